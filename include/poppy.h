@@ -0,0 +1,87 @@
+#ifndef POPPY_H
+#define POPPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* libpoppy */
+/* The emulator as a library for embedding it in other programs (make lib). Nothing in here depends on the
+ * emulator's internal headers, so programs built against it keep working when the machine changes */
+
+#if defined(__GNUC__)
+    #define POPPY_API __attribute__((visibility("default")))
+#else
+    #define POPPY_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct poppy;
+
+/* Why poppyRunCycles returned */
+enum poppystop {
+    POPPY_STOP_CYCLES, /* Ran the requested number of cycles */
+    POPPY_STOP_BREAKPOINT, /* PC reached a breakpoint, poppyStopAddress has it */
+    POPPY_STOP_WATCHPOINT, /* A watched address was accessed, poppyStopAddress has it */
+    POPPY_STOP_REQUEST, /* poppyStop was called */
+    POPPY_STOP_TRAP /* A JMP jumped to itself */
+};
+
+struct poppyregisters {
+    uint16_t pc;
+    uint8_t sp, a, x, y, p;
+};
+
+/* Handlers for an external device, addr is the full address. Either can be NULL */
+typedef uint8_t (*poppyread)(void* ctx, uint16_t addr);
+typedef void (*poppywrite)(void* ctx, uint16_t addr, uint8_t value);
+
+/* Native replacement for a ROM routine, returns false to run the routine after all */
+typedef bool (*poppyhook)(struct poppy* p, void* ctx);
+
+POPPY_API struct poppy* poppyCreate(uint64_t seed);
+POPPY_API void poppyDestroy(struct poppy* p);
+POPPY_API bool poppyLoadROM(struct poppy* p, unsigned rom, const void* data, size_t size);
+POPPY_API bool poppyLoadROMFile(struct poppy* p, unsigned rom, const char* file);
+POPPY_API bool poppyLoadBinary(struct poppy* p, const char* file, uint16_t addr);
+POPPY_API bool poppyLoadConfig(struct poppy* p, const char* file);
+POPPY_API void poppyReset(struct poppy* p);
+POPPY_API void poppySetFastMode(struct poppy* p, bool fast);
+POPPY_API bool poppyUseTranslationCache(struct poppy* p, const char* dir);
+
+POPPY_API enum poppystop poppyRunCycles(struct poppy* p, uint64_t cycles);
+POPPY_API bool poppyCycle(struct poppy* p);
+POPPY_API void poppyStop(struct poppy* p);
+POPPY_API uint16_t poppyStopAddress(const struct poppy* p);
+POPPY_API uint64_t poppyCycles(const struct poppy* p);
+POPPY_API uint64_t poppyInstructions(const struct poppy* p);
+
+POPPY_API void poppyGetRegisters(const struct poppy* p, struct poppyregisters* regs);
+POPPY_API void poppySetRegisters(struct poppy* p, const struct poppyregisters* regs);
+POPPY_API uint8_t poppyPeek(const struct poppy* p, uint16_t addr);
+POPPY_API bool poppyPoke(struct poppy* p, uint16_t addr, uint8_t value);
+
+POPPY_API void poppySetBreakpoint(struct poppy* p, uint16_t addr, bool on);
+POPPY_API void poppySetWatchpoint(struct poppy* p, uint16_t first, uint16_t last, bool read, bool write, bool on);
+
+POPPY_API bool poppySetHook(struct poppy* p, uint16_t addr, poppyhook fn, void* ctx, unsigned cycles);
+
+POPPY_API bool poppySetDevice(struct poppy* p, uint16_t first, uint16_t last, poppyread read, poppywrite write,
+    void* ctx);
+POPPY_API void poppySetWaitStates(struct poppy* p, uint16_t first, uint16_t last, uint8_t cycles);
+POPPY_API void poppySetIRQ(struct poppy* p, bool level);
+POPPY_API void poppyNMI(struct poppy* p);
+POPPY_API void poppySetPortInput(struct poppy* p, unsigned port, uint8_t value);
+POPPY_API uint8_t poppyGetPortOutput(const struct poppy* p, unsigned port);
+POPPY_API bool poppyInsertSDCard(struct poppy* p, const char* file);
+POPPY_API void poppySetHostDirectory(struct poppy* p, const char* dir, unsigned cycles);
+POPPY_API bool poppyLoadDevice(struct poppy* p, const char* file, const char* args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef POPPYDEVICE_H
+#define POPPYDEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Device plugins */
+/* A device plugin is a shared object the emulator loads with -P FILE[=ARGS] (or libpoppy with poppyLoadDevice), for
+ * expansion boards in the $8000-$BFFF I/O space. It exports poppyDeviceInit, which is given the host's API and fills
+ * in the device. Like the rest of libpoppy nothing in here depends on the emulator's internal headers */
+
+#if defined(__GNUC__)
+    #define POPPY_DEVICE_EXPORT __attribute__((visibility("default")))
+#else
+    #define POPPY_DEVICE_EXPORT
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POPPY_DEVICE_VERSION 1 /* version of the API below */
+#define POPPY_DEVICE_STATE 256 /* bytes of state a device keeps in a snapshot */
+
+struct poppydevicehost;
+
+/* What the host offers, the handlers are called on the CPU thread and so have to be the calls into it */
+struct poppydeviceapi {
+    unsigned version; /* POPPY_DEVICE_VERSION of the host */
+    /* Puts handlers on the whole pages from first to last, which have to be in $8000-$BFFF and not taken by another
+     * plugin. They go straight into the page table the built-in devices are in, addr is the full address and either
+     * handler can be NULL. Returns false if the pages cannot be had */
+    bool (*claim)(struct poppydevicehost* host, uint16_t first, uint16_t last,
+        uint8_t (*read)(void* ctx, uint16_t addr), void (*write)(void* ctx, uint16_t addr, uint8_t value), void* ctx);
+    /* Level of the device's own IRQ line, ORed with the other devices' */
+    void (*setIRQ)(struct poppydevicehost* host, bool level);
+    /* Calls fn when the devices are caught up to cycle, which the CPU has just reached. Scheduling the same fn and
+     * ctx again moves the event, UINT64_MAX takes it off. Returns false if there are too many events */
+    bool (*schedule)(struct poppydevicehost* host, uint64_t cycle, void (*fn)(void* ctx, uint64_t cycle), void* ctx);
+    /* The cycle the CPU is at, which is when the handlers are called */
+    uint64_t (*cycles)(const struct poppydevicehost* host);
+};
+
+/* Filled in by poppyDeviceInit, every callback can be NULL */
+struct poppydevice {
+    void* ctx; /* passed to the callbacks */
+    void (*reset)(void* ctx); /* The RESET line */
+    /* Snapshots, state is POPPY_DEVICE_STATE bytes that start out zeroed. Events are not part of a snapshot, load
+     * has to schedule them again from the restored state */
+    void (*save)(void* ctx, uint8_t* state);
+    void (*load)(void* ctx, const uint8_t* state);
+    void (*destroy)(void* ctx); /* The machine goes away */
+};
+
+/* args is what came after = on the command line, "" without it. Returns false if the device cannot be set up */
+typedef bool (*poppydeviceinit)(struct poppydevicehost* host, const struct poppydeviceapi* api, const char* args,
+    struct poppydevice* device);
+POPPY_DEVICE_EXPORT bool poppyDeviceInit(struct poppydevicehost* host, const struct poppydeviceapi* api,
+    const char* args, struct poppydevice* device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
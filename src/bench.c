@@ -0,0 +1,156 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+#include "time.h"
+
+/* Benchmarks */
+/* Built-in ROMs that loop forever over one kind of instruction mix, for measuring the interpreter and the
+ * recompiled code against builds with an optimization taken out (make bench). The VIA's timer 1 interrupts every
+ * 4096 cycles like a system tick, so the device and interrupt paths are part of every run */
+
+#define BENCH_LOOP 0x100 /* $E100, where every workload starts */
+
+/* $E000: the stack, the tick, then the workload */
+static const uint8_t prologue[] = {
+    0xA2, 0xFF,       /* LDX #$FF */
+    0x9A,             /* TXS */
+    0xA9, 0x40,       /* LDA #$40 */
+    0x8D, 0x0B, 0x80, /* STA $800B     ; ACR: timer 1 free-running */
+    0xA9, 0xFE,       /* LDA #$FE */
+    0x8D, 0x04, 0x80, /* STA $8004 */
+    0xA9, 0x0F,       /* LDA #$0F */
+    0x8D, 0x05, 0x80, /* STA $8005     ; every $0FFE + 2 cycles */
+    0xA9, 0xC0,       /* LDA #$C0 */
+    0x8D, 0x0E, 0x80, /* STA $800E     ; IER: timer 1 */
+    0x58,             /* CLI */
+    0x4C, 0x00, 0xE1, /* JMP $E100 */
+};
+
+/* $E080: NMI and IRQ */
+static const uint8_t handler[] = {
+    0x48,             /* PHA */
+    0xAD, 0x04, 0x80, /* LDA $8004     ; acknowledges timer 1 */
+    0x68,             /* PLA */
+    0x40,             /* RTI */
+};
+
+/* Absolute operands, the bytes fetched after the opcode */
+static const uint8_t fetch[] = {
+    0xAD, 0x00, 0x02, /* LDA $0200 */
+    0x8D, 0x01, 0x02, /* STA $0201 */
+    0xAE, 0x02, 0x02, /* LDX $0202 */
+    0x8E, 0x03, 0x02, /* STX $0203 */
+    0xAC, 0x04, 0x02, /* LDY $0204 */
+    0x8C, 0x05, 0x02, /* STY $0205 */
+    0x6D, 0x06, 0x02, /* ADC $0206 */
+    0xEE, 0x07, 0x02, /* INC $0207 */
+    0x4C, 0x00, 0xE1, /* JMP $E100 */
+};
+
+/* A page copy */
+static const uint8_t copy[] = {
+    0xA2, 0x00,       /* LDX #$00 */
+    0xBD, 0x00, 0x02, /* LDA $0200,X */
+    0x9D, 0x00, 0x03, /* STA $0300,X */
+    0xE8,             /* INX */
+    0xD0, 0xF7,       /* BNE $E102 */
+    0x4C, 0x00, 0xE1, /* JMP $E100 */
+};
+
+/* Delay and counting loops */
+static const uint8_t count[] = {
+    0xA2, 0x00,       /* LDX #$00 */
+    0xCA,             /* DEX */
+    0xD0, 0xFD,       /* BNE $E102 */
+    0xA0, 0x00,       /* LDY #$00 */
+    0xC8,             /* INY */
+    0xC0, 0x80,       /* CPY #$80 */
+    0xD0, 0xFB,       /* BNE $E107 */
+    0x4C, 0x00, 0xE1, /* JMP $E100 */
+};
+
+/* Arithmetic on the zero page */
+static const uint8_t add[] = {
+    0xA2, 0x00,       /* LDX #$00 */
+    0x18,             /* CLC */
+    0x65, 0x10,       /* ADC $10 */
+    0x38,             /* SEC */
+    0xE5, 0x11,       /* SBC $11 */
+    0xCA,             /* DEX */
+    0xD0, 0xF7,       /* BNE $E102 */
+    0x4C, 0x00, 0xE1, /* JMP $E100 */
+};
+
+/* A page copy through zero page pointers */
+static const uint8_t indirect[] = {
+    0xA9, 0x00,       /* LDA #$00 */
+    0x85, 0x10,       /* STA $10 */
+    0x85, 0x12,       /* STA $12 */
+    0xA9, 0x02,       /* LDA #$02 */
+    0x85, 0x11,       /* STA $11       ; ($10) = $0200 */
+    0xA9, 0x04,       /* LDA #$04 */
+    0x85, 0x13,       /* STA $13       ; ($12) = $0400 */
+    0xA0, 0x00,       /* LDY #$00 */
+    0xB1, 0x10,       /* LDA ($10),Y */
+    0x91, 0x12,       /* STA ($12),Y */
+    0xC8,             /* INY */
+    0xD0, 0xF9,       /* BNE $E110 */
+    0x4C, 0x0E, 0xE1, /* JMP $E10E */
+};
+
+static const struct {
+    const char* name;
+    const uint8_t* code;
+    size_t length;
+    const char* description;
+} workloads[] = {
+    {"fetch", fetch, sizeof(fetch), "loads, stores and INC on absolute addresses"},
+    {"copy", copy, sizeof(copy), "LDA/STA abs,X page copy"},
+    {"count", count, sizeof(count), "DEX/BNE and INY/CPY/BNE loops"},
+    {"add", add, sizeof(add), "ADC/SBC on the zero page"},
+    {"indirect", indirect, sizeof(indirect), "LDA/STA (zp),Y page copy"},
+};
+
+/* Puts the workload into ROM0 with its vectors, in place of a ROM file */
+bool loadBenchmark(struct machine* m, const char* name) {
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(*workloads); ++i) {
+        if (strcmp(workloads[i].name, name)) continue;
+        memset(m->rom0, 0, sizeof(m->rom0));
+        memcpy(m->rom0, prologue, sizeof(prologue));
+        memcpy(&m->rom0[0x80], handler, sizeof(handler));
+        memcpy(&m->rom0[BENCH_LOOP], workloads[i].code, workloads[i].length);
+        static const uint8_t vectors[] = {0x80, 0xE0, 0x00, 0xE0, 0x80, 0xE0};
+        memcpy(&m->rom0[0x1FFA], vectors, sizeof(vectors));
+        m->romcode = ROMCODE_UNCHECKED;
+        return true;
+    }
+    fprintf(stderr, "Unknown benchmark '%s'\n", name);
+    return false;
+}
+
+void listBenchmarks(void) {
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(*workloads); ++i) {
+        printf("            %-9s %s\n", workloads[i].name, workloads[i].description);
+    }
+}
+
+/* Runs the loaded workload unthrottled for the given number of instructions and prints how fast it went */
+int runBenchmark(struct machine* m, const char* name, uint64_t instructions) {
+    struct timespec start, end;
+    getTime(&start);
+    cpuRun(m, instructions);
+    getTime(&end);
+    subTime(&end, &start);
+
+    double seconds = end.tv_sec + end.tv_nsec / 1e9;
+    printf(
+        "%s: %" PRIu64 " instructions in %.3f s, %.2f M instructions/s (%.2f MHz)\n",
+        name, m->instructions, seconds, seconds > 0 ? m->instructions / seconds / 1e6 : 0,
+        seconds > 0 ? m->cycles / seconds / 1e6 : 0
+    );
+    return m->stop == STOP_NONE ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#ifndef POPPY_BENCH_H
+#define POPPY_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+bool loadBenchmark(struct machine* m, const char* name);
+int runBenchmark(struct machine* m, const char* name, uint64_t instructions);
+void listBenchmarks(void);
+
+#endif
@@ -0,0 +1,52 @@
+#include "breakpoints.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Breakpoints */
+/* Execution breakpoints are a bitmap over the whole address space that is only looked at while any are set, through
+ * EVENT_BREAKPOINTS. Watchpoints cost nothing at all for memory that is not watched: the pages with watched
+ * addresses are taken out of the page table so their accesses go through the slow path, which checks the
+ * watchpoint bitmaps before doing the access */
+
+static inline bool setBit(uint8_t* map, uint16_t addr, bool on) {
+    bool was = testAddress(map, addr);
+    if (on) map[addr >> 3] |= 1U << (addr & 7);
+    else map[addr >> 3] &= ~(1U << (addr & 7));
+    return was;
+}
+
+void setBreakpoint(struct machine* m, uint16_t addr, bool on) {
+    bool was = setBit(m->breakpoints, addr, on);
+    if (on && !was) ++m->breakpointcount;
+    else if (!on && was) --m->breakpointcount;
+    if (m->breakpointcount) raiseEvents(m, EVENT_BREAKPOINTS);
+    else clearEvents(m, EVENT_BREAKPOINTS);
+}
+
+void setWatchpoint(struct machine* m, uint16_t first, uint16_t last, bool read, bool write, bool on) {
+    for (unsigned addr = first; addr <= last; ++addr) {
+        if (read) setBit(m->readwatch, addr, on);
+        if (write) setBit(m->writewatch, addr, on);
+    }
+    mapWatchpoints(m);
+}
+
+static bool pageWatched(const uint8_t* map, unsigned page) {
+    for (unsigned i = page << 5; i < (page + 1) << 5; ++i) {
+        if (map[i]) return true;
+    }
+    return false;
+}
+
+/* Rebuilds the page table with the watched pages taken out of it */
+void mapWatchpoints(struct machine* m) {
+    mapPages(m);
+    for (unsigned page = 0; page < 256; ++page) {
+        bool read = pageWatched(m->readwatch, page);
+        bool write = pageWatched(m->writewatch, page);
+        if (read) m->readpages[page] = NULL;
+        if (write) m->writepages[page] = NULL;
+        if (read || write) m->pageflags[page] |= PAGE_WATCH;
+    }
+}
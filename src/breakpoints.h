@@ -0,0 +1,13 @@
+#ifndef POPPY_BREAKPOINTS_H
+#define POPPY_BREAKPOINTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+void setBreakpoint(struct machine* m, uint16_t addr, bool on);
+void setWatchpoint(struct machine* m, uint16_t first, uint16_t last, bool read, bool write, bool on);
+void mapWatchpoints(struct machine* m);
+
+#endif
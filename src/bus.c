@@ -0,0 +1,279 @@
+#include "machine.h"
+
+#include <stdlib.h>
+
+#include "bus.h"
+#include "via.h"
+#include "hostio.h"
+
+/* Watched pages are taken out of the page table, so only their accesses pay for checking the bitmap */
+static inline void checkWatch(struct machine* m, const uint8_t* map, uint16_t addr) {
+    if ((m->pageflags[addr >> 8] & PAGE_WATCH) && testAddress(map, addr)) {
+        m->stop = STOP_WATCHPOINT;
+        m->stopaddr = addr;
+        raiseEvents(m, EVENT_STOP);
+    }
+}
+
+/* Slow path for everything that is not plain memory in the page table, wait states are charged like in bus.h */
+uint8_t busReadSlow(struct machine* m, uint16_t addr) {
+    busWaitStates(m, addr, 1);
+    if (m->pageflags[addr >> 8] & PAGE_ACCURATE) m->accuratehit = true;
+    checkWatch(m, m->readwatch, addr);
+    const struct pagedevice* device = &m->devices[addr >> 8];
+    if (device->read) return device->read(device->ctx, addr);
+    const struct pagemap* map = &m->memmap[addr >> 8];
+    uint8_t ret;
+    switch (map->region) {
+        case REGION_HOSTIO: /* Host file I/O, floating while it is off */
+            if (m->hostio.dir) {
+                ret = hostioRead(m, addr);
+                break;
+            }
+            /* fall through */
+        default: /* For unused stuff (floating) */
+            /* xorshift64, kept per machine so copies of a machine read the same values */
+            m->floating ^= m->floating << 13;
+            m->floating ^= m->floating >> 7;
+            m->floating ^= m->floating << 17;
+            ret = m->floating;
+            break;
+        case REGION_RAM: /* System memory */
+            ret = m->sysram[map->offset | (addr & 0xFF)];
+            break;
+        case REGION_VIA: /* I/O controller */
+            ret = viaRead(&m->via, addr);
+            updateIRQ(m); /* reads can clear interrupt flags */
+            break;
+        case REGION_ROM1:
+            ret = m->rom1[map->offset | (addr & 0xFF)];
+            break;
+        case REGION_ROM0:
+            ret = m->rom0[map->offset | (addr & 0xFF)];
+            break;
+    }
+    return ret;
+}
+void busWriteSlow(struct machine* m, uint16_t addr, uint8_t value) {
+    busWaitStates(m, addr, 1);
+    if (m->pageflags[addr >> 8] & PAGE_ACCURATE) m->accuratehit = true;
+    checkWatch(m, m->writewatch, addr);
+    const struct pagedevice* device = &m->devices[addr >> 8];
+    if (device->write) {
+        device->write(device->ctx, addr, value);
+        return;
+    }
+    const struct pagemap* map = &m->memmap[addr >> 8];
+    switch (map->region) {
+        default: /* Unused and ROM */
+            break;
+        case REGION_RAM: /* System memory */
+            busLogRAMWrite(m, addr, m->sysram[map->offset | (addr & 0xFF)], value);
+            m->sysram[map->offset | (addr & 0xFF)] = value;
+            break;
+        case REGION_VIA: /* I/O controller */
+            viaWrite(&m->via, addr, value);
+            if ((addr & 0xF) == VIA_ORB || (addr & 0xF) == VIA_DDRB) updateSDCard(m);
+            updateIRQ(m);
+            break;
+        case REGION_HOSTIO: /* Host file I/O */
+            if (m->hostio.dir) hostioWrite(m, addr, value);
+            break;
+        case REGION_BANK:
+            selectBank(m, map->bank, value);
+            break;
+    }
+}
+
+/* Device timers */
+
+static void findNextTimer(struct machine* m) {
+    m->nexttimer = UINT64_MAX;
+    for (unsigned i = 0; i < m->timercount; ++i) {
+        if (m->timers[i].cycle < m->nexttimer) m->nexttimer = m->timers[i].cycle;
+    }
+}
+
+/* Schedules fn for cycle, moving it if the same fn and ctx are already scheduled. UINT64_MAX takes it off, returns
+ * false if there is no room for another one */
+bool setTimer(struct machine* m, uint64_t cycle, void (*fn)(void* ctx, uint64_t cycle), void* ctx) {
+    unsigned i = 0;
+    while (i < m->timercount && (m->timers[i].fn != fn || m->timers[i].ctx != ctx)) ++i;
+    if (cycle == UINT64_MAX) {
+        if (i < m->timercount) m->timers[i] = m->timers[--m->timercount];
+    } else if (i < m->timercount) {
+        m->timers[i].cycle = cycle;
+    } else if (m->timercount < MAX_TIMERS) {
+        m->timers[m->timercount++] = (struct devicetimer){.cycle = cycle, .fn = fn, .ctx = ctx};
+    } else {
+        return false;
+    }
+    findNextTimer(m);
+    return true;
+}
+
+void clearTimers(struct machine* m) {
+    m->timercount = 0;
+    m->nexttimer = UINT64_MAX;
+}
+
+/* Runs the timers that are due in the order of their cycles, they can schedule more */
+void runTimers(struct machine* m) {
+    for (;;) {
+        unsigned due = m->timercount;
+        for (unsigned i = 0; i < m->timercount; ++i) {
+            if (m->timers[i].cycle > m->cycles) continue;
+            if (due == m->timercount || m->timers[i].cycle < m->timers[due].cycle) due = i;
+        }
+        if (due == m->timercount) break;
+        struct devicetimer timer = m->timers[due];
+        m->timers[due] = m->timers[--m->timercount];
+        findNextTimer(m);
+        timer.fn(timer.ctx, timer.cycle);
+    }
+    findNextTimer(m);
+}
+
+/* The memory behind an address (RAM or ROM), NULL if there is none */
+static const uint8_t* memoryAt(const struct machine* m, uint16_t addr) {
+    const struct pagemap* map = &m->memmap[addr >> 8];
+    switch (map->region) {
+        default:
+            return NULL;
+        case REGION_RAM:
+            return &m->sysram[map->offset | (addr & 0xFF)];
+        case REGION_ROM0:
+            return &m->rom0[map->offset | (addr & 0xFF)];
+        case REGION_ROM1:
+            return &m->rom1[map->offset | (addr & 0xFF)];
+    }
+}
+
+/* The system memory behind len bytes from addr, for native code that accesses it in one go. NULL unless all of it is
+ * RAM and in one piece there, which is up to the memory map */
+uint8_t* ramRange(struct machine* m, uint16_t addr, unsigned len) {
+    if (!len) return m->sysram;
+    if (addr + len > 0x10000 || m->memmap[addr >> 8].region != REGION_RAM) return NULL;
+    unsigned start = m->memmap[addr >> 8].offset | (addr & 0xFF);
+    for (unsigned page = (addr >> 8) + 1; page <= (addr + len - 1) >> 8; ++page) {
+        const struct pagemap* map = &m->memmap[page];
+        if (map->region != REGION_RAM || map->offset != start + ((page << 8) - addr)) return NULL;
+    }
+    return &m->sysram[start];
+}
+
+/* Write straight into the memory behind an address (RAM or ROM) without a bus access,
+ * returns false if there is no memory there */
+bool pokeByte(struct machine* m, uint16_t addr, uint8_t value) {
+    uint8_t* mem = (uint8_t*)memoryAt(m, addr);
+    if (!mem) return false;
+    *mem = value;
+    if (m->memmap[addr >> 8].region != REGION_RAM) m->romcode = ROMCODE_UNCHECKED;
+    return true;
+}
+
+/* Read plain memory without a bus access, addresses that are not mapped to memory read as $FF. Watched pages are
+ * not in the page table, their memory is found through the memory map */
+uint8_t peekByte(const struct machine* m, uint16_t addr) {
+    const uint8_t* page = m->readpages[addr >> 8];
+    if (page) return page[addr & 0xFF];
+    const uint8_t* mem = memoryAt(m, addr);
+    return mem ? *mem : 0xFF;
+}
+
+/* The Odin32K's own memory map, without banks */
+void mapDefault(struct machine* m) {
+    for (unsigned page = 0; page < 256; ++page) {
+        struct pagemap* map = &m->memmap[page];
+        *map = (struct pagemap){.region = REGION_NONE};
+        switch (page >> 4) { /* switch case the top 4 bits of the address (1 hex digit) */
+            default: /* $9000-$AFFF is for the serial ports (TODO) */
+                break;
+            case 0x0 ... 0x7: /* System memory */
+                *map = (struct pagemap){.region = REGION_RAM, .offset = page << 8};
+                break;
+            case 0x8: /* I/O controller */
+                map->region = REGION_VIA;
+                break;
+            case 0xB: /* Host file I/O */
+                map->region = REGION_HOSTIO;
+                break;
+            case 0xC ... 0xD: /* ROM 1 */
+                *map = (struct pagemap){.region = REGION_ROM1, .offset = (page << 8) & 0x1FFF};
+                break;
+            case 0xE ... 0xF: /* ROM 0 */
+                *map = (struct pagemap){.region = REGION_ROM0, .offset = (page << 8) & 0x1FFF};
+                break;
+        }
+    }
+    m->bankcount = 0;
+}
+
+/* Build the page table from the memory map, plain memory gets a host pointer and everything else goes through the
+ * slow path */
+void mapPages(struct machine* m) {
+    for (unsigned page = 0; page < 256; ++page) {
+        const struct pagemap* map = &m->memmap[page];
+        m->readpages[page] = NULL;
+        m->writepages[page] = NULL;
+        m->pageflags[page] = 0;
+        switch (map->region) {
+            default:
+                break;
+            case REGION_RAM:
+                m->readpages[page] = &m->sysram[map->offset];
+                m->writepages[page] = &m->sysram[map->offset];
+                break;
+            case REGION_VIA: /* the VIA timers make bus timing matter */
+                m->pageflags[page] = PAGE_ACCURATE;
+                break;
+            case REGION_ROM0:
+                m->readpages[page] = &m->rom0[map->offset];
+                break;
+            case REGION_ROM1:
+                m->readpages[page] = &m->rom1[map->offset];
+                break;
+        }
+    }
+    m->codepagenum = 0x100; /* invalidate the cached code page */
+    m->romcode = ROMCODE_UNCHECKED;
+}
+
+/* Shows bank number (modulo the number of banks) in a bank window. The page table follows before the next
+ * instruction, which also makes recompiled code check its ROMs again */
+void selectBank(struct machine* m, unsigned bank, uint8_t number) {
+    struct bank* b = &m->banks[bank];
+    b->selected = number % b->count;
+    const struct pagemap* source = &b->sources[b->selected];
+    for (unsigned page = b->first; page <= b->last; ++page) {
+        m->memmap[page] = (struct pagemap){
+            .region = source->region, .offset = source->offset + ((page - b->first) << 8)
+        };
+    }
+    raiseEvents(m, EVENT_REMAP);
+}
+
+/* Makes every access to the pages from first to last take cycles more, recompiled ROM code picks them up when a
+ * block starts */
+void setWaitStates(struct machine* m, uint16_t first, uint16_t last, uint8_t cycles) {
+    for (unsigned page = first >> 8; page <= (unsigned)last >> 8; ++page) m->waitstates[page] = cycles;
+}
+
+/* Map the whole address space as plain RAM from mem (64K), for running CPU tests without the Odin32K memory map */
+void mapFlat(struct machine* m, uint8_t* mem) {
+    for (unsigned page = 0; page < 256; ++page) {
+        m->readpages[page] = &mem[page << 8];
+        m->writepages[page] = &mem[page << 8];
+        m->pageflags[page] = 0;
+    }
+    m->codepagenum = 0x100;
+    m->romcode = ROMCODE_MISMATCH; /* $C000-$FFFF is RAM that can change under the recompiled code */
+}
+
+uint64_t ramHash(const struct machine* m) {
+    uint64_t hash = 0;
+    for (unsigned addr = 0; addr < 0x8000; ++addr) {
+        hash ^= ramHashEntry(addr, m->sysram[addr]);
+    }
+    return hash;
+}
@@ -0,0 +1,230 @@
+#ifndef POPPY_BUS_H
+#define POPPY_BUS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "options.h"
+#include "machine.h"
+#include "time.h"
+#include "via.h"
+
+/* The bus functions take an accurate parameter that is always a constant, the accurate core steps the devices
+ * and paces on every cycle while the fast core only counts cycles and leaves the rest to the end of the
+ * instruction. With BUS_BLOCK_CYCLES defined before this header (recompiled ROM code) the fast core does not even
+ * count them, a block charges the cycles its instructions always take at once and only page crossings and taken
+ * branches count as they happen. Wait states are charged on top of the access' own cycle, the devices see the
+ * access at the start of them and catch up with them at their next step. A block folds the ones of its own opcode
+ * and operand fetches into its totals as well */
+
+/* Timing */
+static const uint64_t clocktime = 1000000000 / CLOCK_SPEED;
+/* Wait until the host clock catches up with the emulated cycles */
+static inline void pace(struct machine* m) {
+    uint64_t n = m->cycles - m->pacedcycles;
+    if (!n) return;
+    m->pacedcycles = m->cycles;
+    if (m->fastmode) return; /* No pacing in fast mode */
+    int64_t nanosec = clocktime * n;
+    m->targettime.tv_nsec += nanosec % 1000000000;
+    m->targettime.tv_sec += m->targettime.tv_nsec / 1000000000;
+    m->targettime.tv_nsec %= 1000000000;
+    m->targettime.tv_sec += nanosec / 1000000000;
+    waitUntil(&m->targettime);
+}
+/* Keep EVENT_IRQ in line with the IRQ output of the devices, the events word is only touched when it changes */
+static inline void updateIRQ(struct machine* m) {
+    bool irq = viaIRQ(&m->via) || m->extirq;
+    if (irq == m->irqline) return;
+    m->irqline = irq;
+    if (irq) raiseEvents(m, EVENT_IRQ);
+    else clearEvents(m, EVENT_IRQ);
+}
+/* Drive the SD card with the levels on port B and MISO back from it, after port B or the card changes */
+static inline void updateSDCard(struct machine* m) {
+    if (!m->sdcard.image) return;
+    struct via* via = &m->via;
+    bool miso = sdcardPins(&m->sdcard, (via->orb & via->ddrb) | (via->pinb & ~via->ddrb));
+    via->pinb = (via->pinb & ~SD_MISO) | (miso ? SD_MISO : 0);
+}
+/* Cycles from devicecycles on before a device can raise an interrupt if nothing accesses it */
+static inline uint32_t quietCycles(const struct machine* m) {
+    uint32_t quiet = viaQuietCycles(&m->via);
+    if (m->nexttimer <= m->devicecycles) return 0;
+    if (m->nexttimer - m->devicecycles < quiet) quiet = m->nexttimer - m->devicecycles;
+    return quiet;
+}
+/* Step the devices up to the current cycle */
+static inline void syncDevices(struct machine* m) {
+    if (m->devicecycles == m->cycles) return;
+    viaTick(&m->via, m->cycles - m->devicecycles);
+    m->devicecycles = m->cycles;
+    if (m->cycles >= m->nexttimer) runTimers(m);
+    updateIRQ(m);
+}
+static inline void busCycles(struct machine* m, unsigned n, bool accurate) {
+    #ifdef BUS_BLOCK_CYCLES
+    if (!accurate) return;
+    #endif
+    m->cycles += n;
+    if (accurate) {
+        syncDevices(m);
+        pace(m);
+    }
+}
+
+/* Wait states of the page addr is in, for n accesses */
+static inline void busWaitStates(struct machine* m, uint16_t addr, unsigned n) {
+    unsigned waits = m->waitstates[addr >> 8];
+    if (waits) m->cycles += waits * n; /* most pages have none, which leaves the cycle counter alone */
+}
+/* The same for opcode and operand fetches, which a block charges itself */
+static inline void busCodeWaitStates(struct machine* m, uint16_t addr, unsigned n, bool accurate) {
+    #ifdef BUS_BLOCK_CYCLES
+    if (!accurate) return;
+    #endif
+    (void)accurate;
+    busWaitStates(m, addr, n);
+}
+
+/* Bus tracing */
+static inline void busLog(struct machine* m, uint16_t addr, uint8_t value, bool write) {
+    if (!m->tracebus) return;
+    if (m->buslogcount < BUSLOG_SIZE) {
+        m->buslog[m->buslogcount] = (struct busaccess){.addr = addr, .value = value, .write = write};
+    }
+    ++m->buslogcount;
+    if (write) m->fingerprint = fingerprintMix(m->fingerprint, (uint32_t)addr << 8 | value);
+}
+/* RAM is hashed by where a byte is in system memory, which is not its address if the memory map moves it */
+static inline void busLogRAMWrite(struct machine* m, uint16_t addr, uint8_t old, uint8_t value) {
+    if (!m->tracebus || m->memmap[addr >> 8].region != REGION_RAM) return;
+    unsigned offset = m->memmap[addr >> 8].offset | (addr & 0xFF);
+    m->ramhash ^= ramHashEntry(offset, old) ^ ramHashEntry(offset, value);
+    m->dirtypages[offset >> 14] |= 1ULL << ((offset >> 8) & 63);
+}
+
+/* I/O */
+static inline uint8_t busRead(struct machine* m, uint16_t addr, bool accurate) {
+    busCycles(m, 1, accurate); /* Reading takes 1 cycle */
+    const uint8_t* page = m->readpages[addr >> 8];
+    uint8_t ret;
+    if (page) {
+        busWaitStates(m, addr, 1);
+        ret = page[addr & 0xFF];
+    } else {
+        ret = busReadSlow(m, addr);
+    }
+    busLog(m, addr, ret, false);
+    #if VERBOSE >= 3
+    printf("R  --  0x%04X: 0x%02X\n", addr, ret);
+    #endif
+    return ret;
+}
+static inline void busWrite(struct machine* m, uint16_t addr, uint8_t value, bool accurate) {
+    busCycles(m, 1, accurate); /* Writing takes 1 cycle */
+    uint8_t* page = m->writepages[addr >> 8];
+    if (page) {
+        busWaitStates(m, addr, 1);
+        busLogRAMWrite(m, addr, page[addr & 0xFF], value);
+        page[addr & 0xFF] = value;
+    } else {
+        busWriteSlow(m, addr, value);
+    }
+    busLog(m, addr, value, true);
+    #if VERBOSE >= 3
+    printf("W  --  0x%04X: 0x%02X\n", addr, value);
+    #endif
+}
+
+/* Dummy reads */
+/* The CPU does reads whose value is thrown away, these only matter when they hit a device with read side effects
+ * so in fast mode the fast core only counts the ones that hit plain memory (RAM and ROM) as a cycle */
+static inline void busDummyRead(struct machine* m, uint16_t addr, bool accurate) {
+    if (!accurate && m->fastmode && m->readpages[addr >> 8]) {
+        busCycles(m, 1, false);
+        busWaitStates(m, addr, 1);
+        busLog(m, addr, m->readpages[addr >> 8][addr & 0xFF], false); /* logged like the read it stands in for */
+        return;
+    }
+    busRead(m, addr, accurate);
+}
+/* Dummy reads on a page crossing or a taken branch, the ones a block cannot charge up front */
+static inline void busPenaltyRead(struct machine* m, uint16_t addr, bool accurate) {
+    busDummyRead(m, addr, accurate);
+    #ifdef BUS_BLOCK_CYCLES
+    if (!accurate) ++m->cycles;
+    #endif
+}
+
+/* Opcode fetch */
+/* Opcodes and operands come through the page table like any other read, but an operand that does not cross a page
+ * is read in a single 16-bit load. The page table lookup is a single load already, so the cached code page pointer
+ * (codepage) did not pay for its compare and reload on most workloads and is only built as make bench's codepage
+ * variant */
+#ifdef POPPY_CODEPAGE
+    #define BUS_CODEPAGE true
+#else
+    #define BUS_CODEPAGE false
+#endif
+static inline void invalidateCodePage(struct machine* m) {
+    m->codepagenum = 0x100;
+}
+/* Host pointer of the page addr is in, NULL if it has to go through the slow path */
+static inline const uint8_t* busCodePage(struct machine* m, uint16_t addr) {
+    if (!BUS_CODEPAGE) return m->readpages[addr >> 8];
+    if ((unsigned)(addr >> 8) != m->codepagenum) {
+        m->codepagenum = addr >> 8;
+        m->codepage = m->readpages[m->codepagenum];
+    }
+    return m->codepage;
+}
+static inline uint8_t busReadCode(struct machine* m, uint16_t addr, bool accurate) {
+    const uint8_t* page = busCodePage(m, addr);
+    if (!page) return busRead(m, addr, accurate);
+    busCycles(m, 1, accurate);
+    busCodeWaitStates(m, addr, 1, accurate);
+    uint8_t ret = page[addr & 0xFF];
+    busLog(m, addr, ret, false);
+    #if VERBOSE >= 3
+    printf("R  --  0x%04X: 0x%02X\n", addr, ret);
+    #endif
+    return ret;
+}
+static inline uint8_t busFetchByte(struct machine* m, bool accurate) {
+    return busReadCode(m, m->registers.pc++, accurate);
+}
+static inline uint16_t busFetchWord(struct machine* m, bool accurate) {
+    /* The accurate core has to step the devices between the two reads so it always reads them one by one */
+    const uint8_t* page = accurate || (m->registers.pc & 0xFF) == 0xFF ? NULL : busCodePage(m, m->registers.pc);
+    if (!page) {
+        uint16_t ret = busFetchByte(m, accurate);
+        ret |= (uint16_t)busFetchByte(m, accurate) << 8;
+        return ret;
+    }
+    const uint8_t* ptr = page + (m->registers.pc & 0xFF);
+    uint16_t ret = ptr[0] | (uint16_t)ptr[1] << 8;
+    busCycles(m, 2, false);
+    busCodeWaitStates(m, m->registers.pc, 2, false);
+    busLog(m, m->registers.pc, ptr[0], false);
+    busLog(m, m->registers.pc + 1, ptr[1], false);
+    #if VERBOSE >= 3
+    printf("R  --  0x%04X: 0x%02X\n", m->registers.pc, ptr[0]);
+    printf("R  --  0x%04X: 0x%02X\n", (uint16_t)(m->registers.pc + 1), ptr[1]);
+    #endif
+    m->registers.pc += 2;
+    return ret;
+}
+
+/* Stack */
+static inline void busPush(struct machine* m, uint8_t value, bool accurate) {
+    busWrite(m, 0x0100 | m->registers.sp, value, accurate);
+    --m->registers.sp;
+}
+static inline uint8_t busPop(struct machine* m, bool accurate) {
+    ++m->registers.sp;
+    return busRead(m, 0x0100 | m->registers.sp, accurate);
+}
+
+#endif
@@ -0,0 +1,355 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "bus.h"
+#include "breakpoints.h"
+#include "plugin.h"
+
+/* Machine descriptions */
+/* An INI file that lays out the address space of another board revision without rebuilding the emulator. It is
+ * compiled into the memory map and the device list once when it is loaded, so running costs the same as with the
+ * Odin32K's own map. Every section puts something on the whole pages of its at range, a later section taking pages
+ * from an earlier one, and pages no section mentions float:
+ *
+ *   [ram]     at = $0000-$7FFF, offset = $0000        system memory (32K) from offset on
+ *   [rom]     at = $E000-$FFFF, chip = 0, offset = $0000, file = odin.rom
+ *                                                     ROM0 or ROM1 (8K each), file is loaded into it
+ *   [mirror]  at = $4000-$5FFF, of = $0000            what the pages from of on are at that point
+ *   [bank]    at = $C000-$DFFF, register = $A000, banks = rom1:$0000 ram:$4000
+ *                                                     a window showing one of the memories in banks, picked by
+ *                                                     writing its number to the register's page, 0 after reset
+ *   [device]  type = via, at = $8000-$8FFF            the I/O controller
+ *   [device]  type = hostio, at = $B000-$BFFF         host file I/O (-V)
+ *   [device]  type = plugin, file = dev.so, args = ...
+ *                                                     a device plugin, which claims its own pages
+ *
+ * Every section with pages can also have wait = CYCLES, which every access to them takes on top of its own (a
+ * plugin's pages are given with at for that), and a mirror has the wait states of what it mirrors without it. Keys go
+ * one per line. Addresses are $1234, 0x1234 or decimal, files are relative to the description and ; and #
+ * start comments */
+
+#define MAX_KEYS 8
+
+struct description {
+    struct machine* m;
+    const char* file;
+    char dir[4096]; /* of the file, empty or ending in a / */
+};
+
+/* A section as it is read, it is compiled when it ends */
+struct section {
+    char name[16];
+    unsigned line;
+    unsigned count;
+    char keys[MAX_KEYS][16];
+    char values[MAX_KEYS][256];
+    bool used[MAX_KEYS]; /* looked up by the section's kind, the rest are unknown */
+};
+
+static bool fail(const struct description* d, unsigned line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "'%s' line %u: ", d->file, line);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return false;
+}
+
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str)) ++str;
+    size_t len = strlen(str);
+    while (len && isspace((unsigned char)str[len - 1])) str[--len] = 0;
+    return str;
+}
+
+/* NULL if the section does not have the key */
+static const char* value(struct section* s, const char* key) {
+    for (unsigned i = 0; i < s->count; ++i) {
+        if (strcmp(s->keys[i], key)) continue;
+        s->used[i] = true;
+        return s->values[i];
+    }
+    return NULL;
+}
+
+/* $1234, 0x1234 or plain decimal, up to max */
+static bool parseNumber(const char* str, unsigned long max, unsigned long* out) {
+    char* end;
+    unsigned long number = str[0] == '$' ? strtoul(str + 1, &end, 16) : strtoul(str, &end, 0);
+    if (end == str || (end == str + 1 && str[0] == '$') || *end || number > max) return false;
+    *out = number;
+    return true;
+}
+
+/* A number the section can leave out, out keeps its default then */
+static bool optionalNumber(const struct description* d, struct section* s, const char* key, unsigned long max,
+    unsigned long* out) {
+    const char* str = value(s, key);
+    if (str && !parseNumber(str, max, out)) return fail(d, s->line, "Invalid %s '%s'", key, str);
+    return true;
+}
+static bool number(const struct description* d, struct section* s, const char* key, unsigned long max,
+    unsigned long* out) {
+    if (!value(s, key)) return fail(d, s->line, "[%s] needs %s", s->name, key);
+    return optionalNumber(d, s, key, max, out);
+}
+
+/* The whole pages of the section's at range */
+static bool pages(const struct description* d, struct section* s, unsigned* first, unsigned* last) {
+    const char* str = value(s, "at");
+    if (!str) return fail(d, s->line, "[%s] needs at", s->name);
+    char buffer[256];
+    strcpy(buffer, str);
+    char* dash = strchr(buffer, '-');
+    unsigned long from, to;
+    if (dash) *dash = 0;
+    if (!dash || !parseNumber(trim(buffer), 0xFFFF, &from) || !parseNumber(trim(dash + 1), 0xFFFF, &to) ||
+        from > to) {
+        return fail(d, s->line, "Invalid range '%s', it has to be FIRST-LAST", str);
+    }
+    if ((from & 0xFF) || (to & 0xFF) != 0xFF) return fail(d, s->line, "'%s' is not whole pages", str);
+    *first = from >> 8;
+    *last = to >> 8;
+    return true;
+}
+
+/* Bank windows keep their pages, they are mapped again whenever the bank changes */
+static bool claimPages(const struct description* d, const struct section* s, unsigned first, unsigned last) {
+    const struct machine* m = d->m;
+    for (unsigned i = 0; i < m->bankcount; ++i) {
+        if (first <= m->banks[i].last && last >= m->banks[i].first) {
+            return fail(d, s->line, "[%s] overlaps a bank window", s->name);
+        }
+    }
+    return true;
+}
+
+/* Puts memory on pages first to last, from offset in the memory of region */
+static bool mapMemory(const struct description* d, const struct section* s, unsigned first, unsigned last,
+    enum region region, unsigned long offset) {
+    unsigned long size = region == REGION_RAM ? sizeof(d->m->sysram) : sizeof(d->m->rom0);
+    if (offset & 0xFF) return fail(d, s->line, "The offset has to be a whole page");
+    if (offset + ((last - first + 1) << 8) > size) return fail(d, s->line, "[%s] does not fit in the memory", s->name);
+    if (!claimPages(d, s, first, last)) return false;
+    for (unsigned page = first; page <= last; ++page) {
+        d->m->memmap[page] = (struct pagemap){.region = region, .offset = offset + ((page - first) << 8)};
+    }
+    return true;
+}
+
+/* Wait states of the section's pages, none without a wait key */
+static bool waitStates(const struct description* d, struct section* s, unsigned first, unsigned last) {
+    unsigned long cycles = 0;
+    if (!optionalNumber(d, s, "wait", 255, &cycles)) return false;
+    for (unsigned page = first; page <= last; ++page) d->m->waitstates[page] = cycles;
+    return true;
+}
+
+/* Files are relative to the description */
+static const char* path(const struct description* d, const char* file, char* buffer, size_t size) {
+    if (file[0] == '/' || !d->dir[0]) return file;
+    snprintf(buffer, size, "%s%s", d->dir, file);
+    return buffer;
+}
+
+/* Sections */
+
+static bool compileRAM(const struct description* d, struct section* s) {
+    unsigned first, last;
+    unsigned long offset = 0;
+    if (!pages(d, s, &first, &last) || !optionalNumber(d, s, "offset", 0xFFFF, &offset)) return false;
+    return mapMemory(d, s, first, last, REGION_RAM, offset) && waitStates(d, s, first, last);
+}
+
+static bool compileROM(const struct description* d, struct section* s) {
+    unsigned first, last;
+    unsigned long chip, offset = 0;
+    if (!pages(d, s, &first, &last) || !number(d, s, "chip", 1, &chip) ||
+        !optionalNumber(d, s, "offset", 0xFFFF, &offset)) {
+        return false;
+    }
+    if (!mapMemory(d, s, first, last, chip ? REGION_ROM1 : REGION_ROM0, offset) || !waitStates(d, s, first, last)) {
+        return false;
+    }
+    const char* file = value(s, "file");
+    char buffer[4352];
+    return !file || loadROM(d->m, path(d, file, buffer, sizeof(buffer)), chip);
+}
+
+static bool compileMirror(const struct description* d, struct section* s) {
+    struct machine* m = d->m;
+    unsigned first, last;
+    unsigned long of;
+    if (!pages(d, s, &first, &last) || !number(d, s, "of", 0xFFFF, &of)) return false;
+    unsigned count = last - first + 1;
+    if ((of & 0xFF) || (of >> 8) + count > 256) return fail(d, s->line, "Invalid mirror of '%s'", value(s, "of"));
+    if (!claimPages(d, s, of >> 8, (of >> 8) + count - 1)) return false; /* it would not follow the bank */
+    if (!claimPages(d, s, first, last)) return false;
+    struct pagemap source[256];
+    memcpy(source, &m->memmap[of >> 8], count * sizeof(*source));
+    memcpy(&m->memmap[first], source, count * sizeof(*source));
+    uint8_t waits[256]; /* the same as the pages it mirrors unless it has its own */
+    memcpy(waits, &m->waitstates[of >> 8], count);
+    memcpy(&m->waitstates[first], waits, count);
+    return !value(s, "wait") || waitStates(d, s, first, last);
+}
+
+static bool compileBank(const struct description* d, struct section* s) {
+    struct machine* m = d->m;
+    unsigned first, last;
+    unsigned long reg;
+    if (!pages(d, s, &first, &last) || !number(d, s, "register", 0xFFFF, &reg)) return false;
+    const char* list = value(s, "banks");
+    if (!list) return fail(d, s->line, "[bank] needs banks");
+    if (m->bankcount == MAX_BANKS) return fail(d, s->line, "Too many banks, at most %d windows", MAX_BANKS);
+    if (!claimPages(d, s, first, last) || !claimPages(d, s, reg >> 8, reg >> 8)) return false;
+    if (reg >> 8 >= first && reg >> 8 <= last) return fail(d, s->line, "The bank register is in its own window");
+    struct bank bank = {.first = first, .last = last};
+    char buffer[256];
+    strcpy(buffer, list);
+    for (char* source = strtok(buffer, " ,\t"); source; source = strtok(NULL, " ,\t")) {
+        char* colon = strchr(source, ':');
+        unsigned long offset = 0;
+        if (colon) *colon++ = 0;
+        enum region region;
+        if (!strcmp(source, "ram")) {
+            region = REGION_RAM;
+        } else if (!strcmp(source, "rom0")) {
+            region = REGION_ROM0;
+        } else if (!strcmp(source, "rom1")) {
+            region = REGION_ROM1;
+        } else {
+            return fail(d, s->line, "Unknown memory '%s', it has to be ram, rom0 or rom1", source);
+        }
+        if (colon && !parseNumber(colon, 0xFFFF, &offset)) return fail(d, s->line, "Invalid offset '%s'", colon);
+        unsigned long size = region == REGION_RAM ? sizeof(m->sysram) : sizeof(m->rom0);
+        if ((offset & 0xFF) || offset + ((last - first + 1) << 8) > size) {
+            return fail(d, s->line, "Bank %s:$%04lX does not fit in the memory", source, offset);
+        }
+        if (bank.count == MAX_BANK_SOURCES) return fail(d, s->line, "Too many banks, at most %d", MAX_BANK_SOURCES);
+        bank.sources[bank.count++] = (struct pagemap){.region = region, .offset = offset};
+    }
+    if (!bank.count) return fail(d, s->line, "[bank] needs banks");
+    m->banks[m->bankcount] = bank;
+    m->memmap[reg >> 8] = (struct pagemap){.region = REGION_BANK, .bank = m->bankcount};
+    m->waitstates[reg >> 8] = 0;
+    selectBank(m, m->bankcount++, 0);
+    return waitStates(d, s, first, last);
+}
+
+static bool compileDevice(const struct description* d, struct section* s) {
+    const char* type = value(s, "type");
+    if (!type) return fail(d, s->line, "[device] needs type");
+    if (!strcmp(type, "plugin")) {
+        const char* file = value(s, "file");
+        if (!file) return fail(d, s->line, "[device] needs file for a plugin");
+        char buffer[4352];
+        if (!loadPlugin(d->m, path(d, file, buffer, sizeof(buffer)), value(s, "args"))) return false;
+        /* The plugin claims its pages itself, at is only needed for their wait states */
+        unsigned first, last;
+        return !value(s, "wait") || (pages(d, s, &first, &last) && waitStates(d, s, first, last));
+    }
+    enum region region;
+    if (!strcmp(type, "via")) {
+        region = REGION_VIA;
+    } else if (!strcmp(type, "hostio")) {
+        region = REGION_HOSTIO;
+    } else {
+        return fail(d, s->line, "Unknown device '%s', it has to be via, hostio or plugin", type);
+    }
+    unsigned first, last;
+    if (!pages(d, s, &first, &last) || !claimPages(d, s, first, last)) return false;
+    for (unsigned page = first; page <= last; ++page) d->m->memmap[page] = (struct pagemap){.region = region};
+    return waitStates(d, s, first, last);
+}
+
+static bool compileSection(const struct description* d, struct section* s) {
+    bool ok;
+    if (!strcmp(s->name, "ram")) {
+        ok = compileRAM(d, s);
+    } else if (!strcmp(s->name, "rom")) {
+        ok = compileROM(d, s);
+    } else if (!strcmp(s->name, "mirror")) {
+        ok = compileMirror(d, s);
+    } else if (!strcmp(s->name, "bank")) {
+        ok = compileBank(d, s);
+    } else if (!strcmp(s->name, "device")) {
+        ok = compileDevice(d, s);
+    } else {
+        return fail(d, s->line, "Unknown section [%s]", s->name);
+    }
+    for (unsigned i = 0; ok && i < s->count; ++i) {
+        if (!s->used[i]) return fail(d, s->line, "Unknown key '%s' in [%s]", s->keys[i], s->name);
+    }
+    return ok;
+}
+
+/* Replaces the memory map and loads the ROMs and plugins the description in file has. The machine can be left half
+ * set up if it fails */
+bool loadConfig(struct machine* m, const char* file) {
+    FILE* fp = fopen(file, "r");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return false;
+    }
+    struct description d = {.m = m, .file = file};
+    const char* slash = strrchr(file, '/');
+    if (slash && (size_t)(slash - file) < sizeof(d.dir) - 1) memcpy(d.dir, file, slash - file + 1);
+    for (unsigned page = 0; page < 256; ++page) m->memmap[page] = (struct pagemap){.region = REGION_NONE};
+    memset(m->waitstates, 0, sizeof(m->waitstates));
+    m->bankcount = 0;
+
+    struct section s = {0};
+    char buffer[512];
+    bool ok = true;
+    for (unsigned line = 1; ok && fgets(buffer, sizeof(buffer), fp); ++line) {
+        if (!strchr(buffer, '\n') && !feof(fp)) {
+            ok = fail(&d, line, "Line too long");
+            break;
+        }
+        buffer[strcspn(buffer, ";#")] = 0;
+        char* str = trim(buffer);
+        if (!*str) continue;
+        if (*str == '[') {
+            size_t len = strlen(str);
+            if (str[len - 1] != ']' || len - 2 >= sizeof(s.name)) {
+                ok = fail(&d, line, "Invalid section '%s'", str);
+                break;
+            }
+            if (s.line) ok = compileSection(&d, &s);
+            memset(&s, 0, sizeof(s));
+            memcpy(s.name, str + 1, len - 2);
+            s.line = line;
+            continue;
+        }
+        char* equals = strchr(str, '=');
+        if (!s.line) {
+            ok = fail(&d, line, "Keys have to be in a section");
+        } else if (!equals) {
+            ok = fail(&d, line, "Expected KEY = VALUE");
+        } else if (s.count == MAX_KEYS) {
+            ok = fail(&d, line, "Too many keys in [%s]", s.name);
+        } else {
+            *equals = 0;
+            char* key = trim(str);
+            char* val = trim(equals + 1);
+            if (strlen(key) >= sizeof(s.keys[0]) || strlen(val) >= sizeof(s.values[0])) {
+                ok = fail(&d, line, "'%s' is too long", key);
+            } else {
+                strcpy(s.keys[s.count], key);
+                strcpy(s.values[s.count++], val);
+            }
+        }
+    }
+    if (ok && s.line) ok = compileSection(&d, &s);
+    fclose(fp);
+    mapWatchpoints(m);
+    return ok;
+}
@@ -0,0 +1,10 @@
+#ifndef POPPY_CONFIG_H
+#define POPPY_CONFIG_H
+
+#include <stdbool.h>
+
+#include "machine.h"
+
+bool loadConfig(struct machine* m, const char* file);
+
+#endif
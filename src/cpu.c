@@ -0,0 +1,216 @@
+#include "cpu.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "options.h"
+#include "bus.h"
+#include "time.h"
+#include "ucode.h"
+#include "breakpoints.h"
+#include "symbols.h"
+#include "hle.h"
+#include "recompile.h"
+#include "sequencer.h"
+#include "disasm.h"
+
+/* Fast core, steps a whole instruction at a time and the devices catch up at the end of it */
+#define CORE_ACCURATE false
+#define CORE_STEP cpuStepFast
+#include "opcodes.h"
+#undef CORE_ACCURATE
+#undef CORE_STEP
+
+/* Accurate core, the cycle-stepped state machine in sequencer.c run to the end of the instruction */
+static inline void cpuStepAccurate(struct machine* m) {
+    while (!sequencerCycle(m)) {}
+}
+
+/* Instructions the auto core stays on the accurate core after the last access to a PAGE_ACCURATE page */
+#define ACCURATE_HOLD 64
+
+void printRegisters(const struct registers* regs) {
+    printf(
+        "PC: 0x%04X  SP: 0x%02X  -  A: 0x%02X  X: 0x%02X  Y: 0x%02X  -  P:",
+        regs->pc, regs->sp, regs->a, regs->x, regs->y
+    );
+    for (register int i = 7; i >= 0; --i) {
+        static const char flagchars[8] = {'C', 'Z', 'I', 'D', 0, 0, 'V', 'N'};
+        if (!flagchars[i]) continue;
+        putchar(' ');
+        putchar(flagchars[i]);
+        putchar(':');
+        putchar('0' + ((regs->p >> i) & 1));
+    }
+    putchar('\n');
+}
+
+/* Interrupt entry, the same sequence as BRK without the opcode fetch and the B flag */
+static inline void interruptSequence(struct machine* m, uint16_t vector, bool accurate) {
+    busDummyRead(m, m->registers.pc, accurate);
+    busDummyRead(m, m->registers.pc, accurate);
+    busPush(m, m->registers.pc >> 8, accurate);
+    busPush(m, m->registers.pc, accurate);
+    busPush(m, (m->registers.p & ~FLAG_BREAK) | FLAG_ONE, accurate);
+    m->registers.p = (m->registers.p | FLAG_IRQDISABLE) & ~FLAG_DECIMAL;
+    m->registers.pc = busRead(m, vector, accurate);
+    m->registers.pc |= (uint16_t)busRead(m, vector + 1, accurate) << 8;
+}
+static void cpuInterrupt(struct machine* m, uint16_t vector) {
+    bool accurate = (m->pageflags[m->registers.pc >> 8] | m->pageflags[0x01] | m->pageflags[0xFF]) & PAGE_ACCURATE;
+    if (m->core == CORE_ACCURATE || (m->core == CORE_AUTO && (m->accuratehold || accurate))) {
+        interruptSequence(m, vector, true);
+    } else {
+        interruptSequence(m, vector, false);
+    }
+    syncDevices(m);
+    pace(m);
+}
+
+static inline bool checkBreakpoint(struct machine* m, unsigned events) {
+    if ((events & EVENT_BREAKPOINTS) && m->stop == STOP_NONE && testAddress(m->breakpoints, m->registers.pc)) {
+        m->stop = STOP_BREAKPOINT;
+        m->stopaddr = m->registers.pc;
+        return true;
+    }
+    return false;
+}
+
+/* Slow path of cpuStep for when any events are pending, returns true if the run has to stop */
+static bool cpuEvents(struct machine* m) {
+    unsigned events = atomic_load(&m->events);
+    if (events & EVENT_REMAP) {
+        clearEvents(m, EVENT_REMAP);
+        mapWatchpoints(m);
+    }
+    if (events & EVENT_NMI) {
+        clearEvents(m, EVENT_NMI);
+        cpuInterrupt(m, 0xFFFA);
+    } else if ((events & EVENT_IRQ) && !(m->registers.p & FLAG_IRQDISABLE)) {
+        cpuInterrupt(m, 0xFFFE); /* EVENT_IRQ stays set until the handler makes the device let go of the line */
+    }
+    /* Breakpoints come before hooks, so one on a hooked routine stops there, and again where the hook returns to */
+    checkBreakpoint(m, events);
+    if (events & EVENT_HOOKS) {
+        if (m->stop != STOP_NONE) m->hookpending = true;
+        else if (runHook(m)) checkBreakpoint(m, events);
+    }
+    if (events & EVENT_TRACE) {
+        char label[64];
+        fputs(">  --  ", stdout);
+        if (symbolFormat(m->symbols, m->registers.pc, label, sizeof(label))) printf("%s  ", label);
+        printRegisters(&m->registers);
+    }
+    if (events & EVENT_STOP) {
+        clearEvents(m, EVENT_STOP);
+        if (m->stop == STOP_NONE) m->stop = STOP_REQUEST;
+    }
+    if (events & EVENT_STEP) {
+        clearEvents(m, EVENT_STEP);
+        if (m->stop == STOP_NONE) m->stop = STOP_STEP;
+    }
+    if ((events & EVENT_MONITOR) && m->stop == STOP_NONE) m->stop = STOP_MONITOR;
+    return m->stop != STOP_NONE;
+}
+
+/* Whether the next instruction can access a PAGE_ACCURATE page, for the auto core to run it on the accurate core
+ * from its first cycle on rather than from the instruction after */
+static inline bool accurateNext(const struct machine* m) {
+    uint8_t pages[8];
+    unsigned count = instructionPages(m, m->registers.pc, pages);
+    for (unsigned i = 0; i < count; ++i) {
+        if (m->pageflags[pages[i]] & PAGE_ACCURATE) return true;
+    }
+    return false;
+}
+
+/* The end of every instruction: the devices catch up, the host clock is paced and the events are looked at. Returns
+ * true when the run has to stop */
+static inline bool cpuFinish(struct machine* m) {
+    ++m->instructions;
+    syncDevices(m);
+    pace(m);
+    /* The only check between instructions, everything else is behind it */
+    if (atomic_load_explicit(&m->events, memory_order_relaxed)) return cpuEvents(m);
+    return false;
+}
+
+/* Run one instruction, switching cores only happens here at instruction boundaries. Returns true when an event
+ * stops the run, with the reason in m->stop. With recompiled ROM code (a ROM-specialized build or a translation
+ * cache) the fast core runs a whole block of it instead where there is one, which stops at the first instruction an
+ * event is pending after */
+bool cpuStep(struct machine* m) {
+    if (m->sequencer.step) { /* an instruction begun with cpuCycle finishes on the accurate core */
+        cpuStepAccurate(m);
+        return cpuFinish(m);
+    }
+    if (m->hookpending) { /* the routine the run stopped at is replaced now that it continues */
+        m->hookpending = false;
+        if (runHook(m) && checkBreakpoint(m, atomic_load(&m->events))) return true;
+    }
+    m->buslogcount = 0;
+    switch (m->core) {
+        case CORE_FAST:
+            if (m->romimage && m->registers.pc >= 0xC000) {
+                unsigned count = romStep(m);
+                if (count) {
+                    m->instructions += count - 1;
+                    break;
+                }
+            }
+            cpuStepFast(m);
+            break;
+        case CORE_ACCURATE:
+            cpuStepAccurate(m);
+            break;
+        case CORE_AUTO:
+            if (!m->accuratehold && accurateNext(m)) m->accuratehold = ACCURATE_HOLD;
+            if (m->accuratehold) {
+                --m->accuratehold;
+                cpuStepAccurate(m);
+            } else {
+                cpuStepFast(m);
+            }
+            if (m->accuratehit) {
+                m->accuratehit = false;
+                m->accuratehold = ACCURATE_HOLD;
+            }
+            break;
+    }
+    return cpuFinish(m);
+}
+
+/* Run a single bus cycle on the accurate core whatever the core is, for looking at the machine between the cycles of
+ * an instruction. Returns true when that finished the instruction, with what cpuStep would have returned in stop */
+bool cpuCycle(struct machine* m, bool* stop) {
+    if (!m->sequencer.step) m->buslogcount = 0;
+    if (!sequencerCycle(m)) return false;
+    *stop = cpuFinish(m);
+    return true;
+}
+
+/* Run until limit instructions have been executed (0 for no limit) or an event stops it, returns the reason. A
+ * breakpoint at the first instruction does not stop it, so runs can continue from a breakpoint */
+enum stop cpuRun(struct machine* m, uint64_t limit) {
+    m->stop = STOP_NONE;
+    m->runinstructions = limit;
+    /* Begin reading instructions */
+    while (!limit || m->instructions < limit) {
+        bool stop = cpuStep(m);
+
+        #if VERBOSE >= 2
+        fputs(">  --  ", stdout);
+        printRegisters(&m->registers);
+        #endif
+        #if STEP
+        fputs("--- Press ENTER to continue ---", stdout);
+        fflush(stdout);
+        while (getchar() != '\n') {}
+        getTime(&m->targettime);
+        #endif
+        if (stop) break;
+    }
+    m->runinstructions = 0;
+    return m->stop;
+}
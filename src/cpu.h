@@ -0,0 +1,14 @@
+#ifndef POPPY_CPU_H
+#define POPPY_CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+void printRegisters(const struct registers* regs);
+bool cpuStep(struct machine* m);
+bool cpuCycle(struct machine* m, bool* stop);
+enum stop cpuRun(struct machine* m, uint64_t limit);
+
+#endif
@@ -0,0 +1,148 @@
+#include "debugger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+#include "history.h"
+#include "breakpoints.h"
+#include "symbols.h"
+
+/* Debugger */
+/* A command prompt on stdin that steps the machine forwards and backwards through its recorded history */
+
+static void showState(const struct machine* m) {
+    char label[64];
+    printf("#%" PRIu64 " (cycle %" PRIu64 ")  ", m->instructions, m->cycles);
+    if (symbolFormat(m->symbols, m->registers.pc, label, sizeof(label))) printf("%s  ", label);
+    printRegisters(&m->registers);
+}
+
+static inline bool atLimit(const struct machine* m, uint64_t limit) {
+    return limit && m->instructions >= limit;
+}
+
+/* Accepts labels, $1234, 0x1234 and plain hex, returns false for anything else */
+static bool parseAddress(const struct machine* m, const char* str, uint16_t* out) {
+    if (symbolFind(m->symbols, str, out)) return true;
+    if (*str == '$') ++str;
+    char* end;
+    unsigned long value = strtoul(str, &end, 16);
+    if (end == str || value > 0xFFFF) return false;
+    *out = value;
+    return true;
+}
+
+static void showHelp(void) {
+    puts("  s [N]         Step N instructions (default 1)");
+    puts("  n             Step over a JSR");
+    puts("  c             Continue until a breakpoint, the watched range is written or the program traps");
+    puts("  rs [N]        Reverse step N instructions (default 1)");
+    puts("  rn            Reverse step over a JSR");
+    puts("  rc            Reverse continue to the last write to the watched range");
+    puts("  w ADDR [END]  Watch writes to ADDR (up to END), w alone removes the watch");
+    puts("  b ADDR        Set or remove a breakpoint at ADDR");
+    puts("  r             Show the registers");
+    puts("  q             Quit");
+}
+
+/* Runs the debugger prompt until it is quit, taking a snapshot every interval cycles. Running forward stops after
+ * limit instructions (0 for no limit) */
+void debuggerRun(struct machine* m, uint64_t interval, uint64_t limit) {
+    static struct history h;
+    historyInit(&h, m, interval);
+    bool watching = false;
+    struct watchrange watch = {0};
+    char line[128];
+    showState(m);
+    for (;;) {
+        fputs("> ", stdout);
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) break;
+        char cmd[8] = "";
+        char arg1[32] = "", arg2[32] = "";
+        if (sscanf(line, "%7s %31s %31s", cmd, arg1, arg2) < 1) continue;
+
+        if (!strcmp(cmd, "q")) {
+            break;
+        } else if (!strcmp(cmd, "s")) {
+            uint64_t n = *arg1 ? strtoull(arg1, NULL, 0) : 1;
+            while (n-- && !atLimit(m, limit)) historyStep(&h, m);
+        } else if (!strcmp(cmd, "n")) {
+            /* A JSR runs until it returns to the instruction after it with the same SP */
+            bool call = peekByte(m, m->registers.pc) == 0x20; /* JSR */
+            uint16_t ret = m->registers.pc + 3;
+            uint8_t sp = m->registers.sp;
+            if (!atLimit(m, limit)) historyStep(&h, m);
+            while (call && (m->registers.pc != ret || m->registers.sp != sp) && !m->selfloop && !atLimit(m, limit)) {
+                historyStep(&h, m);
+            }
+        } else if (!strcmp(cmd, "c")) {
+            m->selfloop = false;
+            m->stop = STOP_NONE;
+            while (!m->selfloop && !atLimit(m, limit)) {
+                if (historyStep(&h, m)) {
+                    switch (m->stop) {
+                        case STOP_BREAKPOINT:
+                            printf("Breakpoint at $%04X\n", m->stopaddr);
+                            break;
+                        case STOP_WATCHPOINT:
+                            printf("Watched $%04X written at #%" PRIu64 "\n", m->stopaddr, m->instructions - 1);
+                            break;
+                        default:
+                            printf("Stopped after %" PRIu64 " instructions\n", m->instructions);
+                            break;
+                    }
+                    break;
+                }
+            }
+        } else if ((!strcmp(cmd, "rs") || !strcmp(cmd, "rn") || !strcmp(cmd, "rc")) && !historyReversible(m)) {
+            puts("Cannot go backwards with an SD card image (-C) or host files (-V), their writes are not undone");
+            continue;
+        } else if (!strcmp(cmd, "rs")) {
+            uint64_t n = *arg1 ? strtoull(arg1, NULL, 0) : 1;
+            uint64_t start = h.snapshots[0].instructions;
+            historySeek(&h, m, m->instructions - start > n ? m->instructions - n : start);
+        } else if (!strcmp(cmd, "rn")) {
+            if (!historyReverseNext(&h, m)) puts("At the start of the history");
+        } else if (!strcmp(cmd, "rc")) {
+            if (!watching || !historyReverseWatch(&h, m, watch.first, watch.last)) {
+                if (watching) puts("No earlier write to the watched range");
+                historySeek(&h, m, h.snapshots[0].instructions);
+            }
+        } else if (!strcmp(cmd, "w")) {
+            if (watching) setWatchpoint(m, watch.first, watch.last, false, true, false);
+            watching = false;
+            if (*arg1) {
+                if (!parseAddress(m, arg1, &watch.first) || !parseAddress(m, *arg2 ? arg2 : arg1, &watch.last)) {
+                    puts("Invalid address");
+                    continue;
+                }
+                setWatchpoint(m, watch.first, watch.last, false, true, true);
+                watching = true;
+                printf("Watching $%04X-$%04X\n", watch.first, watch.last);
+            }
+            continue;
+        } else if (!strcmp(cmd, "b")) {
+            uint16_t addr;
+            if (!parseAddress(m, arg1, &addr)) {
+                puts("Invalid address");
+                continue;
+            }
+            bool on = !testAddress(m->breakpoints, addr);
+            setBreakpoint(m, addr, on);
+            printf("Breakpoint at $%04X %s\n", addr, on ? "set" : "removed");
+            continue;
+        } else if (!strcmp(cmd, "r")) {
+        } else {
+            showHelp();
+            continue;
+        }
+        showState(m);
+    }
+    historyFree(&h);
+}
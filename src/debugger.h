@@ -0,0 +1,10 @@
+#ifndef POPPY_DEBUGGER_H
+#define POPPY_DEBUGGER_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+void debuggerRun(struct machine* m, uint64_t interval, uint64_t limit);
+
+#endif
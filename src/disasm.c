@@ -0,0 +1,262 @@
+#include "disasm.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "symbols.h"
+
+/* Disassembler */
+/* The whole WDC 65C02 instruction set, opcodes that are no-ops on the 65C02 show up as NOP with the operand
+ * bytes they skip. Memory is read with peekByte so disassembling never touches devices */
+
+enum mode {
+    MODE_IMP, /* implied */
+    MODE_ACC, /* A */
+    MODE_IMM, /* #$12 */
+    MODE_ZP, /* $12 */
+    MODE_ZPX, /* $12,X */
+    MODE_ZPY, /* $12,Y */
+    MODE_ZPI, /* ($12) */
+    MODE_INX, /* ($12,X) */
+    MODE_INY, /* ($12),Y */
+    MODE_ABS, /* $1234 */
+    MODE_ABX, /* $1234,X */
+    MODE_ABY, /* $1234,Y */
+    MODE_IND, /* ($1234) */
+    MODE_AIX, /* ($1234,X) */
+    MODE_REL, /* branch target */
+    MODE_ZPR /* $12,branch target */
+};
+
+static const struct {
+    const char* mnemonic;
+    enum mode mode;
+} opcodes[256] = {
+    /* 00 */ {"BRK", MODE_IMP}, {"ORA", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* 04 */ {"TSB", MODE_ZP}, {"ORA", MODE_ZP}, {"ASL", MODE_ZP}, {"RMB0", MODE_ZP},
+    /* 08 */ {"PHP", MODE_IMP}, {"ORA", MODE_IMM}, {"ASL", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 0C */ {"TSB", MODE_ABS}, {"ORA", MODE_ABS}, {"ASL", MODE_ABS}, {"BBR0", MODE_ZPR},
+    /* 10 */ {"BPL", MODE_REL}, {"ORA", MODE_INY}, {"ORA", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* 14 */ {"TRB", MODE_ZP}, {"ORA", MODE_ZPX}, {"ASL", MODE_ZPX}, {"RMB1", MODE_ZP},
+    /* 18 */ {"CLC", MODE_IMP}, {"ORA", MODE_ABY}, {"INC", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 1C */ {"TRB", MODE_ABS}, {"ORA", MODE_ABX}, {"ASL", MODE_ABX}, {"BBR1", MODE_ZPR},
+    /* 20 */ {"JSR", MODE_ABS}, {"AND", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* 24 */ {"BIT", MODE_ZP}, {"AND", MODE_ZP}, {"ROL", MODE_ZP}, {"RMB2", MODE_ZP},
+    /* 28 */ {"PLP", MODE_IMP}, {"AND", MODE_IMM}, {"ROL", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 2C */ {"BIT", MODE_ABS}, {"AND", MODE_ABS}, {"ROL", MODE_ABS}, {"BBR2", MODE_ZPR},
+    /* 30 */ {"BMI", MODE_REL}, {"AND", MODE_INY}, {"AND", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* 34 */ {"BIT", MODE_ZPX}, {"AND", MODE_ZPX}, {"ROL", MODE_ZPX}, {"RMB3", MODE_ZP},
+    /* 38 */ {"SEC", MODE_IMP}, {"AND", MODE_ABY}, {"DEC", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 3C */ {"BIT", MODE_ABX}, {"AND", MODE_ABX}, {"ROL", MODE_ABX}, {"BBR3", MODE_ZPR},
+    /* 40 */ {"RTI", MODE_IMP}, {"EOR", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* 44 */ {"NOP", MODE_ZP}, {"EOR", MODE_ZP}, {"LSR", MODE_ZP}, {"RMB4", MODE_ZP},
+    /* 48 */ {"PHA", MODE_IMP}, {"EOR", MODE_IMM}, {"LSR", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 4C */ {"JMP", MODE_ABS}, {"EOR", MODE_ABS}, {"LSR", MODE_ABS}, {"BBR4", MODE_ZPR},
+    /* 50 */ {"BVC", MODE_REL}, {"EOR", MODE_INY}, {"EOR", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* 54 */ {"NOP", MODE_ZPX}, {"EOR", MODE_ZPX}, {"LSR", MODE_ZPX}, {"RMB5", MODE_ZP},
+    /* 58 */ {"CLI", MODE_IMP}, {"EOR", MODE_ABY}, {"PHY", MODE_IMP}, {"NOP", MODE_IMP},
+    /* 5C */ {"NOP", MODE_ABS}, {"EOR", MODE_ABX}, {"LSR", MODE_ABX}, {"BBR5", MODE_ZPR},
+    /* 60 */ {"RTS", MODE_IMP}, {"ADC", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* 64 */ {"STZ", MODE_ZP}, {"ADC", MODE_ZP}, {"ROR", MODE_ZP}, {"RMB6", MODE_ZP},
+    /* 68 */ {"PLA", MODE_IMP}, {"ADC", MODE_IMM}, {"ROR", MODE_ACC}, {"NOP", MODE_IMP},
+    /* 6C */ {"JMP", MODE_IND}, {"ADC", MODE_ABS}, {"ROR", MODE_ABS}, {"BBR6", MODE_ZPR},
+    /* 70 */ {"BVS", MODE_REL}, {"ADC", MODE_INY}, {"ADC", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* 74 */ {"STZ", MODE_ZPX}, {"ADC", MODE_ZPX}, {"ROR", MODE_ZPX}, {"RMB7", MODE_ZP},
+    /* 78 */ {"SEI", MODE_IMP}, {"ADC", MODE_ABY}, {"PLY", MODE_IMP}, {"NOP", MODE_IMP},
+    /* 7C */ {"JMP", MODE_AIX}, {"ADC", MODE_ABX}, {"ROR", MODE_ABX}, {"BBR7", MODE_ZPR},
+    /* 80 */ {"BRA", MODE_REL}, {"STA", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* 84 */ {"STY", MODE_ZP}, {"STA", MODE_ZP}, {"STX", MODE_ZP}, {"SMB0", MODE_ZP},
+    /* 88 */ {"DEY", MODE_IMP}, {"BIT", MODE_IMM}, {"TXA", MODE_IMP}, {"NOP", MODE_IMP},
+    /* 8C */ {"STY", MODE_ABS}, {"STA", MODE_ABS}, {"STX", MODE_ABS}, {"BBS0", MODE_ZPR},
+    /* 90 */ {"BCC", MODE_REL}, {"STA", MODE_INY}, {"STA", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* 94 */ {"STY", MODE_ZPX}, {"STA", MODE_ZPX}, {"STX", MODE_ZPY}, {"SMB1", MODE_ZP},
+    /* 98 */ {"TYA", MODE_IMP}, {"STA", MODE_ABY}, {"TXS", MODE_IMP}, {"NOP", MODE_IMP},
+    /* 9C */ {"STZ", MODE_ABS}, {"STA", MODE_ABX}, {"STZ", MODE_ABX}, {"BBS1", MODE_ZPR},
+    /* A0 */ {"LDY", MODE_IMM}, {"LDA", MODE_INX}, {"LDX", MODE_IMM}, {"NOP", MODE_IMP},
+    /* A4 */ {"LDY", MODE_ZP}, {"LDA", MODE_ZP}, {"LDX", MODE_ZP}, {"SMB2", MODE_ZP},
+    /* A8 */ {"TAY", MODE_IMP}, {"LDA", MODE_IMM}, {"TAX", MODE_IMP}, {"NOP", MODE_IMP},
+    /* AC */ {"LDY", MODE_ABS}, {"LDA", MODE_ABS}, {"LDX", MODE_ABS}, {"BBS2", MODE_ZPR},
+    /* B0 */ {"BCS", MODE_REL}, {"LDA", MODE_INY}, {"LDA", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* B4 */ {"LDY", MODE_ZPX}, {"LDA", MODE_ZPX}, {"LDX", MODE_ZPY}, {"SMB3", MODE_ZP},
+    /* B8 */ {"CLV", MODE_IMP}, {"LDA", MODE_ABY}, {"TSX", MODE_IMP}, {"NOP", MODE_IMP},
+    /* BC */ {"LDY", MODE_ABX}, {"LDA", MODE_ABX}, {"LDX", MODE_ABY}, {"BBS3", MODE_ZPR},
+    /* C0 */ {"CPY", MODE_IMM}, {"CMP", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* C4 */ {"CPY", MODE_ZP}, {"CMP", MODE_ZP}, {"DEC", MODE_ZP}, {"SMB4", MODE_ZP},
+    /* C8 */ {"INY", MODE_IMP}, {"CMP", MODE_IMM}, {"DEX", MODE_IMP}, {"WAI", MODE_IMP},
+    /* CC */ {"CPY", MODE_ABS}, {"CMP", MODE_ABS}, {"DEC", MODE_ABS}, {"BBS4", MODE_ZPR},
+    /* D0 */ {"BNE", MODE_REL}, {"CMP", MODE_INY}, {"CMP", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* D4 */ {"NOP", MODE_ZPX}, {"CMP", MODE_ZPX}, {"DEC", MODE_ZPX}, {"SMB5", MODE_ZP},
+    /* D8 */ {"CLD", MODE_IMP}, {"CMP", MODE_ABY}, {"PHX", MODE_IMP}, {"STP", MODE_IMP},
+    /* DC */ {"NOP", MODE_ABS}, {"CMP", MODE_ABX}, {"DEC", MODE_ABX}, {"BBS5", MODE_ZPR},
+    /* E0 */ {"CPX", MODE_IMM}, {"SBC", MODE_INX}, {"NOP", MODE_IMM}, {"NOP", MODE_IMP},
+    /* E4 */ {"CPX", MODE_ZP}, {"SBC", MODE_ZP}, {"INC", MODE_ZP}, {"SMB6", MODE_ZP},
+    /* E8 */ {"INX", MODE_IMP}, {"SBC", MODE_IMM}, {"NOP", MODE_IMP}, {"NOP", MODE_IMP},
+    /* EC */ {"CPX", MODE_ABS}, {"SBC", MODE_ABS}, {"INC", MODE_ABS}, {"BBS6", MODE_ZPR},
+    /* F0 */ {"BEQ", MODE_REL}, {"SBC", MODE_INY}, {"SBC", MODE_ZPI}, {"NOP", MODE_IMP},
+    /* F4 */ {"NOP", MODE_ZPX}, {"SBC", MODE_ZPX}, {"INC", MODE_ZPX}, {"SMB7", MODE_ZP},
+    /* F8 */ {"SED", MODE_IMP}, {"SBC", MODE_ABY}, {"PLX", MODE_IMP}, {"NOP", MODE_IMP},
+    /* FC */ {"NOP", MODE_ABS}, {"SBC", MODE_ABX}, {"INC", MODE_ABX}, {"BBS7", MODE_ZPR},
+};
+
+static const uint8_t modelengths[] = {
+    [MODE_IMP] = 1, [MODE_ACC] = 1, [MODE_IMM] = 2, [MODE_ZP] = 2, [MODE_ZPX] = 2, [MODE_ZPY] = 2,
+    [MODE_ZPI] = 2, [MODE_INX] = 2, [MODE_INY] = 2, [MODE_ABS] = 3, [MODE_ABX] = 3, [MODE_ABY] = 3,
+    [MODE_IND] = 3, [MODE_AIX] = 3, [MODE_REL] = 2, [MODE_ZPR] = 3
+};
+
+unsigned instructionLength(uint8_t opcode) {
+    return modelengths[opcodes[opcode].mode];
+}
+
+/* Writes the instruction at addr as "$0400  A9 12     LDA #$12" to out, with the label of the address the operand
+ * refers to as a comment if there is one. Returns its length in bytes */
+unsigned disassemble(const struct machine* m, uint16_t addr, char* out, size_t size) {
+    uint8_t bytes[3] = {0};
+    uint8_t opcode = peekByte(m, addr);
+    unsigned len = instructionLength(opcode);
+    for (unsigned i = 0; i < len; ++i) bytes[i] = peekByte(m, addr + i);
+    uint8_t zp = bytes[1];
+    uint16_t abs = bytes[1] | (uint16_t)bytes[2] << 8;
+
+    char operand[24];
+    int target = -1; /* address the operand refers to, for its label */
+    switch (opcodes[opcode].mode) {
+        case MODE_IMP:
+            operand[0] = 0;
+            break;
+        case MODE_ACC:
+            snprintf(operand, sizeof(operand), "A");
+            break;
+        case MODE_IMM:
+            snprintf(operand, sizeof(operand), "#$%02X", zp);
+            break;
+        case MODE_ZP:
+            snprintf(operand, sizeof(operand), "$%02X", zp);
+            target = zp;
+            break;
+        case MODE_ZPX:
+            snprintf(operand, sizeof(operand), "$%02X,X", zp);
+            target = zp;
+            break;
+        case MODE_ZPY:
+            snprintf(operand, sizeof(operand), "$%02X,Y", zp);
+            target = zp;
+            break;
+        case MODE_ZPI:
+            snprintf(operand, sizeof(operand), "($%02X)", zp);
+            target = zp;
+            break;
+        case MODE_INX:
+            snprintf(operand, sizeof(operand), "($%02X,X)", zp);
+            target = zp;
+            break;
+        case MODE_INY:
+            snprintf(operand, sizeof(operand), "($%02X),Y", zp);
+            target = zp;
+            break;
+        case MODE_ABS:
+            snprintf(operand, sizeof(operand), "$%04X", abs);
+            target = abs;
+            break;
+        case MODE_ABX:
+            snprintf(operand, sizeof(operand), "$%04X,X", abs);
+            target = abs;
+            break;
+        case MODE_ABY:
+            snprintf(operand, sizeof(operand), "$%04X,Y", abs);
+            target = abs;
+            break;
+        case MODE_IND:
+            snprintf(operand, sizeof(operand), "($%04X)", abs);
+            target = abs;
+            break;
+        case MODE_AIX:
+            snprintf(operand, sizeof(operand), "($%04X,X)", abs);
+            target = abs;
+            break;
+        case MODE_REL:
+            target = (uint16_t)(addr + 2 + (int8_t)zp);
+            snprintf(operand, sizeof(operand), "$%04X", target);
+            break;
+        case MODE_ZPR:
+            target = (uint16_t)(addr + 3 + (int8_t)bytes[2]);
+            snprintf(operand, sizeof(operand), "$%02X,$%04X", zp, target);
+            break;
+    }
+
+    char hex[12] = "";
+    for (unsigned i = 0; i < len; ++i) snprintf(hex + i * 3, sizeof(hex) - i * 3, "%02X ", bytes[i]);
+    int used;
+    if (operand[0]) used = snprintf(out, size, "$%04X  %-9s %-4s %s", addr, hex, opcodes[opcode].mnemonic, operand);
+    else used = snprintf(out, size, "$%04X  %-9s %s", addr, hex, opcodes[opcode].mnemonic);
+    char label[64];
+    if (target >= 0 && (size_t)used < size && symbolFormat(m->symbols, target, label, sizeof(label))) {
+        snprintf(out + used, size - used, "%*s; %s", used < 30 ? 30 - used : 1, "", label);
+    }
+    return len;
+}
+
+/* Stores the pages the instruction at addr can access into pages (at most 8) and returns how many: its own bytes,
+ * the operand's page and the one indexing can carry it into, pointers and what they point to, the stack and the
+ * BRK vector. A page can be in there twice. The auto core picks the core from this before running the instruction */
+unsigned instructionPages(const struct machine* m, uint16_t addr, uint8_t* pages) {
+    uint8_t opcode = peekByte(m, addr);
+    unsigned len = instructionLength(opcode);
+    uint8_t zp = peekByte(m, addr + 1);
+    uint16_t abs = zp | (uint16_t)peekByte(m, addr + 2) << 8;
+    unsigned count = 0;
+    pages[count++] = addr >> 8;
+    pages[count++] = (uint16_t)(addr + len - 1) >> 8;
+    switch (opcodes[opcode].mode) {
+        case MODE_IMP:
+        case MODE_ACC:
+        case MODE_IMM:
+            break;
+        case MODE_ZP:
+        case MODE_ZPX:
+        case MODE_ZPY:
+        case MODE_ZPR:
+            pages[count++] = 0x00;
+            break;
+        case MODE_ZPI:
+        case MODE_INY: {
+            uint16_t ptr = peekByte(m, zp) | (uint16_t)peekByte(m, (uint8_t)(zp + 1)) << 8;
+            pages[count++] = 0x00;
+            pages[count++] = ptr >> 8;
+            pages[count++] = (uint16_t)(ptr + m->registers.y) >> 8;
+        } break;
+        case MODE_INX: {
+            uint8_t at = zp + m->registers.x;
+            uint16_t ptr = peekByte(m, at) | (uint16_t)peekByte(m, (uint8_t)(at + 1)) << 8;
+            pages[count++] = 0x00;
+            pages[count++] = ptr >> 8;
+        } break;
+        case MODE_ABS:
+        case MODE_IND:
+            pages[count++] = abs >> 8;
+            pages[count++] = (uint16_t)(abs + 1) >> 8;
+            break;
+        case MODE_ABX:
+        case MODE_AIX:
+            pages[count++] = abs >> 8;
+            pages[count++] = (uint16_t)(abs + m->registers.x + 1) >> 8;
+            break;
+        case MODE_ABY:
+            pages[count++] = abs >> 8;
+            pages[count++] = (uint16_t)(abs + m->registers.y) >> 8;
+            break;
+        case MODE_REL:
+            pages[count++] = (uint16_t)(addr + 2 + (int8_t)zp) >> 8;
+            break;
+    }
+    switch (opcode) {
+        case 0x00: /* BRK */
+            pages[count++] = 0xFF;
+            /* fall through */
+        case 0x08: case 0x20: case 0x28: case 0x40: case 0x48: case 0x5A: case 0x60: case 0x68: case 0x7A: case 0xDA:
+        case 0xFA:
+            pages[count++] = 0x01;
+            break;
+    }
+    return count;
+}
@@ -0,0 +1,13 @@
+#ifndef POPPY_DISASM_H
+#define POPPY_DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+unsigned instructionLength(uint8_t opcode);
+unsigned disassemble(const struct machine* m, uint16_t addr, char* out, size_t size);
+unsigned instructionPages(const struct machine* m, uint16_t addr, uint8_t* pages);
+
+#endif
@@ -0,0 +1,189 @@
+#include "fingerprint.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+
+/* Fingerprinting */
+/* A cheap stand-in for comparing full traces between emulator versions. A rolling hash is kept over the registers
+ * after every instruction and over every bus write, and every interval cycles a checkpoint folds in a hash of
+ * system memory and writes it out. Every checkpoint depends on everything before it, so two runs stay different
+ * after their first differing checkpoint and it can be found with a binary search over the files */
+
+static const char fingerprintmagic[8] = "POPPYFP1";
+
+struct checkpoint {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t hash;
+};
+
+/* System memory hash, every page is hashed on its own and only pages written since the last checkpoint are
+ * hashed again */
+struct memoryhash {
+    uint64_t pages[128];
+    uint64_t hash; /* XOR of every page hash mixed with its page number */
+};
+
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+
+/* Hashes 32 bytes at a time in 8 lanes, which the compiler turns into SIMD instructions */
+uint64_t hashPage(const uint8_t* page) {
+    v8u32 acc = {
+        0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344, 0xA4093822, 0x299F31D0, 0x082EFA98, 0xEC4E6C89
+    };
+    for (unsigned i = 0; i < 256; i += sizeof(v8u32)) {
+        v8u32 data;
+        memcpy(&data, page + i, sizeof(data));
+        acc = (acc ^ data) * 0x9E3779B1U;
+        acc = (acc << 13) | (acc >> 19);
+    }
+    uint64_t hash = 0;
+    for (unsigned i = 0; i < 8; ++i) hash = fingerprintMix(hash, acc[i]);
+    return hash;
+}
+static void rehashPage(struct memoryhash* mem, const struct machine* m, unsigned page) {
+    uint64_t hash = hashPage(&m->sysram[page << 8]);
+    mem->hash ^= fingerprintMix(mem->pages[page], page) ^ fingerprintMix(hash, page);
+    mem->pages[page] = hash;
+}
+
+static void rehashDirtyPages(struct memoryhash* mem, struct machine* m) {
+    for (unsigned word = 0; word < 2; ++word) {
+        uint64_t dirty = m->dirtypages[word];
+        while (dirty) {
+            unsigned bit = __builtin_ctzll(dirty);
+            dirty &= dirty - 1;
+            rehashPage(mem, m, word * 64 + bit);
+        }
+        m->dirtypages[word] = 0;
+    }
+}
+
+/* Runs until limit instructions have been executed (0 for no limit) and writes a checkpoint to out every interval
+ * cycles */
+void fingerprintRun(struct machine* m, FILE* out, uint64_t interval, uint64_t limit) {
+    static struct memoryhash mem;
+    mem.hash = 0;
+    for (unsigned page = 0; page < 128; ++page) {
+        mem.pages[page] = hashPage(&m->sysram[page << 8]);
+        mem.hash ^= fingerprintMix(mem.pages[page], page);
+    }
+    m->dirtypages[0] = m->dirtypages[1] = 0;
+    m->fingerprint = 0;
+    m->tracebus = true;
+
+    fwrite(fingerprintmagic, 1, sizeof(fingerprintmagic), out);
+    fwrite(&interval, sizeof(interval), 1, out);
+    uint64_t next = m->cycles + interval;
+    while (!limit || m->instructions < limit) {
+        cpuStep(m);
+        const struct registers* r = &m->registers;
+        m->fingerprint = fingerprintMix(
+            m->fingerprint,
+            (uint64_t)r->pc | (uint64_t)r->a << 16 | (uint64_t)r->x << 24 | (uint64_t)r->y << 32 |
+                (uint64_t)r->p << 40 | (uint64_t)r->sp << 48
+        );
+        if (m->cycles >= next) {
+            rehashDirtyPages(&mem, m);
+            m->fingerprint = fingerprintMix(m->fingerprint, mem.hash);
+            struct checkpoint checkpoint = {
+                .cycles = m->cycles, .instructions = m->instructions, .hash = m->fingerprint
+            };
+            fwrite(&checkpoint, sizeof(checkpoint), 1, out);
+            next += interval;
+        }
+    }
+    fflush(out);
+}
+
+/* Comparing */
+
+struct fingerprintfile {
+    const char* name;
+    FILE* fp;
+    uint64_t interval;
+    long count;
+};
+
+static bool openFingerprint(struct fingerprintfile* file, const char* name) {
+    file->name = name;
+    file->fp = fopen(name, "rb");
+    if (!file->fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", name, strerror(errno));
+        return false;
+    }
+    char magic[sizeof(fingerprintmagic)];
+    if (fread(magic, 1, sizeof(magic), file->fp) != sizeof(magic) || memcmp(magic, fingerprintmagic, sizeof(magic)) ||
+        fread(&file->interval, sizeof(file->interval), 1, file->fp) != 1) {
+        fprintf(stderr, "'%s' is not a fingerprint file\n", name);
+        fclose(file->fp);
+        return false;
+    }
+    fseek(file->fp, 0, SEEK_END);
+    long size = ftell(file->fp) - (long)sizeof(fingerprintmagic) - (long)sizeof(uint64_t);
+    file->count = size / sizeof(struct checkpoint);
+    return true;
+}
+static void readCheckpoint(struct fingerprintfile* file, long i, struct checkpoint* out) {
+    fseek(file->fp, sizeof(fingerprintmagic) + sizeof(uint64_t) + i * sizeof(struct checkpoint), SEEK_SET);
+    if (fread(out, sizeof(*out), 1, file->fp) != 1) memset(out, 0, sizeof(*out));
+}
+static bool sameCheckpoint(struct fingerprintfile* a, struct fingerprintfile* b, long i) {
+    struct checkpoint x, y;
+    readCheckpoint(a, i, &x);
+    readCheckpoint(b, i, &y);
+    return x.cycles == y.cycles && x.instructions == y.instructions && x.hash == y.hash;
+}
+
+/* Finds the first checkpoint where two fingerprint files differ, returns the exit status (0 if they match) */
+int fingerprintCompare(const char* namea, const char* nameb) {
+    struct fingerprintfile a, b;
+    if (!openFingerprint(&a, namea)) return 2;
+    if (!openFingerprint(&b, nameb)) {
+        fclose(a.fp);
+        return 2;
+    }
+    int status = 0;
+    if (a.interval != b.interval) {
+        printf("Checkpoint intervals differ (%" PRIu64 " and %" PRIu64 " cycles)\n", a.interval, b.interval);
+        status = 2;
+    } else {
+        /* Binary search for the first differing checkpoint, everything before it matches */
+        long count = a.count < b.count ? a.count : b.count;
+        long lo = 0, hi = count;
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            if (sameCheckpoint(&a, &b, mid)) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < count) {
+            struct checkpoint x, y, last = {0};
+            readCheckpoint(&a, lo, &x);
+            readCheckpoint(&b, lo, &y);
+            if (lo > 0) readCheckpoint(&a, lo - 1, &last);
+            printf(
+                "First difference at checkpoint %ld, after cycle %" PRIu64 " (instruction %" PRIu64 ")\n",
+                lo, last.cycles, last.instructions
+            );
+            printf("  %s: cycle %" PRIu64 "  instruction %" PRIu64 "  hash %016" PRIx64 "\n",
+                a.name, x.cycles, x.instructions, x.hash);
+            printf("  %s: cycle %" PRIu64 "  instruction %" PRIu64 "  hash %016" PRIx64 "\n",
+                b.name, y.cycles, y.instructions, y.hash);
+            status = 1;
+        } else if (a.count != b.count) {
+            printf("The first %ld checkpoints match, %s has %ld and %s has %ld\n", count, a.name, a.count, b.name,
+                b.count);
+        } else {
+            printf("All %ld checkpoints match\n", count);
+        }
+    }
+    fclose(a.fp);
+    fclose(b.fp);
+    return status;
+}
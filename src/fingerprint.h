@@ -0,0 +1,13 @@
+#ifndef POPPY_FINGERPRINT_H
+#define POPPY_FINGERPRINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+uint64_t hashPage(const uint8_t* page);
+void fingerprintRun(struct machine* m, FILE* out, uint64_t interval, uint64_t limit);
+int fingerprintCompare(const char* a, const char* b);
+
+#endif
@@ -0,0 +1,469 @@
+#include "gdbstub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "cpu.h"
+#include "breakpoints.h"
+
+/* GDB stub */
+/* Serves the GDB remote serial protocol on a localhost TCP port or a Unix socket. The socket is handled by its own
+ * thread, the CPU thread only runs while GDB has it continuing or stepping and otherwise sleeps on a condition
+ * variable, so the CPU never looks at the socket. Interrupts from GDB reach the CPU as EVENT_STOP. While the CPU is
+ * stopped the stub thread owns the machine and reads and writes it directly. Registers are sent in the order of struct
+ * registers: PC (16 bits), SP, A, X, Y and P */
+
+enum gdbstate {
+    GDB_STOPPED, /* The stub thread owns the machine */
+    GDB_CONTINUE,
+    GDB_STEP,
+    GDB_QUIT
+};
+
+struct gdbstub {
+    struct machine* m;
+    uint64_t limit;
+    int listenfd;
+    int fd; /* connection to GDB */
+    int wakepipe[2]; /* written by the CPU thread every time it stops */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    enum gdbstate state;
+    char in[4096]; /* received bytes */
+    size_t inlen, inpos;
+};
+
+/* Connection */
+
+static int readChar(struct gdbstub* stub) {
+    if (stub->inpos == stub->inlen) {
+        ssize_t n;
+        do {
+            n = read(stub->fd, stub->in, sizeof(stub->in));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return -1;
+        stub->inlen = n;
+        stub->inpos = 0;
+    }
+    return (unsigned char)stub->in[stub->inpos++];
+}
+
+static bool writeAll(int fd, const char* data, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static void sendPacket(struct gdbstub* stub, const char* data) {
+    static char buf[4096 + 4];
+    size_t len = strlen(data);
+    uint8_t sum = 0;
+    buf[0] = '$';
+    for (size_t i = 0; i < len; ++i) sum += (uint8_t)data[i];
+    memcpy(buf + 1, data, len);
+    buf[len + 1] = '#';
+    buf[len + 2] = hexdigits[sum >> 4];
+    buf[len + 3] = hexdigits[sum & 15];
+    writeAll(stub->fd, buf, len + 4);
+}
+
+/* Reads the next packet into out and acknowledges it, returns false when the connection is closed */
+static bool readPacket(struct gdbstub* stub, char* out, size_t size) {
+    int c;
+    do {
+        c = readChar(stub);
+        if (c < 0) return false;
+    } while (c != '$'); /* acknowledgements and interrupts of a CPU that is already stopped */
+    size_t len = 0;
+    while ((c = readChar(stub)) != '#') {
+        if (c < 0) return false;
+        if (len + 1 < size) out[len++] = c;
+    }
+    out[len] = 0;
+    if (readChar(stub) < 0 || readChar(stub) < 0) return false; /* checksum, the socket is reliable */
+    return writeAll(stub->fd, "+", 1);
+}
+
+/* Hex */
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+static unsigned long parseHexNumber(const char** str) {
+    unsigned long value = 0;
+    int digit;
+    while ((digit = hexValue(**str)) >= 0) {
+        value = value << 4 | digit;
+        ++*str;
+    }
+    return value;
+}
+static char* putHexByte(char* out, uint8_t value) {
+    *out++ = hexdigits[value >> 4];
+    *out++ = hexdigits[value & 15];
+    return out;
+}
+static bool getHexByte(const char** str, uint8_t* out) {
+    int hi = hexValue((*str)[0]);
+    if (hi < 0) return false;
+    int lo = hexValue((*str)[1]);
+    if (lo < 0) return false;
+    *out = hi << 4 | lo;
+    *str += 2;
+    return true;
+}
+
+/* Registers, in the order of struct registers */
+
+#define GDB_REGISTERS 6
+
+static char* putRegister(char* out, const struct registers* r, unsigned n) {
+    switch (n) {
+        case 0:
+            out = putHexByte(out, r->pc);
+            return putHexByte(out, r->pc >> 8);
+        case 1:
+            return putHexByte(out, r->sp);
+        case 2:
+            return putHexByte(out, r->a);
+        case 3:
+            return putHexByte(out, r->x);
+        case 4:
+            return putHexByte(out, r->y);
+        default:
+            return putHexByte(out, r->p);
+    }
+}
+static bool getRegister(const char** str, struct registers* r, unsigned n) {
+    uint8_t lo, hi;
+    if (!getHexByte(str, &lo)) return false;
+    switch (n) {
+        case 0:
+            if (!getHexByte(str, &hi)) return false;
+            r->pc = lo | (uint16_t)hi << 8;
+            break;
+        case 1:
+            r->sp = lo;
+            break;
+        case 2:
+            r->a = lo;
+            break;
+        case 3:
+            r->x = lo;
+            break;
+        case 4:
+            r->y = lo;
+            break;
+        default:
+            r->p = lo;
+            break;
+    }
+    return true;
+}
+
+/* Running */
+
+static void setState(struct gdbstub* stub, enum gdbstate state) {
+    pthread_mutex_lock(&stub->lock);
+    stub->state = state;
+    pthread_cond_broadcast(&stub->cond);
+    pthread_mutex_unlock(&stub->lock);
+}
+static bool isStopped(struct gdbstub* stub) {
+    pthread_mutex_lock(&stub->lock);
+    bool stopped = stub->state == GDB_STOPPED;
+    pthread_mutex_unlock(&stub->lock);
+    return stopped;
+}
+/* Stops the CPU if it is running and waits until it has */
+static void stopCPU(struct gdbstub* stub) {
+    if (!isStopped(stub)) raiseEvents(stub->m, EVENT_STOP);
+    while (!isStopped(stub)) {
+        char c;
+        if (read(stub->wakepipe[0], &c, 1) < 0 && errno != EINTR) break;
+    }
+}
+
+static void sendStopReply(struct gdbstub* stub) {
+    struct machine* m = stub->m;
+    char buf[32];
+    if (m->stop == STOP_WATCHPOINT) {
+        bool r = testAddress(m->readwatch, m->stopaddr), w = testAddress(m->writewatch, m->stopaddr);
+        snprintf(buf, sizeof(buf), "T05%s:%04x;", r && w ? "awatch" : w ? "watch" : "rwatch", m->stopaddr);
+    } else {
+        strcpy(buf, "S05"); /* SIGTRAP */
+    }
+    sendPacket(stub, buf);
+}
+
+/* Lets the CPU run until it stops or GDB interrupts it, returns false if the connection was closed */
+static bool runCPU(struct gdbstub* stub, enum gdbstate state) {
+    clearEvents(stub->m, EVENT_STOP); /* left over if the CPU stopped by itself just before being stopped */
+    setState(stub, state);
+    struct pollfd fds[2] = {{.fd = stub->fd, .events = POLLIN}, {.fd = stub->wakepipe[0], .events = POLLIN}};
+    for (;;) {
+        bool buffered = stub->inpos < stub->inlen; /* left over from the last read */
+        if (poll(fds, 2, buffered ? 0 : -1) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (buffered) fds[0].revents |= POLLIN;
+        if (fds[1].revents & POLLIN) {
+            char c;
+            if (read(stub->wakepipe[0], &c, 1) == 1 && isStopped(stub)) {
+                sendStopReply(stub);
+                return true;
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int c = readChar(stub);
+            if (c < 0) return false;
+            if (c == 0x03) raiseEvents(stub->m, EVENT_STOP); /* Ctrl-C */
+        }
+    }
+}
+
+/* Breakpoints and watchpoints, Z and z packets */
+static bool setPoint(struct machine* m, const char* args, bool on) {
+    unsigned type = *args - '0';
+    if (type > 4 || args[1] != ',') return false;
+    args += 2;
+    uint16_t addr = parseHexNumber(&args);
+    unsigned len = 1;
+    if (*args == ',') {
+        ++args;
+        len = parseHexNumber(&args);
+    }
+    if (!len) len = 1;
+    uint16_t last = addr + len - 1 < addr ? 0xFFFF : addr + len - 1;
+    switch (type) {
+        case 0: /* software breakpoint */
+        case 1: /* hardware breakpoint */
+            setBreakpoint(m, addr, on);
+            break;
+        case 2: /* write watchpoint */
+            setWatchpoint(m, addr, last, false, true, on);
+            break;
+        case 3: /* read watchpoint */
+            setWatchpoint(m, addr, last, true, false, on);
+            break;
+        case 4: /* access watchpoint */
+            setWatchpoint(m, addr, last, true, true, on);
+            break;
+    }
+    return true;
+}
+
+/* Serves one connection, returns true when GDB asked to kill the emulator */
+static bool serveConnection(struct gdbstub* stub) {
+    static char packet[4096];
+    static char reply[4096];
+    struct machine* m = stub->m;
+    while (readPacket(stub, packet, sizeof(packet))) {
+        const char* args = packet + 1;
+        char* out = reply;
+        *out = 0;
+        switch (packet[0]) {
+            case '?':
+                sendStopReply(stub);
+                continue;
+            case 'g':
+                for (unsigned n = 0; n < GDB_REGISTERS; ++n) out = putRegister(out, &m->registers, n);
+                *out = 0;
+                break;
+            case 'G': {
+                struct registers r = m->registers;
+                bool ok = true;
+                for (unsigned n = 0; n < GDB_REGISTERS && ok; ++n) ok = getRegister(&args, &r, n);
+                if (ok) m->registers = r;
+                strcpy(reply, ok ? "OK" : "E01");
+            } break;
+            case 'p': {
+                unsigned n = parseHexNumber(&args);
+                if (n < GDB_REGISTERS) *putRegister(out, &m->registers, n) = 0;
+                else strcpy(reply, "E01");
+            } break;
+            case 'P': {
+                unsigned n = parseHexNumber(&args);
+                bool ok = n < GDB_REGISTERS && *args++ == '=' && getRegister(&args, &m->registers, n);
+                strcpy(reply, ok ? "OK" : "E01");
+            } break;
+            case 'm': {
+                unsigned addr = parseHexNumber(&args);
+                unsigned len = *args == ',' ? (++args, parseHexNumber(&args)) : 0;
+                if (len > (sizeof(reply) - 1) / 2) len = (sizeof(reply) - 1) / 2;
+                for (unsigned i = 0; i < len; ++i) out = putHexByte(out, peekByte(m, addr + i));
+                *out = 0;
+            } break;
+            case 'M': {
+                unsigned addr = parseHexNumber(&args);
+                unsigned len = *args == ',' ? (++args, parseHexNumber(&args)) : 0;
+                bool ok = *args++ == ':';
+                for (unsigned i = 0; i < len && ok; ++i) {
+                    uint8_t value;
+                    ok = getHexByte(&args, &value) && pokeByte(m, addr + i, value);
+                }
+                strcpy(reply, ok ? "OK" : "E01");
+            } break;
+            case 'c':
+            case 's':
+                if (*args) m->registers.pc = parseHexNumber(&args);
+                if (!runCPU(stub, packet[0] == 's' ? GDB_STEP : GDB_CONTINUE)) {
+                    stopCPU(stub);
+                    return false;
+                }
+                continue;
+            case 'Z':
+            case 'z':
+                strcpy(reply, setPoint(m, args, packet[0] == 'Z') ? "OK" : "");
+                break;
+            case 'H':
+                strcpy(reply, "OK");
+                break;
+            case 'q':
+                if (!strncmp(args, "Supported", 9)) strcpy(reply, "PacketSize=1000");
+                else if (!strcmp(args, "Attached")) strcpy(reply, "1");
+                else if (!strcmp(args, "C")) strcpy(reply, "QC1");
+                else if (!strcmp(args, "fThreadInfo")) strcpy(reply, "m1");
+                else if (!strcmp(args, "sThreadInfo")) strcpy(reply, "l");
+                break;
+            case 'D': /* detach, the machine keeps running */
+                sendPacket(stub, "OK");
+                setState(stub, GDB_CONTINUE);
+                return false;
+            case 'k':
+                return true;
+            default:
+                break;
+        }
+        sendPacket(stub, reply);
+    }
+    return false; /* connection closed, the machine stays stopped for the next one */
+}
+
+static void* gdbThread(void* arg) {
+    struct gdbstub* stub = arg;
+    for (;;) {
+        int fd = accept(stub->listenfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); /* fails harmlessly on Unix sockets */
+        stub->fd = fd;
+        stub->inlen = stub->inpos = 0;
+        stopCPU(stub);
+        bool quit = serveConnection(stub);
+        close(fd);
+        if (quit) break;
+    }
+    setState(stub, GDB_QUIT);
+    raiseEvents(stub->m, EVENT_STOP);
+    return NULL;
+}
+
+/* Socket */
+
+static int listenOn(const char* address) {
+    int fd;
+    if (strchr(address, '/')) {
+        struct sockaddr_un sa = {.sun_family = AF_UNIX};
+        if (strlen(address) >= sizeof(sa.sun_path)) {
+            fprintf(stderr, "Socket path '%s' is too long\n", address);
+            return -1;
+        }
+        strcpy(sa.sun_path, address);
+        unlink(address);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && bind(fd, (struct sockaddr*)&sa, sizeof(sa))) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_in sa = {
+            .sin_family = AF_INET, .sin_port = htons(atoi(address)), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+        };
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd >= 0 && bind(fd, (struct sockaddr*)&sa, sizeof(sa))) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0 || listen(fd, 1)) {
+        fprintf(stderr, "Failed to listen on '%s': %s\n", address, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Runs the machine under control of GDB connecting to address (a port on localhost, or a path for a Unix socket)
+ * until GDB kills it. The machine starts out stopped. Returns the exit status */
+int gdbServe(struct machine* m, const char* address, uint64_t limit) {
+    static struct gdbstub stub;
+    stub.m = m;
+    stub.limit = limit;
+    stub.state = GDB_STOPPED;
+    stub.listenfd = listenOn(address);
+    if (stub.listenfd < 0) return 1;
+    if (pipe(stub.wakepipe)) {
+        perror("pipe");
+        return 1;
+    }
+    pthread_mutex_init(&stub.lock, NULL);
+    pthread_cond_init(&stub.cond, NULL);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, gdbThread, &stub)) {
+        fputs("Failed to start the GDB thread\n", stderr);
+        return 1;
+    }
+    printf("Waiting for GDB on %s\n", address);
+    fflush(stdout);
+
+    /* The CPU side, nothing here touches the socket */
+    pthread_mutex_lock(&stub.lock);
+    for (;;) {
+        while (stub.state == GDB_STOPPED) pthread_cond_wait(&stub.cond, &stub.lock);
+        if (stub.state == GDB_QUIT) break;
+        if (stub.state == GDB_STEP) raiseEvents(m, EVENT_STEP);
+        pthread_mutex_unlock(&stub.lock);
+
+        cpuRun(m, limit);
+
+        pthread_mutex_lock(&stub.lock);
+        clearEvents(m, EVENT_STEP);
+        if (stub.state != GDB_QUIT) stub.state = GDB_STOPPED;
+        if (write(stub.wakepipe[1], "", 1) < 0) perror("write");
+    }
+    pthread_mutex_unlock(&stub.lock);
+    pthread_join(tid, NULL);
+    close(stub.listenfd);
+    if (strchr(address, '/')) unlink(address);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef POPPY_GDBSTUB_H
+#define POPPY_GDBSTUB_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+int gdbServe(struct machine* m, const char* address, uint64_t limit);
+
+#endif
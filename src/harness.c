@@ -0,0 +1,40 @@
+#include "harness.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+#include "time.h"
+
+/* Trap harness */
+/* Test programs like Klaus Dormann's 6502/65C02 functional and decimal tests stop by jumping to themselves
+ * (JMP *), at the success address when everything passed and anywhere else when a test failed. The JMP
+ * instruction flags that itself so checking for it is a single load per instruction */
+
+/* Runs until the program traps or limit instructions have been executed (0 for no limit), returns the exit status */
+int runTrapHarness(struct machine* m, uint16_t success, uint64_t limit) {
+    struct timespec start, end;
+    getTime(&start);
+    m->selfloop = false;
+    while (!m->selfloop && (!limit || m->instructions < limit)) {
+        cpuStep(m);
+    }
+    getTime(&end);
+    subTime(&end, &start);
+
+    bool pass = m->selfloop && m->registers.pc == success;
+    if (m->selfloop) {
+        printf("%s: trapped at $%04X", pass ? "PASS" : "FAIL", m->registers.pc);
+        if (!pass) printf(" (success is $%04X)", success);
+        putchar('\n');
+    } else {
+        printf("FAIL: no trap after %" PRIu64 " instructions\n", m->instructions);
+    }
+    printRegisters(&m->registers);
+    double seconds = end.tv_sec + end.tv_nsec / 1e9;
+    printf(
+        "%" PRIu64 " instructions, %" PRIu64 " cycles in %.3f s (%.2f MHz)\n",
+        m->instructions, m->cycles, seconds, seconds > 0 ? m->cycles / seconds / 1e6 : 0
+    );
+    return pass ? 0 : 1;
+}
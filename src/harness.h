@@ -0,0 +1,10 @@
+#ifndef POPPY_HARNESS_H
+#define POPPY_HARNESS_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+int runTrapHarness(struct machine* m, uint16_t success, uint64_t limit);
+
+#endif
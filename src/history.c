@@ -0,0 +1,159 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+/* Execution history */
+/* Going backwards is done by restoring the last snapshot before the target and executing forward to it, which is
+ * deterministic as every bit of machine state is in the snapshot. What is outside of the machine is not: a writable
+ * SD card image (-C) and host files (-V) are written straight to the host, so going backwards is refused while
+ * either is in (historyReversible). Snapshots are taken every interval cycles while running for the first time, so
+ * reaching any instruction takes at most interval cycles of re-execution no matter how long the history is. The
+ * snapshots share pages through the page store so keeping a long history costs little more than the memory that
+ * actually changed */
+
+static void historyTake(struct history* h, struct machine* m) {
+    if (h->count == h->capacity) {
+        h->capacity = h->capacity ? h->capacity * 2 : 64;
+        h->snapshots = realloc(h->snapshots, h->capacity * sizeof(*h->snapshots));
+        if (!h->snapshots) {
+            fputs("Out of memory\n", stderr);
+            exit(1);
+        }
+    }
+    snapshotTake(&h->store, m, &h->snapshots[h->count], h->count ? &h->snapshots[h->count - 1] : NULL);
+    ++h->count;
+}
+
+/* Starts recording the history of the machine from its current state */
+void historyInit(struct history* h, struct machine* m, uint64_t interval) {
+    pagestoreInit(&h->store);
+    h->snapshots = NULL;
+    h->count = h->capacity = 0;
+    h->interval = interval ? interval : 1;
+    m->tracebus = true; /* for the dirty pages and the bus log */
+    historyTake(h, m);
+}
+void historyFree(struct history* h) {
+    for (unsigned i = 0; i < h->count; ++i) snapshotRelease(&h->store, &h->snapshots[i]);
+    free(h->snapshots);
+    pagestoreFree(&h->store);
+}
+
+/* Runs one instruction, taking a snapshot when it gets past the end of the history. Returns true like cpuStep when
+ * an event stops the run */
+bool historyStep(struct history* h, struct machine* m) {
+    bool stop = cpuStep(m);
+    const struct snapshot* last = &h->snapshots[h->count - 1];
+    if (m->instructions > last->instructions && m->cycles - last->cycles >= h->interval) historyTake(h, m);
+    return stop;
+}
+
+/* Whether going backwards gives back what the machine saw then, which it cannot with writes to the host in between */
+bool historyReversible(const struct machine* m) {
+    return !(m->sdcard.image && !m->sdcard.readonly) && !m->hostio.dir;
+}
+
+/* Last snapshot at or before the instruction */
+static unsigned historyFind(const struct history* h, uint64_t instructions) {
+    unsigned lo = 0, hi = h->count;
+    while (hi - lo > 1) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (h->snapshots[mid].instructions <= instructions) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Re-execution runs unthrottled, pacing would only make going backwards take as long as the original run */
+static void replayTo(struct history* h, struct machine* m, uint64_t instructions) {
+    bool fastmode = m->fastmode;
+    m->fastmode = true;
+    while (m->instructions < instructions) historyStep(h, m);
+    m->fastmode = fastmode;
+}
+
+/* Puts the machine into the state it had after the given number of instructions, instructions that were never
+ * executed are executed now */
+void historySeek(struct history* h, struct machine* m, uint64_t instructions) {
+    unsigned i = historyFind(h, instructions);
+    /* Going forward from the current state is cheaper if there is no snapshot in between */
+    if (m->instructions > instructions || h->snapshots[i].instructions > m->instructions) {
+        snapshotRestore(&h->store, m, &h->snapshots[i]);
+    }
+    replayTo(h, m, instructions);
+}
+
+/* Moves back to the latest instruction before the current one that matches, the machine is left in the state from
+ * before that instruction. Searches backwards one snapshot interval at a time and stays where it is if nothing
+ * matches */
+bool historyFindBack(struct history* h, struct machine* m, historymatch match, void* ctx) {
+    uint64_t now = m->instructions;
+    if (!now || now <= h->snapshots[0].instructions) return false;
+    bool fastmode = m->fastmode;
+    m->fastmode = true;
+    uint64_t found = 0;
+    bool hit = false;
+    for (unsigned i = historyFind(h, now - 1) + 1; i-- > 0 && !hit;) {
+        uint64_t end = i + 1 < h->count && h->snapshots[i + 1].instructions < now ? h->snapshots[i + 1].instructions
+                                                                                  : now;
+        snapshotRestore(&h->store, m, &h->snapshots[i]);
+        while (m->instructions < end) {
+            struct registers before = m->registers;
+            uint64_t at = m->instructions;
+            cpuStep(m);
+            if (match(m, &before, ctx)) {
+                found = at;
+                hit = true;
+            }
+        }
+    }
+    m->fastmode = fastmode;
+    historySeek(h, m, hit ? found : now);
+    return hit;
+}
+
+bool historyReverseStep(struct history* h, struct machine* m) {
+    if (!m->instructions || m->instructions <= h->snapshots[0].instructions) return false;
+    historySeek(h, m, m->instructions - 1);
+    return true;
+}
+
+struct callsite {
+    uint8_t sp;
+};
+static bool isCallSite(const struct machine* m, const struct registers* before, void* ctx) {
+    const struct callsite* call = ctx;
+    return m->buslog[0].value == 0x20 && before->sp == call->sp; /* JSR */
+}
+
+/* Steps back over subroutine calls, ending up before the JSR when the previous instruction was the RTS */
+bool historyReverseNext(struct history* h, struct machine* m) {
+    uint8_t sp = m->registers.sp;
+    if (!historyReverseStep(h, m)) return false;
+    if (peekByte(m, m->registers.pc) == 0x60) { /* RTS */
+        /* The SP from before the JSR is the same as after the RTS */
+        struct callsite call = {.sp = sp};
+        historyFindBack(h, m, isCallSite, &call);
+    }
+    return true;
+}
+
+/* Matches instructions that write to the watched range */
+bool historyWatchHit(const struct machine* m, const struct registers* before, void* ctx) {
+    (void)before;
+    const struct watchrange* watch = ctx;
+    unsigned n = m->buslogcount < BUSLOG_SIZE ? m->buslogcount : BUSLOG_SIZE;
+    for (unsigned i = 0; i < n; ++i) {
+        if (m->buslog[i].write && m->buslog[i].addr >= watch->first && m->buslog[i].addr <= watch->last) return true;
+    }
+    return false;
+}
+
+/* Goes back to before the last instruction that wrote to an address from first to last */
+bool historyReverseWatch(struct history* h, struct machine* m, uint16_t first, uint16_t last) {
+    struct watchrange watch = {.first = first, .last = last};
+    return historyFindBack(h, m, historyWatchHit, &watch);
+}
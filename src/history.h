@@ -0,0 +1,39 @@
+#ifndef POPPY_HISTORY_H
+#define POPPY_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+#include "snapshot.h"
+
+/* Execution history for going backwards, snapshots every interval cycles that get re-executed from */
+struct history {
+    struct pagestore store;
+    struct snapshot* snapshots; /* in order of instructions */
+    unsigned count;
+    unsigned capacity;
+    uint64_t interval;
+};
+
+/* Called after every instruction of a search with the registers from before it, the instruction matches if it
+ * returns true */
+typedef bool (*historymatch)(const struct machine* m, const struct registers* before, void* ctx);
+
+/* Context for historyWatchHit */
+struct watchrange {
+    uint16_t first, last;
+};
+
+void historyInit(struct history* h, struct machine* m, uint64_t interval);
+void historyFree(struct history* h);
+bool historyStep(struct history* h, struct machine* m);
+bool historyReversible(const struct machine* m);
+void historySeek(struct history* h, struct machine* m, uint64_t instructions);
+bool historyFindBack(struct history* h, struct machine* m, historymatch match, void* ctx);
+bool historyReverseStep(struct history* h, struct machine* m);
+bool historyReverseNext(struct history* h, struct machine* m);
+bool historyReverseWatch(struct history* h, struct machine* m, uint16_t first, uint16_t last);
+bool historyWatchHit(const struct machine* m, const struct registers* before, void* ctx);
+
+#endif
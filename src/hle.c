@@ -0,0 +1,206 @@
+#include "hle.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* HLE hooks */
+/* Native C versions of ROM routines. Hooked entry points are a bitmap that is only looked at while any hooks are
+ * set, through EVENT_HOOKS, at the instruction boundary before PC is fetched. A hook works on the machine state
+ * directly, then the routine's RTS is simulated and the hook's cycle cost is charged. Hooks are off unless they
+ * are set, and running a hooked machine in lockstep with an unhooked copy (-l) checks them against the original */
+
+bool setHook(struct machine* m, uint16_t addr, bool (*fn)(struct machine* m, void* ctx), void* ctx, unsigned cycles) {
+    clearHook(m, addr);
+    if (m->hookcount == MAX_HOOKS) return false;
+    m->hooks[m->hookcount++] = (struct hook){.addr = addr, .fn = fn, .ctx = ctx, .cycles = cycles};
+    m->hookmap[addr >> 3] |= 1U << (addr & 7);
+    raiseEvents(m, EVENT_HOOKS);
+    return true;
+}
+
+void clearHook(struct machine* m, uint16_t addr) {
+    if (!testAddress(m->hookmap, addr)) return;
+    m->hookmap[addr >> 3] &= ~(1U << (addr & 7));
+    for (unsigned i = 0; i < m->hookcount; ++i) {
+        if (m->hooks[i].addr == addr) {
+            m->hooks[i] = m->hooks[--m->hookcount];
+            break;
+        }
+    }
+    if (!m->hookcount) clearEvents(m, EVENT_HOOKS);
+}
+
+void clearHooks(struct machine* m) {
+    while (m->hookcount) clearHook(m, m->hooks[0].addr);
+}
+
+/* Runs the hook at PC instead of the routine, returns true if there was one and it did */
+bool runHook(struct machine* m) {
+    uint16_t pc = m->registers.pc;
+    if (!testAddress(m->hookmap, pc)) return false;
+    const struct hook* hook = NULL;
+    for (unsigned i = 0; i < m->hookcount; ++i) {
+        if (m->hooks[i].addr == pc) hook = &m->hooks[i];
+    }
+    if (!hook || !hook->fn(m, hook->ctx)) return false;
+    /* RTS */
+    uint8_t lo = peekByte(m, 0x100 | (uint8_t)(m->registers.sp + 1));
+    uint8_t hi = peekByte(m, 0x100 | (uint8_t)(m->registers.sp + 2));
+    m->registers.sp += 2;
+    m->registers.pc = (lo | hi << 8) + 1;
+    m->cycles += hook->cycles;
+    m->hookran = true;
+    syncDevices(m);
+    pace(m);
+    return true;
+}
+
+/* Built-in routines */
+/* Arguments and results are in a zero page block, registers are left alone but for sdbyte's A. The block is where
+ * the firmware's routine takes its arguments (HLE_ARGS unless the hook is given another), passed to the hook as its
+ * context. A ROM routine with a different convention needs a hook of its own, which is what the lockstep check is
+ * there to tell */
+
+static inline uint8_t argBlock(void* ctx) {
+    return (uintptr_t)ctx;
+}
+static uint16_t argWord(const struct machine* m, void* ctx, unsigned offset) {
+    uint8_t args = argBlock(ctx);
+    return hleRead(m, (uint8_t)(args + offset)) | hleRead(m, (uint8_t)(args + offset + 1)) << 8;
+}
+static void setArgWord(struct machine* m, void* ctx, unsigned offset, uint16_t value) {
+    uint8_t args = argBlock(ctx);
+    hleWrite(m, (uint8_t)(args + offset), value);
+    hleWrite(m, (uint8_t)(args + offset + 1), value >> 8);
+}
+
+/* Copies +4 bytes from +0 to +2, forwards */
+static bool hookMove(struct machine* m, void* ctx) {
+    uint16_t src = argWord(m, ctx, 0), dst = argWord(m, ctx, 2), len = argWord(m, ctx, 4);
+    for (uint16_t i = 0; i < len; ++i) hleWrite(m, dst + i, hleRead(m, src + i));
+    return true;
+}
+
+/* +0 * +2, the 32 bit product goes to +4 */
+static bool hookMul16(struct machine* m, void* ctx) {
+    uint32_t product = (uint32_t)argWord(m, ctx, 0) * argWord(m, ctx, 2);
+    setArgWord(m, ctx, 4, product);
+    setArgWord(m, ctx, 6, product >> 16);
+    return true;
+}
+
+/* +0 / +2, quotient to +4 and remainder to +6. Division by zero is left to the ROM */
+static bool hookDiv16(struct machine* m, void* ctx) {
+    uint16_t divisor = argWord(m, ctx, 2);
+    if (!divisor) return false;
+    setArgWord(m, ctx, 4, argWord(m, ctx, 0) / divisor);
+    setArgWord(m, ctx, 6, argWord(m, ctx, 0) % divisor);
+    return true;
+}
+
+/* CRC-16/CCITT (polynomial $1021) of +2 bytes at +0, continuing from the CRC in +4 */
+static bool hookCRC16(struct machine* m, void* ctx) {
+    uint16_t addr = argWord(m, ctx, 0), len = argWord(m, ctx, 2), crc = argWord(m, ctx, 4);
+    for (uint16_t i = 0; i < len; ++i) {
+        crc ^= hleRead(m, addr + i) << 8;
+        for (unsigned bit = 0; bit < 8; ++bit) crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+    }
+    setArgWord(m, ctx, 4, crc);
+    return true;
+}
+
+/* SD card transfers, left to the ROM while its bit-banging is in the middle of a byte. The block transfers charge
+ * the hook's cycles for every byte, like the ROM's loop would */
+
+static unsigned hookCycles(const struct machine* m) {
+    for (unsigned i = 0; i < m->hookcount; ++i) {
+        if (m->hooks[i].addr == m->registers.pc) return m->hooks[i].cycles;
+    }
+    return 0;
+}
+
+/* Sends A and returns the byte received in A, with N and Z set for it */
+static bool hookSDByte(struct machine* m, void* ctx) {
+    (void)ctx;
+    if (!sdcardAligned(&m->sdcard)) return false;
+    uint8_t value = sdcardTransfer(&m->sdcard, m->registers.a);
+    updateSDCard(m);
+    m->registers.a = value;
+    m->registers.p = (m->registers.p & ~(FLAG_NEGATIVE | FLAG_ZERO)) | (value & FLAG_NEGATIVE) |
+        (value ? 0 : FLAG_ZERO);
+    return true;
+}
+
+/* Receives +2 bytes to +0, sending $FF */
+static bool hookSDRead(struct machine* m, void* ctx) {
+    if (!sdcardAligned(&m->sdcard)) return false;
+    uint16_t dst = argWord(m, ctx, 0), len = argWord(m, ctx, 2);
+    if (len) m->cycles += (uint64_t)hookCycles(m) * (len - 1);
+    uint8_t* mem = ramRange(m, dst, len);
+    if (!m->tracebus && mem) {
+        sdcardRead(&m->sdcard, mem, len); /* straight from the image into system memory */
+    } else {
+        uint8_t buffer[SD_BLOCK];
+        for (uint16_t done = 0; done < len;) {
+            unsigned n = len - done < SD_BLOCK ? len - done : SD_BLOCK;
+            sdcardRead(&m->sdcard, buffer, n);
+            for (unsigned i = 0; i < n; ++i) hleWrite(m, dst + done + i, buffer[i]);
+            done += n;
+        }
+    }
+    updateSDCard(m);
+    return true;
+}
+
+/* Sends +2 bytes from +0 */
+static bool hookSDWrite(struct machine* m, void* ctx) {
+    if (!sdcardAligned(&m->sdcard)) return false;
+    uint16_t src = argWord(m, ctx, 0), len = argWord(m, ctx, 2);
+    if (len) m->cycles += (uint64_t)hookCycles(m) * (len - 1);
+    const uint8_t* mem = ramRange(m, src, len);
+    if (mem) {
+        sdcardWrite(&m->sdcard, mem, len);
+    } else {
+        for (uint16_t i = 0; i < len; ++i) {
+            uint8_t value = hleRead(m, src + i);
+            sdcardWrite(&m->sdcard, &value, 1);
+        }
+    }
+    updateSDCard(m);
+    return true;
+}
+
+static const struct {
+    const char* name;
+    bool (*fn)(struct machine* m, void* ctx);
+    const char* help;
+} builtins[] = {
+    {"move", hookMove, "copy (+4) bytes from (+0) to (+2)"},
+    {"mul16", hookMul16, "(+0) * (+2) to +4-+7"},
+    {"div16", hookDiv16, "(+0) / (+2), quotient to +4 and remainder to +6"},
+    {"crc16", hookCRC16, "CRC-16/CCITT of (+2) bytes at (+0), continuing from (+4)"},
+    {"sdbyte", hookSDByte, "send A to the SD card and return the byte received in A"},
+    {"sdread", hookSDRead, "receive (+2) bytes from the SD card to (+0), CYCLES per byte"},
+    {"sdwrite", hookSDWrite, "send (+2) bytes from (+0) to the SD card, CYCLES per byte"},
+};
+
+/* Sets the built-in routine name as the hook at addr, taking its arguments from the zero page block at args */
+bool setBuiltinHook(struct machine* m, uint16_t addr, const char* name, unsigned cycles, uint8_t args) {
+    for (unsigned i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i) {
+        if (!strcmp(builtins[i].name, name)) {
+            if (setHook(m, addr, builtins[i].fn, (void*)(uintptr_t)args, cycles)) return true;
+            fprintf(stderr, "Too many hooks, at most %d can be set\n", MAX_HOOKS);
+            return false;
+        }
+    }
+    fprintf(stderr, "Unknown hook '%s'\n", name);
+    return false;
+}
+
+void listBuiltinHooks(void) {
+    for (unsigned i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i) {
+        printf("            %-7s %s\n", builtins[i].name, builtins[i].help);
+    }
+}
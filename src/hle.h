@@ -0,0 +1,31 @@
+#ifndef POPPY_HLE_H
+#define POPPY_HLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HLE_ARGS 0xF0 /* zero page argument block of the built-in routines unless they are given another */
+
+#include "machine.h"
+#include "bus.h"
+
+bool setHook(struct machine* m, uint16_t addr, bool (*fn)(struct machine* m, void* ctx), void* ctx, unsigned cycles);
+void clearHook(struct machine* m, uint16_t addr);
+void clearHooks(struct machine* m);
+bool runHook(struct machine* m);
+bool setBuiltinHook(struct machine* m, uint16_t addr, const char* name, unsigned cycles, uint8_t args);
+void listBuiltinHooks(void);
+
+/* Memory for native routines, without bus accesses but keeping the RAM hash in step for lockstep. Addresses go
+ * through the memory map and only system memory can be written, like on the bus */
+static inline uint8_t hleRead(const struct machine* m, uint16_t addr) {
+    return peekByte(m, addr);
+}
+static inline void hleWrite(struct machine* m, uint16_t addr, uint8_t value) {
+    uint8_t* mem = ramRange(m, addr, 1);
+    if (!mem) return;
+    busLogRAMWrite(m, addr, *mem, value);
+    *mem = value;
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "hostio.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "machine.h"
+#include "bus.h"
+
+/* Transfers go straight between the host file and system memory with pread and pwrite at the position the device
+ * keeps for every file. A copy of the machine gets descriptors of its own (hostioCopy), and a snapshot keeps the
+ * names, modes and positions so the files are opened again as they were when it is restored */
+
+/* Turns the device on with files in dir, every command taking cost cycles, or off with a NULL dir. Files it had
+ * open are closed */
+void hostioInit(struct hostio* io, const char* dir, unsigned cost) {
+    for (unsigned i = 0; io->dir && i < HOSTIO_FILES; ++i) {
+        if (io->fds[i] >= 0) close(io->fds[i]);
+    }
+    memset(io, 0, sizeof(*io));
+    io->dir = dir;
+    io->cost = cost;
+    for (unsigned i = 0; i < HOSTIO_FILES; ++i) io->fds[i] = -1;
+}
+
+/* Makes dst's files descriptors of their own for src's, dst is overwritten. Files that cannot be duplicated are
+ * closed in dst */
+bool hostioCopy(struct hostio* dst, const struct hostio* src) {
+    bool ok = true;
+    *dst = *src;
+    for (unsigned i = 0; i < HOSTIO_FILES; ++i) {
+        if (src->fds[i] < 0) continue;
+        dst->fds[i] = fcntl(src->fds[i], F_DUPFD_CLOEXEC, 0);
+        if (dst->fds[i] < 0) {
+            fprintf(stderr, "Failed to copy host file '%s': %s\n", src->names[i], strerror(errno));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void hostioSave(const struct hostio* io, struct hostiostate* state) {
+    memcpy(state->regs, io->regs, sizeof(state->regs));
+    for (unsigned i = 0; i < HOSTIO_FILES; ++i) {
+        state->open[i] = io->fds[i] >= 0;
+        state->modes[i] = io->modes[i];
+        state->positions[i] = io->positions[i];
+    }
+}
+
+/* Plain names only, so the guest cannot get out of the directory */
+static bool plainName(const char* name) {
+    return name[0] && name[0] != '.' && !strchr(name, '/');
+}
+
+static int openFile(const struct hostio* io, const char* name, uint8_t mode, bool truncate) {
+    int flags;
+    switch (mode) {
+        default:
+            return -1;
+        case HOSTIO_MODE_READ:
+            flags = O_RDONLY;
+            break;
+        case HOSTIO_MODE_WRITE:
+            flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0);
+            break;
+        case HOSTIO_MODE_UPDATE:
+            flags = O_RDWR | O_CREAT;
+            break;
+    }
+    char path[4096];
+    int n = snprintf(path, sizeof(path), "%s/%s", io->dir, name);
+    if (n < 0 || (size_t)n >= sizeof(path)) return -1;
+    return open(path, flags | O_CLOEXEC, 0666);
+}
+
+/* Puts the device back into a saved state, files open then are opened again by name (written ones without
+ * truncating them) unless they still are. A file that cannot be opened is left closed */
+void hostioRestore(struct hostio* io, const struct hostiostate* state, const char* const names[HOSTIO_FILES]) {
+    if (!io->dir) return;
+    memcpy(io->regs, state->regs, sizeof(io->regs));
+    for (unsigned i = 0; i < HOSTIO_FILES; ++i) {
+        char name[HOSTIO_NAME];
+        memcpy(name, names[i], HOSTIO_NAME - 1);
+        name[HOSTIO_NAME - 1] = 0;
+        bool same = io->fds[i] >= 0 && state->open[i] && io->modes[i] == state->modes[i] &&
+            !strcmp(io->names[i], name);
+        if (!same) {
+            if (io->fds[i] >= 0) close(io->fds[i]);
+            io->fds[i] = -1;
+            memset(io->names[i], 0, HOSTIO_NAME);
+            if (state->open[i]) {
+                if (plainName(name)) io->fds[i] = openFile(io, name, state->modes[i], false);
+                if (io->fds[i] < 0) fprintf(stderr, "Failed to open host file '%s' again\n", name);
+                else memcpy(io->names[i], name, HOSTIO_NAME);
+            }
+        }
+        io->modes[i] = state->modes[i];
+        io->positions[i] = state->positions[i];
+    }
+}
+
+static unsigned regWord(const struct hostio* io, unsigned reg) {
+    return io->regs[reg] | io->regs[reg + 1] << 8;
+}
+
+/* Takes the RAM hash entries of a range of system memory out before a transfer into it and puts them back in after */
+static void logRange(struct machine* m, const uint8_t* mem, unsigned len) {
+    if (!m->tracebus) return;
+    unsigned offset = mem - m->sysram;
+    for (unsigned i = 0; i < len; ++i) {
+        m->ramhash ^= ramHashEntry(offset + i, mem[i]);
+        m->dirtypages[(offset + i) >> 14] |= 1ULL << (((offset + i) >> 8) & 63);
+    }
+}
+
+static uint8_t hostioOpen(struct machine* m, unsigned file) {
+    struct hostio* io = &m->hostio;
+    char name[HOSTIO_NAME];
+    unsigned addr = regWord(io, HOSTIO_ADDR);
+    unsigned len = 0;
+    while (len < sizeof(name) && (name[len] = peekByte(m, addr + len))) ++len;
+    if (len == sizeof(name) || !plainName(name)) return HOSTIO_BADNAME;
+    uint8_t mode = io->regs[HOSTIO_MODE];
+    if (mode > HOSTIO_MODE_UPDATE) return HOSTIO_BADCMD;
+    int fd = openFile(io, name, mode, true);
+    if (fd < 0) return HOSTIO_HOSTERR;
+    if (io->fds[file] >= 0) close(io->fds[file]);
+    io->fds[file] = fd;
+    io->modes[file] = mode;
+    memset(io->names[file], 0, HOSTIO_NAME);
+    memcpy(io->names[file], name, len);
+    io->positions[file] = 0;
+    return HOSTIO_OK;
+}
+
+static uint8_t hostioTransfer(struct machine* m, unsigned file, bool write) {
+    struct hostio* io = &m->hostio;
+    unsigned addr = regWord(io, HOSTIO_ADDR), len = regWord(io, HOSTIO_LEN);
+    uint8_t* mem = ramRange(m, addr, len);
+    if (!mem) return HOSTIO_BADRANGE;
+    ssize_t n;
+    if (write) {
+        n = pwrite(io->fds[file], mem, len, io->positions[file]);
+    } else {
+        logRange(m, mem, len);
+        n = pread(io->fds[file], mem, len, io->positions[file]);
+        logRange(m, mem, len);
+    }
+    if (n < 0) return HOSTIO_HOSTERR;
+    io->positions[file] += n;
+    io->regs[HOSTIO_DONE] = n;
+    io->regs[HOSTIO_DONE + 1] = n >> 8;
+    return HOSTIO_OK;
+}
+
+static uint8_t hostioCommand(struct machine* m, uint8_t cmd) {
+    struct hostio* io = &m->hostio;
+    unsigned file = io->regs[HOSTIO_FILE];
+    if (file >= HOSTIO_FILES) return HOSTIO_BADFILE;
+    if (cmd == HOSTIO_OPEN) return hostioOpen(m, file);
+    if (io->fds[file] < 0) return HOSTIO_BADFILE;
+    switch (cmd) {
+        default:
+            return HOSTIO_BADCMD;
+        case HOSTIO_CLOSE:
+            close(io->fds[file]);
+            io->fds[file] = -1;
+            memset(io->names[file], 0, HOSTIO_NAME);
+            return HOSTIO_OK;
+        case HOSTIO_READ:
+            return hostioTransfer(m, file, false);
+        case HOSTIO_WRITE:
+            return hostioTransfer(m, file, true);
+        case HOSTIO_SEEK:
+            io->positions[file] = io->regs[HOSTIO_OFFSET] | io->regs[HOSTIO_OFFSET + 1] << 8 |
+                io->regs[HOSTIO_OFFSET + 2] << 16 | (uint32_t)io->regs[HOSTIO_OFFSET + 3] << 24;
+            return HOSTIO_OK;
+    }
+}
+
+uint8_t hostioRead(struct machine* m, uint16_t addr) {
+    return m->hostio.regs[addr & 0xF];
+}
+
+void hostioWrite(struct machine* m, uint16_t addr, uint8_t value) {
+    struct hostio* io = &m->hostio;
+    io->regs[addr & 0xF] = value;
+    if ((addr & 0xF) != HOSTIO_CMD) return;
+    io->regs[HOSTIO_STATUS] = hostioCommand(m, value);
+    /* The file's position, so the guest can tell where it is */
+    unsigned file = io->regs[HOSTIO_FILE];
+    uint32_t position = file < HOSTIO_FILES ? io->positions[file] : 0;
+    for (unsigned i = 0; i < 4; ++i) io->regs[HOSTIO_OFFSET + i] = position >> (i * 8);
+    m->cycles += io->cost;
+}
@@ -0,0 +1,70 @@
+#ifndef POPPY_HOSTIO_H
+#define POPPY_HOSTIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Host file I/O */
+/* A paravirtual device in the unused $B000-$BFFF region for test workloads, with its registers mirrored every 16
+ * bytes. The guest fills in the registers and writes a command to HOSTIO_CMD, which is done right away and stalls
+ * the CPU for the device's cost. Files are opened by name in one host directory */
+
+/* Registers (the bottom 4 bits of the address), multi-byte ones are little endian */
+#define HOSTIO_CMD    0x0 /* Write to run a command */
+#define HOSTIO_STATUS 0x1 /* HOSTIO_OK or why the last command failed */
+#define HOSTIO_FILE   0x2 /* File number, 0 to HOSTIO_FILES - 1 */
+#define HOSTIO_MODE   0x3 /* HOSTIO_MODE_* for HOSTIO_OPEN */
+#define HOSTIO_ADDR   0x4 /* 2 bytes, system memory to transfer to or from, the name for HOSTIO_OPEN */
+#define HOSTIO_LEN    0x6 /* 2 bytes, bytes to transfer */
+#define HOSTIO_OFFSET 0x8 /* 4 bytes, the position for HOSTIO_SEEK, the file's position after every command */
+#define HOSTIO_DONE   0xC /* 2 bytes, bytes the last transfer moved, less than HOSTIO_LEN at the end of a file */
+
+/* Commands */
+#define HOSTIO_OPEN  0x01 /* Open the zero terminated name at HOSTIO_ADDR as HOSTIO_FILE */
+#define HOSTIO_CLOSE 0x02
+#define HOSTIO_READ  0x03 /* Read HOSTIO_LEN bytes from the file's position to HOSTIO_ADDR */
+#define HOSTIO_WRITE 0x04 /* Write HOSTIO_LEN bytes from HOSTIO_ADDR at the file's position */
+#define HOSTIO_SEEK  0x05 /* Set the file's position to HOSTIO_OFFSET */
+
+#define HOSTIO_MODE_READ   0x00
+#define HOSTIO_MODE_WRITE  0x01 /* Created or truncated */
+#define HOSTIO_MODE_UPDATE 0x02 /* Read and write, created if it does not exist */
+
+/* Status */
+#define HOSTIO_OK       0x00
+#define HOSTIO_BADCMD   0x01 /* Unknown command or mode */
+#define HOSTIO_BADFILE  0x02 /* File number out of range, or not open */
+#define HOSTIO_BADNAME  0x03 /* The name is empty, too long or leaves the directory */
+#define HOSTIO_BADRANGE 0x04 /* The transfer is not all in one piece of system memory */
+#define HOSTIO_HOSTERR  0x05 /* The host failed it */
+
+#define HOSTIO_FILES 4
+#define HOSTIO_NAME 256 /* longest name with its terminator, a page so snapshots can keep it in the page store */
+
+struct hostio {
+    const char* dir; /* NULL while the device is off, the region floats then */
+    unsigned cost; /* Cycles every command takes */
+    uint8_t regs[16];
+    int fds[HOSTIO_FILES]; /* -1 for files that are not open */
+    uint64_t positions[HOSTIO_FILES];
+    uint8_t modes[HOSTIO_FILES]; /* HOSTIO_MODE_* the files were opened with */
+    char names[HOSTIO_FILES][HOSTIO_NAME]; /* zero padded, for opening them again */
+};
+
+/* What a snapshot keeps of the device, the names of the files go in the page store */
+struct hostiostate {
+    uint8_t regs[16];
+    bool open[HOSTIO_FILES];
+    uint8_t modes[HOSTIO_FILES];
+    uint64_t positions[HOSTIO_FILES];
+};
+
+struct machine;
+void hostioInit(struct hostio* io, const char* dir, unsigned cost);
+bool hostioCopy(struct hostio* dst, const struct hostio* src);
+void hostioSave(const struct hostio* io, struct hostiostate* state);
+void hostioRestore(struct hostio* io, const struct hostiostate* state, const char* const names[HOSTIO_FILES]);
+uint8_t hostioRead(struct machine* m, uint16_t addr);
+void hostioWrite(struct machine* m, uint16_t addr, uint8_t value);
+
+#endif
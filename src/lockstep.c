@@ -0,0 +1,98 @@
+#include "lockstep.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+
+/* Lockstep */
+/* Runs two copies of a machine side by side, usually on different cores, and stops at the first instruction where
+ * the registers, the cycle count, the bus accesses or the contents of system memory disagree. When a runs an HLE
+ * hook in place of a routine, b runs the original routine until it returns to the same place, then only the
+ * registers and system memory have to agree and a takes over b's cycle count and devices */
+
+static bool sameRegisters(const struct machine* a, const struct machine* b) {
+    return a->registers.pc == b->registers.pc && a->registers.sp == b->registers.sp &&
+        a->registers.a == b->registers.a && a->registers.x == b->registers.x &&
+        a->registers.y == b->registers.y && a->registers.p == b->registers.p;
+}
+
+static bool sameState(const struct machine* a, const struct machine* b) {
+    if (!sameRegisters(a, b)) return false;
+    if (a->cycles != b->cycles || a->ramhash != b->ramhash) return false;
+    if (a->buslogcount != b->buslogcount) return false;
+    unsigned count = a->buslogcount < BUSLOG_SIZE ? a->buslogcount : BUSLOG_SIZE;
+    for (unsigned i = 0; i < count; ++i) {
+        const struct busaccess* x = &a->buslog[i];
+        const struct busaccess* y = &b->buslog[i];
+        if (x->addr != y->addr || x->value != y->value || x->write != y->write) return false;
+    }
+    return true;
+}
+
+static void printState(const char* name, const struct machine* m) {
+    static const char* corenames[] = {"fast", "accurate", "auto"};
+    printf("%s (%s core):\n    ", name, corenames[m->core]);
+    printRegisters(&m->registers);
+    printf("    Cycles: %" PRIu64 "  RAM hash: %016" PRIx64 "\n", m->cycles, m->ramhash);
+    unsigned count = m->buslogcount < BUSLOG_SIZE ? m->buslogcount : BUSLOG_SIZE;
+    for (unsigned i = 0; i < count; ++i) {
+        printf("    %c  --  0x%04X: 0x%02X\n", m->buslog[i].write ? 'W' : 'R', m->buslog[i].addr, m->buslog[i].value);
+    }
+    if (m->buslogcount > count) printf("    (%u more accesses)\n", m->buslogcount - count);
+}
+
+/* Runs b through the routine a ran a hook for, up to where the hook returned to. Returns false if the results
+ * differ, b gets a limit so a hook that returns somewhere else does not hang the run */
+static bool catchUp(struct machine* a, struct machine* b) {
+    for (unsigned i = 0; i < 100000000; ++i) {
+        cpuStep(b);
+        if (b->registers.pc == a->registers.pc && b->registers.sp == a->registers.sp) break;
+    }
+    if (!sameRegisters(a, b) || a->ramhash != b->ramhash) return false;
+    a->cycles = b->cycles;
+    a->devicecycles = b->devicecycles;
+    a->via = b->via;
+    sdcardSetState(&a->sdcard, &b->sdcard);
+    a->irqline = b->irqline;
+    if (b->irqline) raiseEvents(a, EVENT_IRQ);
+    else clearEvents(a, EVENT_IRQ);
+    return true;
+}
+
+/* Turn on bus tracing on two machines that are about to be run in lockstep */
+void lockstepStart(struct machine* a, struct machine* b) {
+    a->tracebus = true;
+    a->ramhash = ramHash(a);
+    b->tracebus = true;
+    b->ramhash = ramHash(b);
+}
+
+/* Returns false if the machines diverged before running limit instructions (0 for no limit) */
+bool lockstepRun(struct machine* a, struct machine* b, uint64_t limit) {
+    while (!limit || a->instructions < limit) {
+        uint16_t pc = a->registers.pc;
+        cpuStep(a);
+        if (a->hookran) {
+            a->hookran = false;
+            if (!catchUp(a, b)) {
+                printf("Lockstep divergence in the hooked routine called from $%04X\n", pc);
+                printState("A", a);
+                printState("B", b);
+                return false;
+            }
+            continue;
+        }
+        cpuStep(b);
+        if (!sameState(a, b)) {
+            printf(
+                "Lockstep divergence in instruction %" PRIu64 " at $%04X\n",
+                a->instructions, pc
+            );
+            printState("A", a);
+            printState("B", b);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,12 @@
+#ifndef POPPY_LOCKSTEP_H
+#define POPPY_LOCKSTEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+void lockstepStart(struct machine* a, struct machine* b);
+bool lockstepRun(struct machine* a, struct machine* b, uint64_t limit);
+
+#endif
@@ -0,0 +1,101 @@
+#include "machine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bus.h"
+#include "breakpoints.h"
+#include "recompile.h"
+
+/* Machine */
+/* Setting up a machine, shared by the emulator and libpoppy */
+
+/* Power on: RAM comes up with random contents, and so do unused addresses when they are read. seed picks the
+ * random values so a machine can be set up the same way again */
+void initMachine(struct machine* m, uint64_t seed) {
+    uint64_t x = seed | 1; /* xorshift64, must not be 0 */
+    for (unsigned i = 0; i < 32768; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        m->sysram[i] = x & x >> 32; /* mostly zero bits like real SRAM */
+    }
+    m->floating = x;
+    mapDefault(m);
+    mapWatchpoints(m); /* the page table, without watched pages */
+    viaReset(&m->via);
+    m->devicecycles = m->cycles;
+    m->nexttimer = UINT64_MAX;
+    #ifdef POPPY_ROMC
+    m->romimage = &romImage;
+    #endif
+}
+
+/* The RESET line: the devices are reset and PC is read from the RESET vector ($FFFC, $1FFC in ROM0 in the Odin32K's
+ * own memory map) */
+void resetMachine(struct machine* m) {
+    syncDevices(m);
+    viaReset(&m->via);
+    updateSDCard(m); /* the port pins are inputs again, which deselects the card */
+    if (m->bankcount) {
+        for (unsigned i = 0; i < m->bankcount; ++i) selectBank(m, i, 0);
+        mapWatchpoints(m); /* right away, the first instruction is run before the event is looked at */
+    }
+    for (unsigned i = 0; i < m->plugincount; ++i) {
+        if (m->plugins[i].reset) m->plugins[i].reset(m->plugins[i].ctx);
+    }
+    updateIRQ(m);
+    m->registers.pc = peekByte(m, 0xFFFC) | (peekByte(m, 0xFFFD) << 8);
+}
+
+/* Reads an 8K ROM image into ROM0 or ROM1 */
+bool loadROM(struct machine* m, const char* file, unsigned rom) {
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s' for ROM%u: %s\n", file, rom, strerror(errno));
+        return false;
+    }
+    fread(rom ? m->rom1 : m->rom0, 1, 8192, fp);
+    fclose(fp);
+    m->romcode = ROMCODE_UNCHECKED;
+    return true;
+}
+
+/* Loads a file wherever there is RAM or ROM from addr on, the I/O region is skipped */
+bool loadBinary(struct machine* m, const char* file, uint16_t addr) {
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return false;
+    }
+    int c;
+    for (unsigned at = addr; at < 0x10000 && (c = getc(fp)) != EOF; ++at) {
+        pokeByte(m, at, c);
+    }
+    fclose(fp);
+    return true;
+}
+
+/* Pointers into the machine itself have to point into the copy instead */
+static inline const void* rebase(const void* ptr, const struct machine* from, struct machine* to) {
+    const char* p = ptr;
+    if (p < (const char*)from || p >= (const char*)(from + 1)) return ptr;
+    return (char*)to + (p - (const char*)from);
+}
+
+/* Make dst an identical copy of src that runs independently from it, with its own copy of the SD card and its own
+ * descriptors for the host files. Device, timer and hook contexts that point into src point into dst, other devices
+ * are shared */
+bool copyMachine(struct machine* dst, const struct machine* src) {
+    memcpy(dst, src, sizeof(*dst));
+    for (unsigned page = 0; page < 256; ++page) {
+        dst->readpages[page] = rebase(src->readpages[page], src, dst);
+        dst->writepages[page] = (uint8_t*)rebase(src->writepages[page], src, dst);
+        dst->devices[page].ctx = (void*)rebase(src->devices[page].ctx, src, dst);
+    }
+    dst->codepage = rebase(src->codepage, src, dst);
+    for (unsigned i = 0; i < src->timercount; ++i) dst->timers[i].ctx = (void*)rebase(src->timers[i].ctx, src, dst);
+    for (unsigned i = 0; i < src->hookcount; ++i) dst->hooks[i].ctx = (void*)rebase(src->hooks[i].ctx, src, dst);
+    return sdcardCopy(&dst->sdcard, &src->sdcard) && hostioCopy(&dst->hostio, &src->hostio);
+}
@@ -0,0 +1,300 @@
+#ifndef POPPY_MACHINE_H
+#define POPPY_MACHINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "via.h"
+#include "sdcard.h"
+#include "hostio.h"
+#include "symbols.h"
+
+/* Registers */
+struct registers {
+    uint16_t pc; // Program counter
+    uint8_t sp; // Stack pointer
+    uint8_t a; // Accumulator
+    uint8_t x; // X register
+    uint8_t y; // Y register
+    uint8_t p; // Processor status
+};
+
+/* Status flags */
+/* https://codebase64.org/doku.php?id=base:6502_registers */
+#define FLAG_CARRY      (1U << 0)
+#define FLAG_ZERO       (1U << 1)
+#define FLAG_IRQDISABLE (1U << 2)
+#define FLAG_DECIMAL    (1U << 3)
+#define FLAG_BREAK      (1U << 4)
+#define FLAG_ONE        (1U << 5)
+#define FLAG_OVERFLOW   (1U << 6)
+#define FLAG_NEGATIVE   (1U << 7)
+
+/* Page flags */
+#define PAGE_ACCURATE (1U << 0) /* Accesses switch the auto core over to the accurate core */
+#define PAGE_WATCH    (1U << 1) /* Has watchpoints, its accesses go through the slow path to be checked */
+
+/* CPU cores */
+enum core {
+    CORE_FAST, /* Steps whole instructions, devices catch up at instruction boundaries */
+    CORE_ACCURATE, /* Steps the instructions a bus cycle at a time, and the devices with them */
+    CORE_AUTO /* Fast core, switching to the accurate core while PAGE_ACCURATE pages are being accessed */
+};
+
+/* The accurate core's place in the instruction it is running (sequencer.c) */
+struct sequencer {
+    uint8_t opcode;
+    uint8_t step; /* Next bus cycle of the instruction, 0 between instructions */
+    uint8_t data; /* Zero page operand or pointer, or the result a read-modify-write writes back */
+    uint16_t base; /* Address before indexing */
+    uint16_t addr; /* Effective address */
+};
+
+/* Reasons for stopping a run */
+enum stop {
+    STOP_NONE,
+    STOP_BREAKPOINT, /* PC reached a breakpoint */
+    STOP_WATCHPOINT, /* The last instruction accessed a watched address (stopaddr) */
+    STOP_STEP, /* EVENT_STEP */
+    STOP_REQUEST, /* EVENT_STOP from outside the CPU thread */
+    STOP_MONITOR /* EVENT_MONITOR, the monitor has a command for the CPU thread */
+};
+
+/* Recompiled ROM code */
+/* Whether the blocks of a ROM-specialized binary (make ROMC=...) or a translation cache were made from the ROMs in
+ * the machine, anything that changes ROM or the page table sets it back to unchecked */
+enum romcode {
+    ROMCODE_UNCHECKED,
+    ROMCODE_MATCH,
+    ROMCODE_MISMATCH
+};
+struct romimage; /* recompile.h */
+
+/* Pending events */
+/* Everything that has to happen between two instructions sets a bit in the events word, so cpuStep only needs a
+ * single test of it to know that nothing has to be done. Bits can be set from any thread */
+#define EVENT_MONITOR     (1U << 0) /* The monitor has a command in its mailbox, stays set until it is taken */
+#define EVENT_IRQ         (1U << 1) /* The IRQ line is asserted, stays set as long as it is */
+#define EVENT_NMI         (1U << 2) /* An NMI edge happened */
+#define EVENT_BREAKPOINTS (1U << 3) /* Breakpoints are set, PC has to be looked up in the bitmap */
+#define EVENT_STEP        (1U << 4) /* Stop after this instruction */
+#define EVENT_STOP        (1U << 5) /* Stop as soon as possible, with the reason in stop if it is already set */
+#define EVENT_TRACE       (1U << 6) /* Print the registers after every instruction, stays set until cleared */
+#define EVENT_REMAP       (1U << 7) /* Rebuild the page table before the next instruction */
+#define EVENT_HOOKS       (1U << 8) /* HLE hooks are set, PC is checked against them */
+
+/* Memory map */
+/* What is behind every page, the page table and the slow path are both made from it. It is the Odin32K's own map
+ * unless a machine description (config.c) says otherwise */
+enum region {
+    REGION_NONE, /* Nothing, reads float and writes are ignored */
+    REGION_RAM, /* System memory */
+    REGION_ROM0,
+    REGION_ROM1,
+    REGION_VIA, /* I/O controller */
+    REGION_HOSTIO, /* Host file I/O, floats while it is off */
+    REGION_BANK /* Bank register, writes select what a bank window shows */
+};
+struct pagemap {
+    uint8_t region; /* enum region */
+    uint8_t bank; /* index in banks of a REGION_BANK page */
+    uint16_t offset; /* of the page in the memory of REGION_RAM, REGION_ROM0 and REGION_ROM1 */
+};
+
+/* Banks */
+/* A window of pages that shows one of several pieces of memory, picked by writing its number to the bank register */
+#define MAX_BANKS 4
+#define MAX_BANK_SOURCES 8
+struct bank {
+    uint8_t first, last; /* pages of the window */
+    unsigned count; /* sources */
+    struct pagemap sources[MAX_BANK_SOURCES]; /* what the first page of the window is for every bank number */
+    uint8_t selected;
+};
+
+/* External devices */
+/* Handlers for pages the Odin32K leaves unused, supplied by whoever embeds the machine */
+struct pagedevice {
+    uint8_t (*read)(void* ctx, uint16_t addr);
+    void (*write)(void* ctx, uint16_t addr, uint8_t value);
+    void* ctx;
+};
+
+/* Device timers */
+/* Events devices schedule for a cycle, run when the devices are caught up to it */
+#define MAX_TIMERS 16
+struct devicetimer {
+    uint64_t cycle;
+    void (*fn)(void* ctx, uint64_t cycle);
+    void* ctx;
+};
+
+/* Device plugins */
+/* Shared objects loaded at startup (plugin.c), their pages are in devices like any other external device's */
+#define MAX_PLUGINS 4
+struct plugin {
+    void* module; /* dlopen handle */
+    void* host; /* what the plugin was given to call back with */
+    void* ctx;
+    void (*reset)(void* ctx);
+    void (*save)(void* ctx, uint8_t* state);
+    void (*load)(void* ctx, const uint8_t* state);
+    void (*destroy)(void* ctx);
+};
+
+/* HLE hooks */
+/* Native replacements for ROM routines, run in place of the routine when PC reaches its entry */
+#define MAX_HOOKS 32
+struct machine;
+struct hook {
+    uint16_t addr;
+    bool (*fn)(struct machine* m, void* ctx); /* returns false to run the original routine after all */
+    void* ctx;
+    unsigned cycles; /* charged for the whole routine, including its RTS */
+};
+
+/* Bus log */
+#define BUSLOG_SIZE 16 /* More than any instruction needs */
+struct busaccess {
+    uint16_t addr;
+    uint8_t value;
+    bool write;
+};
+
+struct machine {
+    struct registers registers;
+
+    /* Memory Map */
+    uint8_t sysram[32768]; // System memory, $0000-$7FFF
+    uint8_t rom0[8192]; // ROM0, $E000-$FFFF
+    uint8_t rom1[8192]; // ROM1, $C000-$DFFF
+
+    struct pagemap memmap[256];
+    struct bank banks[MAX_BANKS];
+    unsigned bankcount;
+    uint8_t waitstates[256]; /* Cycles every access to a page takes on top of its own */
+
+    /* Page table */
+    /* Host pointers for every 256 byte page that is plain memory, NULL for pages that need the slow path */
+    const uint8_t* readpages[256];
+    uint8_t* writepages[256];
+    uint8_t pageflags[256];
+
+    /* Opcode fetch */
+    /* Only used by make bench's codepage variant (see bus.h): the host pointer for the current code page is cached
+     * and only looked up again when PC ends up in a different page or the page table changes */
+    unsigned codepagenum; /* page number of the cached code page, 0x100 when invalid */
+    const uint8_t* codepage; /* host pointer of the cached code page, NULL if it has to go through the slow path */
+    const struct romimage* romimage; /* Recompiled ROM code, NULL if there is none */
+    enum romcode romcode;
+
+    /* Devices */
+    struct via via; /* I/O controller, $8000-$8FFF */
+    struct sdcard sdcard; /* On VIA port B, no image without one */
+    struct hostio hostio; /* $B000-$BFFF, off unless it is given a directory */
+    uint64_t devicecycles; /* Cycle the devices have been stepped up to */
+    uint64_t floating; /* State of the random values read from unused addresses */
+    struct pagedevice devices[256]; /* External devices by page, pages without one have NULL handlers */
+    uint32_t extirq; /* Levels of the IRQ lines driven by external devices, a bit each (0 for libpoppy, then plugins) */
+    struct devicetimer timers[MAX_TIMERS];
+    unsigned timercount;
+    uint64_t nexttimer; /* Earliest cycle in timers, UINT64_MAX without any */
+    struct plugin plugins[MAX_PLUGINS];
+    unsigned plugincount;
+
+    /* Timing */
+    uint64_t cycles; /* Total emulated cycles */
+    uint64_t instructions; /* Total executed instructions */
+    uint64_t runinstructions; /* Instruction count cpuRun stops at, 0 for none, recompiled blocks stop there too */
+    uint64_t runcycles; /* Cycle poppyRunCycles stops at, 0 for none, recompiled blocks stop there too */
+    bool selfloop; /* Set when a JMP jumps to itself, which is how test programs stop */
+    uint64_t pacedcycles; /* Cycle the host clock has been paced up to */
+    struct timespec targettime;
+    bool fastmode; /* Run unthrottled and skip dummy reads that cannot be observed */
+
+    /* Cores */
+    enum core core;
+    struct sequencer sequencer;
+    bool accuratehit; /* Set by the slow path when a PAGE_ACCURATE page is accessed */
+    unsigned accuratehold; /* Instructions left to run on the accurate core in CORE_AUTO */
+
+    /* Bus tracing, for comparing machines against each other */
+    bool tracebus; /* Log the bus accesses of the current instruction and keep ramhash up to date */
+    unsigned buslogcount; /* Accesses in the current instruction, can be more than BUSLOG_SIZE */
+    struct busaccess buslog[BUSLOG_SIZE];
+    uint64_t ramhash; /* XOR of ramHashEntry for every byte of system memory */
+    uint64_t fingerprint; /* Rolling hash of the registers after every instruction and every bus write */
+    uint64_t dirtypages[2]; /* Bitmap of the system memory pages written since the last fingerprint checkpoint */
+
+    /* Breakpoints and watchpoints, bitmaps of the whole address space */
+    uint8_t breakpoints[8192];
+    uint8_t readwatch[8192];
+    uint8_t writewatch[8192];
+    unsigned breakpointcount; /* Breakpoints set, EVENT_BREAKPOINTS is set while this is not 0 */
+    enum stop stop; /* Why the last run stopped */
+    uint16_t stopaddr;
+
+    atomic_uint events; /* EVENT_* bits */
+    bool irqline; /* Level of the IRQ line as last seen, EVENT_IRQ follows it */
+
+    /* HLE hooks, EVENT_HOOKS is set while hookcount is not 0 */
+    uint8_t hookmap[8192]; /* bitmap of the addresses in hooks */
+    struct hook hooks[MAX_HOOKS];
+    unsigned hookcount;
+    bool hookran; /* Set when a hook replaced a routine, for lockstep to catch the original up */
+    bool hookpending; /* A run stopped at PC before its hook could run, the next step runs it first */
+
+    const struct symbols* symbols; /* Labels for listings and traces, NULL without a symbol file */
+};
+
+static inline void raiseEvents(struct machine* m, unsigned events) {
+    atomic_fetch_or(&m->events, events);
+}
+static inline void clearEvents(struct machine* m, unsigned events) {
+    atomic_fetch_and(&m->events, ~events);
+}
+
+static inline bool testAddress(const uint8_t* map, uint16_t addr) {
+    return map[addr >> 3] >> (addr & 7) & 1;
+}
+
+/* Step of the rolling fingerprint hash */
+static inline uint64_t fingerprintMix(uint64_t hash, uint64_t value) {
+    return ((hash << 5 | hash >> 59) ^ value) * 0x9E3779B97F4A7C15;
+}
+
+/* Hash of a single byte of memory, XORed together so a write only has to swap out one entry */
+static inline uint64_t ramHashEntry(uint16_t addr, uint8_t value) {
+    /* splitmix64 finalizer */
+    uint64_t x = ((uint64_t)addr << 8 | value) + 0x9E3779B97F4A7C15;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+    return x ^ (x >> 31);
+}
+
+/* machine.c */
+void initMachine(struct machine* m, uint64_t seed);
+void resetMachine(struct machine* m);
+bool loadROM(struct machine* m, const char* file, unsigned rom);
+bool loadBinary(struct machine* m, const char* file, uint16_t addr);
+bool copyMachine(struct machine* dst, const struct machine* src);
+
+/* bus.c */
+void mapDefault(struct machine* m);
+void mapPages(struct machine* m);
+void selectBank(struct machine* m, unsigned bank, uint8_t number);
+void setWaitStates(struct machine* m, uint16_t first, uint16_t last, uint8_t cycles);
+void mapFlat(struct machine* m, uint8_t* mem);
+bool pokeByte(struct machine* m, uint16_t addr, uint8_t value);
+uint8_t* ramRange(struct machine* m, uint16_t addr, unsigned len);
+uint8_t peekByte(const struct machine* m, uint16_t addr);
+uint64_t ramHash(const struct machine* m);
+uint8_t busReadSlow(struct machine* m, uint16_t addr);
+void busWriteSlow(struct machine* m, uint16_t addr, uint8_t value);
+bool setTimer(struct machine* m, uint64_t cycle, void (*fn)(void* ctx, uint64_t cycle), void* ctx);
+void clearTimers(struct machine* m);
+void runTimers(struct machine* m);
+
+#endif
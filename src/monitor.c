@@ -0,0 +1,270 @@
+#include "monitor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "cpu.h"
+#include "disasm.h"
+#include "breakpoints.h"
+#include "snapshot.h"
+#include "symbols.h"
+
+/* Monitor */
+/* A machine language monitor reading commands from stdin on its own thread, so the machine keeps running while
+ * it waits for input. Commands go through a one-entry mailbox and are carried out by the CPU thread at an
+ * instruction boundary, which the monitor asks for by setting EVENT_MONITOR, so an idle monitor costs nothing */
+
+struct monitor {
+    struct machine* m;
+    uint64_t limit;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char command[256];
+    bool full; /* a command is waiting in the mailbox */
+    bool running;
+    bool quit;
+    uint16_t dumpnext, disasmnext; /* where m and d without an address continue */
+};
+
+static void showHelp(void) {
+    puts("  m [ADDR] [END]      Dump memory, addresses can also be labels");
+    puts("  d [ADDR] [COUNT]    Disassemble (from PC if ADDR is left out)");
+    puts("  r [REG=VALUE]...    Show or set registers (PC SP A X Y P)");
+    puts("  g [ADDR]            Go, from ADDR if given");
+    puts("  x                   Stop");
+    puts("  s [COUNT]           Step COUNT instructions (default 1)");
+    puts("  b ADDR              Set or remove a breakpoint");
+    puts("  t                   Turn tracing the registers after every instruction on or off");
+    puts("  ss FILE             Save a snapshot to FILE");
+    puts("  q                   Quit");
+}
+
+static bool parseHex(const char* str, unsigned long max, unsigned long* out) {
+    if (*str == '$') ++str;
+    char* end;
+    unsigned long value = strtoul(str, &end, 16);
+    if (end == str || *end || value > max) {
+        printf("Invalid value '%s'\n", str);
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+/* An address in hex or a label */
+static bool parseAddress(const struct machine* m, const char* str, unsigned long* out) {
+    uint16_t addr;
+    if (symbolFind(m->symbols, str, &addr)) {
+        *out = addr;
+        return true;
+    }
+    return parseHex(str, 0xFFFF, out);
+}
+
+static void showState(const struct machine* m) {
+    char line[128];
+    printRegisters(&m->registers);
+    disassemble(m, m->registers.pc, line, sizeof(line));
+    puts(line);
+}
+
+static void dumpMemory(struct monitor* mon, uint16_t first, uint16_t last) {
+    for (unsigned addr = first & ~15U; addr <= last; addr += 16) {
+        char ascii[17] = "";
+        printf("$%04X ", addr);
+        for (unsigned i = 0; i < 16; ++i) {
+            uint8_t value = peekByte(mon->m, addr + i);
+            printf(i == 8 ? "  %02X" : " %02X", value);
+            ascii[i] = value >= 0x20 && value < 0x7F ? value : '.';
+        }
+        printf("  %s\n", ascii);
+    }
+    mon->dumpnext = last + 1;
+}
+
+static bool setRegister(struct registers* r, const char* arg) {
+    const char* eq = strchr(arg, '=');
+    unsigned long value;
+    if (!eq) {
+        printf("Expected REG=VALUE, got '%s'\n", arg);
+        return false;
+    }
+    size_t len = eq - arg;
+    bool pc = len == 2 && !strncasecmp(arg, "PC", 2);
+    if (!parseHex(eq + 1, pc ? 0xFFFF : 0xFF, &value)) return false;
+    if (pc) r->pc = value;
+    else if (len == 2 && !strncasecmp(arg, "SP", 2)) r->sp = value;
+    else if (len == 1 && (*arg == 'A' || *arg == 'a')) r->a = value;
+    else if (len == 1 && (*arg == 'X' || *arg == 'x')) r->x = value;
+    else if (len == 1 && (*arg == 'Y' || *arg == 'y')) r->y = value;
+    else if (len == 1 && (*arg == 'P' || *arg == 'p')) r->p = value;
+    else {
+        printf("Unknown register in '%s'\n", arg);
+        return false;
+    }
+    return true;
+}
+
+static void saveSnapshot(struct machine* m, const char* file) {
+    static struct pagestore store;
+    struct snapshot s;
+    pagestoreInit(&store);
+    snapshotTake(&store, m, &s, NULL);
+    if (snapshotSave(file, &store, &s, 1)) printf("Saved a snapshot to '%s'\n", file);
+    snapshotRelease(&store, &s);
+    pagestoreFree(&store);
+}
+
+/* Carries out a command, on the CPU thread */
+static void runCommand(struct monitor* mon, char* line) {
+    struct machine* m = mon->m;
+    char* args[8];
+    unsigned argc = 0;
+    for (char* tok = strtok(line, " \t\n"); tok && argc < 8; tok = strtok(NULL, " \t\n")) args[argc++] = tok;
+    if (!argc) return;
+    const char* cmd = args[0];
+    unsigned long a = 0, b = 0;
+
+    if (!strcmp(cmd, "m")) {
+        if (argc > 1 && !parseAddress(m, args[1], &a)) return;
+        if (argc == 1) a = mon->dumpnext;
+        if (argc > 2 && !parseAddress(m, args[2], &b)) return;
+        if (argc <= 2) b = a + 0x7F > 0xFFFF ? 0xFFFF : a + 0x7F;
+        dumpMemory(mon, a, b);
+    } else if (!strcmp(cmd, "d")) {
+        if (argc > 1 && !parseAddress(m, args[1], &a)) return;
+        if (argc == 1) a = mon->running ? mon->disasmnext : m->registers.pc;
+        b = argc > 2 ? strtoul(args[2], NULL, 0) : 16;
+        uint16_t addr = a;
+        char text[128];
+        while (b--) {
+            uint16_t offset;
+            const char* label = symbolLookup(m->symbols, addr, &offset);
+            if (label && !offset) printf("%s:\n", label);
+            addr += disassemble(m, addr, text, sizeof(text));
+            puts(text);
+        }
+        mon->disasmnext = addr;
+    } else if (!strcmp(cmd, "r")) {
+        struct registers r = m->registers;
+        for (unsigned i = 1; i < argc; ++i) {
+            if (!setRegister(&r, args[i])) return;
+        }
+        m->registers = r;
+        printRegisters(&m->registers);
+    } else if (!strcmp(cmd, "g")) {
+        if (argc > 1) {
+            if (!parseAddress(m, args[1], &a)) return;
+            m->registers.pc = a;
+        }
+        m->stop = STOP_NONE;
+        mon->running = true;
+    } else if (!strcmp(cmd, "x")) {
+        mon->running = false;
+        showState(m);
+    } else if (!strcmp(cmd, "s")) {
+        mon->running = false;
+        b = argc > 1 ? strtoul(args[1], NULL, 0) : 1;
+        while (b-- && !(mon->limit && m->instructions >= mon->limit)) cpuStep(m);
+        showState(m);
+    } else if (!strcmp(cmd, "b")) {
+        if (argc < 2 || !parseAddress(m, args[1], &a)) return;
+        bool on = !testAddress(m->breakpoints, a);
+        setBreakpoint(m, a, on);
+        printf("Breakpoint at $%04lX %s\n", a, on ? "set" : "removed");
+    } else if (!strcmp(cmd, "t")) {
+        bool on = !(atomic_load(&m->events) & EVENT_TRACE);
+        if (on) raiseEvents(m, EVENT_TRACE);
+        else clearEvents(m, EVENT_TRACE);
+        printf("Tracing %s\n", on ? "on" : "off");
+    } else if (!strcmp(cmd, "ss")) {
+        if (argc < 2) {
+            puts("Expected a file name");
+            return;
+        }
+        saveSnapshot(m, args[1]);
+    } else if (!strcmp(cmd, "q")) {
+        mon->quit = true;
+    } else {
+        showHelp();
+    }
+}
+
+/* Takes the command out of the mailbox and carries it out, on the CPU thread */
+static void serviceMailbox(struct monitor* mon) {
+    clearEvents(mon->m, EVENT_MONITOR);
+    pthread_mutex_lock(&mon->lock);
+    if (mon->full) {
+        runCommand(mon, mon->command);
+        fflush(stdout);
+        mon->full = false;
+        pthread_cond_broadcast(&mon->cond);
+    }
+    pthread_mutex_unlock(&mon->lock);
+}
+
+static void* monitorThread(void* arg) {
+    struct monitor* mon = arg;
+    char line[sizeof(mon->command)];
+    bool quit = false;
+    while (!quit) {
+        fputs(". ", stdout);
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) strcpy(line, "q");
+        pthread_mutex_lock(&mon->lock);
+        strcpy(mon->command, line);
+        mon->full = true;
+        raiseEvents(mon->m, EVENT_MONITOR);
+        pthread_cond_broadcast(&mon->cond);
+        while (mon->full) pthread_cond_wait(&mon->cond, &mon->lock);
+        quit = mon->quit;
+        pthread_mutex_unlock(&mon->lock);
+    }
+    return NULL;
+}
+
+/* Runs the machine with the monitor on stdin until it is quit, starting stopped or running. Running stops after
+ * limit instructions (0 for no limit) */
+void monitorRun(struct machine* m, uint64_t limit, bool stopped) {
+    static struct monitor mon;
+    mon.m = m;
+    mon.limit = limit;
+    mon.running = !stopped;
+    pthread_mutex_init(&mon.lock, NULL);
+    pthread_cond_init(&mon.cond, NULL);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, monitorThread, &mon)) {
+        fputs("Failed to start the monitor thread\n", stderr);
+        return;
+    }
+    m->stop = STOP_NONE;
+    while (!mon.quit) {
+        if (!mon.running) {
+            pthread_mutex_lock(&mon.lock);
+            while (!mon.full) pthread_cond_wait(&mon.cond, &mon.lock);
+            pthread_mutex_unlock(&mon.lock);
+            serviceMailbox(&mon);
+            continue;
+        }
+        if (cpuStep(m) && m->stop == STOP_MONITOR) {
+            m->stop = STOP_NONE;
+            serviceMailbox(&mon);
+        } else if (m->stop != STOP_NONE || (limit && m->instructions >= limit)) {
+            mon.running = false;
+            if (m->stop == STOP_BREAKPOINT) printf("\nBreakpoint at $%04X\n", m->stopaddr);
+            else if (m->stop == STOP_WATCHPOINT) printf("\nWatchpoint at $%04X\n", m->stopaddr);
+            else printf("\nStopped after %" PRIu64 " instructions\n", m->instructions);
+            showState(m);
+            fflush(stdout);
+            m->stop = STOP_NONE;
+        }
+    }
+    pthread_join(tid, NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef POPPY_MONITOR_H
+#define POPPY_MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+void monitorRun(struct machine* m, uint64_t limit, bool stopped);
+
+#endif
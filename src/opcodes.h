@@ -0,0 +1,1165 @@
+/* Instruction set */
+/* Included by cpu.c for the fast core, with CORE_STEP set to the name of the function to define and CORE_ACCURATE
+ * set to the accurate parameter for the bus functions. The accurate core is the cycle-stepped sequencer.c, which
+ * has to make the same bus accesses in the same order as these. With CORE_OPCODE defined the function takes the
+ * opcode as a parameter instead, for recompiled code where it is a constant and all but its case folds away. Dummy
+ * reads that only happen on a page crossing or a taken branch are penaltyRead, recompiled blocks count those apart */
+/* Timing references: https://www.nesdev.org/6502_cpu.txt, https://www.masswerk.at/6502/6502_instruction_set.html */
+
+#define readByte(m, addr) busRead(m, addr, CORE_ACCURATE)
+#define writeByte(m, addr, value) busWrite(m, addr, value, CORE_ACCURATE)
+#define dummyRead(m, addr) busDummyRead(m, addr, CORE_ACCURATE)
+#define penaltyRead(m, addr) busPenaltyRead(m, addr, CORE_ACCURATE)
+#define readCode(m, addr) busReadCode(m, addr, CORE_ACCURATE)
+#define fetchByte(m) busFetchByte(m, CORE_ACCURATE)
+#define fetchWord(m) busFetchWord(m, CORE_ACCURATE)
+#define waitForCycles(m, n) busCycles(m, n, CORE_ACCURATE)
+#define ucodePush(m, value) busPush(m, value, CORE_ACCURATE)
+#define ucodePop(m) busPop(m, CORE_ACCURATE)
+
+#ifdef CORE_OPCODE
+static inline __attribute__((always_inline)) void CORE_STEP(struct machine* m, uint8_t opcode) {
+#else
+static void CORE_STEP(struct machine* m) {
+#endif
+    #if VERBOSE == 1
+        printf("X  --  $%04X: ", m->registers.pc);
+        #define VERBOSE_PREFIX ""
+    #elif VERBOSE > 1
+        #define VERBOSE_PREFIX "X  --  "
+    #endif
+    #ifdef CORE_OPCODE
+    fetchByte(m);
+    uint8_t ins1 = opcode;
+    #else
+    uint8_t ins1 = fetchByte(m);
+    #endif
+
+    switch (ins1) {
+        /* TRANSFER */
+        case 0xA9: { /* LOAD ACCUMULATOR, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA #$%02X\n", ins2);
+            #endif
+            m->registers.a = ins2;
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xA5: { /* LOAD ACCUMULATOR, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA $%02X\n", ins2);
+            #endif
+            m->registers.a = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xB5: { /* LOAD ACCUMULATOR, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            m->registers.a = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xAD: { /* LOAD ACCUMULATOR, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA $%04X\n", ins23);
+            #endif
+            m->registers.a = readByte(m, ins23);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xBD: { /* LOAD ACCUMULATOR, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = readByte(m, ins23x);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xB9: { /* LOAD ACCUMULATOR, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA $%04X,Y\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            if ((ins23y & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = readByte(m, ins23y);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xA1: { /* LOAD ACCUMULATOR, (INDIRECT,X) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA ($%02X,X)\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            m->registers.a = readByte(m, addr);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xB1: { /* LOAD ACCUMULATOR, (INDIRECT),Y */
+            uint8_t ins2 = readCode(m, m->registers.pc);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDA ($%02X),Y\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            uint16_t addry = addr + m->registers.y;
+            if ((addry & 0xFF00) != (addr & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = readByte(m, addry);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0xA2: { /* LOAD X REGISTER, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDX #$%02X\n", ins2);
+            #endif
+            m->registers.x = ins2;
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xA6: { /* LOAD X REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDX $%02X\n", ins2);
+            #endif
+            m->registers.x = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xB6: { /* LOAD X REGISTER, ZEROPAGE,Y */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDX $%02X,Y\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.y;
+            m->registers.x = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xAE: { /* LOAD X REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDX $%04X\n", ins23);
+            #endif
+            m->registers.x = readByte(m, ins23);
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xBE: { /* LOAD X REGISTER, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDX $%04X,Y\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            if ((ins23y & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.x = readByte(m, ins23y);
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xA0: { /* LOAD Y REGISTER, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDY #$%02X\n", ins2);
+            #endif
+            m->registers.y = ins2;
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xA4: { /* LOAD Y REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDY $%02X\n", ins2);
+            #endif
+            m->registers.y = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xB4: { /* LOAD Y REGISTER, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDY $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            m->registers.y = readByte(m, ins2);
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xAC: { /* LOAD Y REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDY $%04X\n", ins23);
+            #endif
+            m->registers.y = readByte(m, ins23);
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xBC: { /* LOAD Y REGISTER, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "LDY $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.y = readByte(m, ins23x);
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0x85: { /* STORE ACCUMULATOR, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA $%02X\n", ins2);
+            #endif
+            writeByte(m, ins2, m->registers.a);
+        } break;
+        case 0x95: { /* STORE ACCUMULATOR, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            writeByte(m, ins2, m->registers.a);
+        } break;
+        case 0x8D: { /* STORE ACCUMULATOR, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA $%04X\n", ins23);
+            #endif
+            writeByte(m, ins23, m->registers.a);
+        } break;
+        case 0x9D: { /* STORE ACCUMULATOR, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            dummyRead(m, m->registers.pc++);
+            writeByte(m, ins23x, m->registers.a);
+        } break;
+        case 0x99: { /* STORE ACCUMULATOR, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            dummyRead(m, m->registers.pc++);
+            writeByte(m, ins23y, m->registers.a);
+        } break;
+        case 0x81: { /* STORE ACCUMULATOR, (INDIRECT,X) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA ($%02X,X)\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            writeByte(m, addr, m->registers.a);
+        } break;
+        case 0x91: { /* STORE ACCUMULATOR, (INDIRECT),Y */
+            uint8_t ins2 = readCode(m, m->registers.pc);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STA ($%02X),Y\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            uint16_t addry = addr + m->registers.y;
+            dummyRead(m, m->registers.pc++);
+            writeByte(m, addry, m->registers.a);
+        } break;
+        case 0x86: { /* STORE X REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STX $%02X\n", ins2);
+            #endif
+            writeByte(m, ins2, m->registers.x);
+        } break;
+        case 0x96: { /* STORE X REGISTER, ZEROPAGE,Y */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STX $%02X,Y\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.y;
+            writeByte(m, ins2, m->registers.x);
+        } break;
+        case 0x8E: { /* STORE X REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STX $%04X\n", ins23);
+            #endif
+            writeByte(m, ins23, m->registers.x);
+        } break;
+        case 0x84: { /* STORE Y REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STY $%02X\n", ins2);
+            #endif
+            writeByte(m, ins2, m->registers.y);
+        } break;
+        case 0x94: { /* STORE Y REGISTER, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STY $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            writeByte(m, ins2, m->registers.y);
+        } break;
+        case 0x8C: { /* STORE Y REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "STY $%04X\n", ins23);
+            #endif
+            writeByte(m, ins23, m->registers.y);
+        } break;
+        case 0xAA: { /* TRANSFER ACCUMULATOR TO X REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TAX");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.x = m->registers.a;
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xA8: { /* TRANSFER ACCUMULATOR TO Y REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TAY");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.y = m->registers.a;
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xBA: { /* TRANSFER STACK POINTER TO X REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TSX");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.x = m->registers.sp;
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0x8A: { /* TRANSFER X REGISTER TO ACCUMULATOR, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TXA");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.a = m->registers.x;
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0x9A: { /* TRANSFER X REGISTER TO STACK POINTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TXS");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.sp = m->registers.x;
+        } break;
+        case 0x98: { /* TRANSFER Y REGISTER TO ACCUMULATOR, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "TYA");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.a = m->registers.y;
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+
+        /* STACK */
+        case 0x48: { /* PUSH ACCUMULATOR, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "PHA");
+            #endif
+            dummyRead(m, m->registers.pc);
+            ucodePush(m, m->registers.a);
+        } break;
+        case 0x08: { /* PUSH STATUS FLAGS, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "PHP");
+            #endif
+            dummyRead(m, m->registers.pc);
+            ucodePush(m, m->registers.p | FLAG_BREAK | FLAG_ONE);
+        } break;
+        case 0x68: { /* POP ACCUMULATOR, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "PLA");
+            #endif
+            dummyRead(m, m->registers.pc);
+            dummyRead(m, 0x0100 | m->registers.sp);
+            m->registers.a = ucodePop(m);
+            ucodeSetZNFlags(m->registers.a, &m->registers.p);
+        } break;
+        case 0x28: { /* POP STATUS FLAGS, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "PLP");
+            #endif
+            dummyRead(m, m->registers.pc);
+            dummyRead(m, 0x0100 | m->registers.sp);
+            m->registers.p = ucodePop(m);
+        } break;
+
+        /* INC & DEC */
+        case 0xE6: { /* INCREMENT MEMORY, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "INC $%02X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            uint8_t value = readByte(m, ins2);
+            ++value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins2, value);
+        } break;
+        case 0xF6: { /* INCREMENT MEMORY, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "INC $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint8_t value = readByte(m, ins2);
+            ++value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins2, value);
+        } break;
+        case 0xEE: { /* INCREMENT MEMORY, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "INC $%04X\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            uint8_t value = readByte(m, ins23);
+            ++value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins23, value);
+        } break;
+        case 0xFE: { /* INCREMENT MEMORY, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "INC $%04X,X\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            uint8_t value = readByte(m, ins23x);
+            ++value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins23x, value);
+        } break;
+        case 0xE8: { /* INCREMENT X REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "INX");
+            #endif
+            dummyRead(m, m->registers.pc);
+            ++m->registers.x;
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0xC8: { /* INCREMENT Y REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "INY");
+            #endif
+            dummyRead(m, m->registers.pc);
+            ++m->registers.y;
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+        case 0xC6: { /* DECREMENT MEMORY, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "DEC $%02X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            uint8_t value = readByte(m, ins2);
+            --value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins2, value);
+        } break;
+        case 0xD6: { /* DECREMENT MEMORY, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "DEC $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint8_t value = readByte(m, ins2);
+            --value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins2, value);
+        } break;
+        case 0xCE: { /* DECREMENT MEMORY, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "DEC $%04X\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            uint8_t value = readByte(m, ins23);
+            --value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins23, value);
+        } break;
+        case 0xDE: { /* DECREMENT MEMORY, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "DEC $%04X,X\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            uint8_t value = readByte(m, ins23x);
+            --value;
+            ucodeSetZNFlags(value, &m->registers.p);
+            writeByte(m, ins23x, value);
+        } break;
+        case 0xCA: { /* DECREMENT X REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "DEX");
+            #endif
+            dummyRead(m, m->registers.pc);
+            --m->registers.x;
+            ucodeSetZNFlags(m->registers.x, &m->registers.p);
+        } break;
+        case 0x88: { /* DECREMENT Y REGISTER, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "DEY");
+            #endif
+            dummyRead(m, m->registers.pc);
+            --m->registers.y;
+            ucodeSetZNFlags(m->registers.y, &m->registers.p);
+        } break;
+
+        /* ARITHMETIC */
+        case 0x69: { /* ADD WITH CARRY TO ACCUMULATOR, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC #$%02X\n", ins2);
+            #endif
+            m->registers.a = ucodeAddWithCarry(m->registers.a, ins2, &m->registers.p);
+        } break;
+        case 0x65: { /* ADD WITH CARRY TO ACCUMULATOR, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC $%02X\n", ins2);
+            #endif
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0x75: { /* ADD WITH CARRY TO ACCUMULATOR, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0x6D: { /* ADD WITH CARRY TO ACCUMULATOR, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC $%04X\n", ins23);
+            #endif
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, ins23), &m->registers.p);
+        } break;
+        case 0x7D: { /* ADD WITH CARRY TO ACCUMULATOR, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, ins23x), &m->registers.p);
+        } break;
+        case 0x79: { /* ADD WITH CARRY TO ACCUMULATOR, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC $%04X,Y\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            if ((ins23y & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, ins23y), &m->registers.p);
+        } break;
+        case 0x61: { /* ADD WITH CARRY TO ACCUMULATOR, (INDIRECT,X) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC ($%02X,X)\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+        case 0x71: { /* ADD WITH CARRY TO ACCUMULATOR, (INDIRECT),Y */
+            uint8_t ins2 = readCode(m, m->registers.pc);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC ($%02X),Y\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            uint16_t addry = addr + m->registers.y;
+            if ((addry & 0xFF00) != (addr & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, addry), &m->registers.p);
+        } break;
+        case 0x72: { /* ADD WITH CARRY TO ACCUMULATOR, (ZEROPAGE) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC ($%02X)\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            m->registers.a = ucodeAddWithCarry(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+        case 0xE9: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC #$%02X\n", ins2);
+            #endif
+            m->registers.a = ucodeSubWithCarry(m->registers.a, ins2, &m->registers.p);
+        } break;
+        case 0xE5: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC $%02X\n", ins2);
+            #endif
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xF5: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xED: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC $%04X\n", ins23);
+            #endif
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, ins23), &m->registers.p);
+        } break;
+        case 0xFD: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, ins23x), &m->registers.p);
+        } break;
+        case 0xF9: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC $%04X,Y\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            if ((ins23y & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, ins23y), &m->registers.p);
+        } break;
+        case 0xE1: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, (INDIRECT,X) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC ($%02X,X)\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+        case 0xF1: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, (INDIRECT),Y */
+            uint8_t ins2 = readCode(m, m->registers.pc);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "SBC ($%02X),Y\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            uint16_t addry = addr + m->registers.y;
+            if ((addry & 0xFF00) != (addr & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, addry), &m->registers.p);
+        } break;
+        case 0xF2: { /* SUBTRACT WITH BORROW FROM ACCUMULATOR, (ZEROPAGE) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ADC ($%02X)\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            m->registers.a = ucodeSubWithCarry(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+
+        /* LOGIC */
+
+        /* SHIFT & ROTATE */
+
+        /* FLAG */
+        case 0x18: { /* CLEAR CARRY FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "CLC");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p &= ~FLAG_CARRY;
+        } break;
+        case 0xD8: { /* CLEAR DECIMAL MODE FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "CLD");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p &= ~FLAG_DECIMAL;
+        } break;
+        case 0x58: { /* CLEAR INTERRUPT DISABLE FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "CLI");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p &= ~FLAG_IRQDISABLE;
+        } break;
+        case 0xB8: { /* CLEAR OVERFLOW FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "CLV");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p &= ~FLAG_OVERFLOW;
+        } break;
+        case 0x38: { /* SET CARRY FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "SEC");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p |= FLAG_CARRY;
+        } break;
+        case 0xF8: { /* SET DECIMAL MODE FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "SED");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p |= FLAG_DECIMAL;
+        } break;
+        case 0x78: { /* SET INTERRUPT DISABLE FLAG, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "SEI");
+            #endif
+            dummyRead(m, m->registers.pc);
+            m->registers.p |= FLAG_IRQDISABLE;
+        } break;
+
+        /* COMPARISONS */
+        case 0xC9: { /* COMPARE ACCUMULATOR, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP #$%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.a, ins2, &m->registers.p);
+        } break;
+        case 0xC5: { /* COMPARE ACCUMULATOR, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP $%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xD5: { /* COMPARE ACCUMULATOR, ZEROPAGE,X */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP $%02X,X\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            ucodeCompare(m->registers.a, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xCD: { /* COMPARE ACCUMULATOR, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP $%04X\n", ins23);
+            #endif
+            ucodeCompare(m->registers.a, readByte(m, ins23), &m->registers.p);
+        } break;
+        case 0xDD: { /* COMPARE ACCUMULATOR, ABSOLUTE,X */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP $%04X,X\n", ins23);
+            #endif
+            uint16_t ins23x = ins23 + m->registers.x;
+            if ((ins23x & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            ucodeCompare(m->registers.a, readByte(m, ins23x), &m->registers.p);
+        } break;
+        case 0xD9: { /* COMPARE ACCUMULATOR, ABSOLUTE,Y */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP $%04X,Y\n", ins23);
+            #endif
+            uint16_t ins23y = ins23 + m->registers.y;
+            if ((ins23y & 0xFF00) != (ins23 & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            ucodeCompare(m->registers.a, readByte(m, ins23y), &m->registers.p);
+        } break;
+        case 0xC1: { /* COMPARE ACCUMULATOR, (INDIRECT,X) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP ($%02X,X)\n", ins2);
+            #endif
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            ucodeCompare(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+        case 0xD1: { /* COMPARE ACCUMULATOR, (INDIRECT),Y */
+            uint8_t ins2 = readCode(m, m->registers.pc);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP ($%02X),Y\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            uint16_t addry = addr + m->registers.y;
+            if ((addry & 0xFF00) != (addr & 0xFF00)) penaltyRead(m, m->registers.pc);
+            ++m->registers.pc;
+            ucodeCompare(m->registers.a, readByte(m, addry), &m->registers.p);
+        } break;
+        case 0xD2: { /* COMPARE ACCUMULATOR, (ZEROPAGE) */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CMP ($%02X)\n", ins2);
+            #endif
+            uint16_t addr = readByte(m, ins2++);
+            addr |= (uint16_t)readByte(m, ins2) << 8;
+            ucodeCompare(m->registers.a, readByte(m, addr), &m->registers.p);
+        } break;
+        case 0xE0: { /* COMPARE X REGISTER, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPX #$%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.x, ins2, &m->registers.p);
+        } break;
+        case 0xE4: { /* COMPARE X REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPX $%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.x, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xEC: { /* COMPARE X REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPX $%04X\n", ins23);
+            #endif
+            ucodeCompare(m->registers.x, readByte(m, ins23), &m->registers.p);
+        } break;
+        case 0xC0: { /* COMPARE Y REGISTER, IMMEDIATE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPY #$%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.y, ins2, &m->registers.p);
+        } break;
+        case 0xC4: { /* COMPARE Y REGISTER, ZEROPAGE */
+            uint8_t ins2 = fetchByte(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPY $%02X\n", ins2);
+            #endif
+            ucodeCompare(m->registers.y, readByte(m, ins2), &m->registers.p);
+        } break;
+        case 0xCC: { /* COMPARE Y REGISTER, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "CPY $%04X\n", ins23);
+            #endif
+            ucodeCompare(m->registers.y, readByte(m, ins23), &m->registers.p);
+        } break;
+
+        /* BRANCH */
+        /* Taken branches read the next opcode again while they add the offset, and once more if the target is in
+         * another page */
+        case 0x10: { /* BRANCH ON RESULT PLUS, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BPL $%04X\n", addr);
+            #endif
+            if (!(m->registers.p & FLAG_NEGATIVE)) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0x30: { /* BRANCH ON RESULT MINUS, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BMI $%04X\n", addr);
+            #endif
+            if (m->registers.p & FLAG_NEGATIVE) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0x50: { /* BRANCH ON OVERFLOW CLEAR, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BVC $%04X\n", addr);
+            #endif
+            if (!(m->registers.p & FLAG_OVERFLOW)) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0x70: { /* BRANCH ON OVERFLOW SET, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BVS $%04X\n", addr);
+            #endif
+            if (m->registers.p & FLAG_OVERFLOW) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0x90: { /* BRANCH ON CARRY CLEAR, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BCC $%04X\n", addr);
+            #endif
+            if (!(m->registers.p & FLAG_CARRY)) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0xB0: { /* BRANCH ON CARRY SET, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BCS $%04X\n", addr);
+            #endif
+            if (m->registers.p & FLAG_CARRY) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0xD0: { /* BRANCH ON RESULT NOT ZERO, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BNE $%04X\n", addr);
+            #endif
+            if (!(m->registers.p & FLAG_ZERO)) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0xF0: { /* BRANCH ON RESULT ZERO, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BEQ $%04X\n", addr);
+            #endif
+            if (m->registers.p & FLAG_ZERO) {
+                penaltyRead(m, m->registers.pc);
+                if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+                if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+                m->registers.pc = addr;
+            }
+        } break;
+        case 0x80: { /* BRANCH ALWAYS, RELATIVE */
+            int8_t ins2 = fetchByte(m);
+            uint16_t addr = m->registers.pc + ins2;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "BRA $%04X\n", addr);
+            #endif
+            dummyRead(m, m->registers.pc);
+            if ((addr & 0xFF00) != (m->registers.pc & 0xFF00)) penaltyRead(m, m->registers.pc);
+            if (addr == (uint16_t)(m->registers.pc - 2)) m->selfloop = true; /* branch to itself */
+            m->registers.pc = addr;
+        } break;
+
+        /* JUMPS */
+        case 0x4C: { /* JUMP, ABSOLUTE */
+            uint16_t ins23 = fetchWord(m);
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "JMP $%04X\n", ins23);
+            #endif
+            if (ins23 == (uint16_t)(m->registers.pc - 3)) m->selfloop = true; /* JMP * */
+            m->registers.pc = ins23;
+        } break;
+        case 0x6C: { /* JUMP, (ABSOLUTE) */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "JMP ($%04X)\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            uint16_t addr = readByte(m, ins23++);
+            addr |= (uint16_t)readByte(m, ins23) << 8;
+            m->registers.pc = addr;
+        } break;
+        case 0x7C: { /* JUMP, (ABSOLUTE,X) */
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "JMP ($%04X,X)\n", ins23);
+            #endif
+            dummyRead(m, ins23);
+            ins23 += m->registers.x;
+            uint16_t addr = readByte(m, ins23++);
+            addr |= (uint16_t)readByte(m, ins23) << 8;
+            m->registers.pc = addr;
+        } break;
+        case 0x20: { /* JUMP SAVING RETURN, ABSOLUTE */
+            uint16_t ins23 = fetchByte(m);
+            dummyRead(m, 0x0100 | m->registers.sp);
+            ucodePush(m, m->registers.pc >> 8);
+            ucodePush(m, m->registers.pc);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "JSR $%04X\n", ins23);
+            #endif
+            m->registers.pc = ins23;
+        } break;
+        case 0x60: { /* RETURN FROM SUBROUTINE, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "RTS");
+            #endif
+            dummyRead(m, m->registers.pc);
+            dummyRead(m, 0x0100 | m->registers.sp);
+            m->registers.pc = ucodePop(m);
+            m->registers.pc |= (uint16_t)ucodePop(m) << 8;
+            dummyRead(m, m->registers.pc++);
+        } break;
+
+        /* INTERRUPTS */
+        case 0x00: { /* BREAK, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "BRK");
+            #endif
+            dummyRead(m, m->registers.pc++);
+            ucodePush(m, m->registers.pc >> 8);
+            ucodePush(m, m->registers.pc);
+            ucodePush(m, m->registers.p | FLAG_BREAK | FLAG_ONE);
+            m->registers.pc = readByte(m, 0xFFFE);
+            m->registers.pc |= (uint16_t)readByte(m, 0xFFFF) << 8;
+        } break;
+        case 0x40: { /* RETURN FROM INTERRUPT, IMPLIED */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "RTI");
+            #endif
+            dummyRead(m, m->registers.pc);
+            dummyRead(m, 0x0100 | m->registers.sp);
+            m->registers.p = ucodePop(m);
+            m->registers.pc = ucodePop(m);
+            m->registers.pc |= (uint16_t)ucodePop(m) << 8;
+        } break;
+
+        /* OTHER */
+        case 0xEA: { /* NO OPERATION */
+            #if VERBOSE
+            puts(VERBOSE_PREFIX "NOP");
+            #endif
+            dummyRead(m, m->registers.pc);
+        } break;
+
+        /* ILLEGAL */
+        default: { /* 1 BYTE, 1 CYCLE */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (1 byte 1 cycle NOP)\n", ins1);
+            #endif
+        } break;
+        case 0x02:
+        case 0x22:
+        case 0x42:
+        case 0x62:
+        case 0x82:
+        case 0xC2:
+        case 0xE2: { /* 2 BYTES, 2 CYCLES */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (2 byte 2 cycle NOP)\n", ins1);
+            #endif
+            dummyRead(m, m->registers.pc++);
+        } break;
+        case 0x44: { /* 2 BYTES, 3 CYCLES */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (2 byte 3 cycle NOP)\n", ins1);
+            #endif
+            uint8_t ins2 = fetchByte(m);
+            dummyRead(m, ins2);
+        } break;
+        case 0x54:
+        case 0xD4:
+        case 0xF4: { /* 2 BYTES, 4 CYCLES */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (2 byte 4 cycle NOP)\n", ins1);
+            #endif
+            uint8_t ins2 = fetchByte(m);
+            dummyRead(m, ins2);
+            ins2 += m->registers.x;
+            dummyRead(m, ins2);
+        } break;
+        case 0xDC:
+        case 0xFC: { /* 3 BYTES, 4 CYCLES */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (3 byte 4 cycle NOP)\n", ins1);
+            #endif
+            uint16_t ins23 = fetchByte(m);
+            ins23 |= (uint16_t)readCode(m, m->registers.pc) << 8;
+            uint16_t ins23x = ins23 + m->registers.x;
+            ++m->registers.pc;
+            dummyRead(m, ins23x);
+        } break;
+        case 0x5C: { /* 3 BYTES, 8 CYCLES */
+            #if VERBOSE
+            printf(VERBOSE_PREFIX "ILLEGAL 0x%02X (3 byte 8 cycle NOP)\n", ins1);
+            #endif
+            dummyRead(m, m->registers.pc++);
+            dummyRead(m, m->registers.pc++);
+            waitForCycles(m, 5);
+        } break;
+    }
+}
+
+#undef readByte
+#undef writeByte
+#undef dummyRead
+#undef penaltyRead
+#undef readCode
+#undef fetchByte
+#undef fetchWord
+#undef waitForCycles
+#undef ucodePush
+#undef ucodePop
@@ -0,0 +1,21 @@
+#ifndef POPPY_OPTIONS_H
+#define POPPY_OPTIONS_H
+
+#ifdef NDEBUG
+    /* Disable verbose and stepping mode by default in release */
+    #define VERBOSE 0
+    #define STEP 0
+    #define WAIT_AT_BEGIN 0
+#else
+    #define VERBOSE 3 /* 0-3 for amount of info */
+    #define STEP 0 /* 1 to enable stepping mode, 0 to disable */
+    #define WAIT_AT_BEGIN 1 /* 1 to wait at the beginning, 0 to immediately start */
+    #define CLOCK_SPEED 4 /* override for debugging */
+#endif
+
+/* Timing */
+#ifndef CLOCK_SPEED
+    #define CLOCK_SPEED 4000000 /* 4 MHz */
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#include "plugin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "poppydevice.h"
+#include "bus.h"
+
+/* Device plugins */
+/* A plugin claims pages by putting its own handlers into devices, so its accesses cost the same single call as any
+ * other external device's. Every plugin has its own bit of extirq and schedules its events with the device timers,
+ * which the devices catch up to like the VIA */
+
+struct poppydevicehost {
+    struct machine* m;
+    unsigned index; /* in plugins */
+};
+
+static bool hostClaim(struct poppydevicehost* host, uint16_t first, uint16_t last,
+    uint8_t (*read)(void* ctx, uint16_t addr), void (*write)(void* ctx, uint16_t addr, uint8_t value), void* ctx) {
+    struct machine* m = host->m;
+    if (first < 0x8000 || last > 0xBFFF || first > last) return false;
+    for (unsigned page = first >> 8; page <= (unsigned)last >> 8; ++page) {
+        if (m->devices[page].read || m->devices[page].write) return false;
+    }
+    for (unsigned page = first >> 8; page <= (unsigned)last >> 8; ++page) {
+        m->devices[page] = (struct pagedevice){.read = read, .write = write, .ctx = ctx};
+    }
+    return true;
+}
+
+static void hostSetIRQ(struct poppydevicehost* host, bool level) {
+    struct machine* m = host->m;
+    uint32_t bit = 1U << (host->index + 1);
+    m->extirq = level ? m->extirq | bit : m->extirq & ~bit;
+    updateIRQ(m);
+}
+
+static bool hostSchedule(struct poppydevicehost* host, uint64_t cycle, void (*fn)(void* ctx, uint64_t cycle),
+    void* ctx) {
+    return setTimer(host->m, cycle, fn, ctx);
+}
+
+static uint64_t hostCycles(const struct poppydevicehost* host) {
+    return host->m->cycles;
+}
+
+static const struct poppydeviceapi api = {
+    .version = POPPY_DEVICE_VERSION,
+    .claim = hostClaim,
+    .setIRQ = hostSetIRQ,
+    .schedule = hostSchedule,
+    .cycles = hostCycles
+};
+
+/* Loads the plugin in file and lets it set itself up with args */
+bool loadPlugin(struct machine* m, const char* file, const char* args) {
+    if (m->plugincount == MAX_PLUGINS) {
+        fprintf(stderr, "Too many plugins, at most %d can be loaded\n", MAX_PLUGINS);
+        return false;
+    }
+    void* module = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+    if (!module) {
+        fprintf(stderr, "Failed to load '%s': %s\n", file, dlerror());
+        return false;
+    }
+    poppydeviceinit init = (poppydeviceinit)dlsym(module, "poppyDeviceInit");
+    if (!init) {
+        fprintf(stderr, "'%s' is not a device plugin\n", file);
+        dlclose(module);
+        return false;
+    }
+    struct poppydevicehost* host = malloc(sizeof(*host));
+    if (!host) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    *host = (struct poppydevicehost){.m = m, .index = m->plugincount};
+    struct poppydevice device = {0};
+    if (!init(host, &api, args ? args : "", &device)) {
+        fprintf(stderr, "Failed to set up the device in '%s'\n", file);
+        free(host);
+        dlclose(module);
+        return false;
+    }
+    m->plugins[m->plugincount++] = (struct plugin){
+        .module = module, .host = host, .ctx = device.ctx, .reset = device.reset, .save = device.save,
+        .load = device.load, .destroy = device.destroy
+    };
+    return true;
+}
+
+/* Unloads the plugins of a machine that is going away */
+void unloadPlugins(struct machine* m) {
+    while (m->plugincount) {
+        struct plugin* plugin = &m->plugins[--m->plugincount];
+        if (plugin->destroy) plugin->destroy(plugin->ctx);
+        free(plugin->host);
+        dlclose(plugin->module);
+    }
+}
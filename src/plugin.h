@@ -0,0 +1,12 @@
+#ifndef POPPY_PLUGIN_H
+#define POPPY_PLUGIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+bool loadPlugin(struct machine* m, const char* file, const char* args);
+void unloadPlugins(struct machine* m);
+
+#endif
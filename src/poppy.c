@@ -0,0 +1,254 @@
+#include "poppy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "machine.h"
+#include "cpu.h"
+#include "bus.h"
+#include "breakpoints.h"
+#include "hle.h"
+#include "plugin.h"
+#include "config.h"
+#include "recompile.h"
+#include "time.h"
+
+/* libpoppy */
+/* A thin layer over the machine, running goes straight to cpuStep like the emulator's own loop so embedding costs
+ * nothing per instruction */
+
+/* Calls a poppyhook from a machine hook */
+struct hookadapter {
+    struct poppy* p;
+    uint16_t addr;
+    poppyhook fn; /* NULL for unused slots */
+    void* ctx;
+};
+
+struct poppy {
+    struct machine machine;
+    struct hookadapter hooks[MAX_HOOKS];
+};
+
+/* A powered on machine with empty ROMs, seed picks the random contents of RAM */
+struct poppy* poppyCreate(uint64_t seed) {
+    struct poppy* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    getTime(&p->machine.targettime);
+    initMachine(&p->machine, seed);
+    resetMachine(&p->machine);
+    return p;
+}
+void poppyDestroy(struct poppy* p) {
+    sdcardClose(&p->machine.sdcard);
+    hostioInit(&p->machine.hostio, NULL, 0);
+    unloadPlugins(&p->machine);
+    free(p);
+}
+
+/* Copies up to 8K into ROM0 or ROM1, poppyReset picks up a new RESET vector */
+bool poppyLoadROM(struct poppy* p, unsigned rom, const void* data, size_t size) {
+    if (rom > 1) return false;
+    memcpy(rom ? p->machine.rom1 : p->machine.rom0, data, size < 8192 ? size : 8192);
+    p->machine.romcode = ROMCODE_UNCHECKED;
+    return true;
+}
+bool poppyLoadROMFile(struct poppy* p, unsigned rom, const char* file) {
+    return rom <= 1 && loadROM(&p->machine, file, rom);
+}
+bool poppyLoadBinary(struct poppy* p, const char* file, uint16_t addr) {
+    return loadBinary(&p->machine, file, addr);
+}
+
+/* Replaces the Odin32K's memory map with the machine description in file (see the emulator's -M) and loads the ROMs
+ * and plugins it names, poppyReset picks up a new RESET vector */
+bool poppyLoadConfig(struct poppy* p, const char* file) {
+    return loadConfig(&p->machine, file);
+}
+
+void poppyReset(struct poppy* p) {
+    resetMachine(&p->machine);
+}
+
+/* Run unthrottled instead of at the real clock speed */
+void poppySetFastMode(struct poppy* p, bool fast) {
+    p->machine.fastmode = fast;
+    getTime(&p->machine.targettime);
+    p->machine.pacedcycles = p->machine.cycles;
+}
+
+/* Runs the ROM code from a translation cache in dir, compiled there on the first use for the loaded ROMs and
+ * this build of the library. Call it after loading the ROMs, returns false if the interpreter has to run it */
+bool poppyUseTranslationCache(struct poppy* p, const char* dir) {
+    return romcacheLoad(&p->machine, dir);
+}
+
+/* Runs at least cycles cycles, finishing the last instruction, unless something stops it first */
+enum poppystop poppyRunCycles(struct poppy* p, uint64_t cycles) {
+    struct machine* m = &p->machine;
+    uint64_t end = m->cycles + cycles;
+    enum poppystop ret = POPPY_STOP_CYCLES;
+    m->stop = STOP_NONE;
+    m->selfloop = false;
+    m->runcycles = end;
+    while (m->cycles < end) {
+        if (cpuStep(m)) {
+            switch (m->stop) {
+                case STOP_BREAKPOINT:
+                    ret = POPPY_STOP_BREAKPOINT;
+                    break;
+                case STOP_WATCHPOINT:
+                    ret = POPPY_STOP_WATCHPOINT;
+                    break;
+                default:
+                    ret = POPPY_STOP_REQUEST;
+                    break;
+            }
+            break;
+        }
+        if (m->selfloop) {
+            ret = POPPY_STOP_TRAP;
+            break;
+        }
+    }
+    m->runcycles = 0;
+    m->stop = STOP_NONE;
+    return ret;
+}
+
+/* Runs a single bus cycle, returns true when that finished an instruction. Devices are stepped every cycle, so
+ * their state can be looked at between the cycles of an instruction */
+bool poppyCycle(struct poppy* p) {
+    struct machine* m = &p->machine;
+    bool stop;
+    if (!cpuCycle(m, &stop)) return false;
+    m->stop = STOP_NONE;
+    return true;
+}
+
+/* Makes poppyRunCycles return after the current instruction, can be called from device handlers and other threads */
+void poppyStop(struct poppy* p) {
+    raiseEvents(&p->machine, EVENT_STOP);
+}
+uint16_t poppyStopAddress(const struct poppy* p) {
+    return p->machine.stopaddr;
+}
+uint64_t poppyCycles(const struct poppy* p) {
+    return p->machine.cycles;
+}
+uint64_t poppyInstructions(const struct poppy* p) {
+    return p->machine.instructions;
+}
+
+void poppyGetRegisters(const struct poppy* p, struct poppyregisters* regs) {
+    const struct registers* r = &p->machine.registers;
+    *regs = (struct poppyregisters){.pc = r->pc, .sp = r->sp, .a = r->a, .x = r->x, .y = r->y, .p = r->p};
+}
+void poppySetRegisters(struct poppy* p, const struct poppyregisters* regs) {
+    p->machine.registers = (struct registers){
+        .pc = regs->pc, .sp = regs->sp, .a = regs->a, .x = regs->x, .y = regs->y, .p = regs->p
+    };
+}
+
+/* Memory without bus accesses, devices are never touched. Peeking reads $FF where there is no memory, poking
+ * returns false there */
+uint8_t poppyPeek(const struct poppy* p, uint16_t addr) {
+    return peekByte(&p->machine, addr);
+}
+bool poppyPoke(struct poppy* p, uint16_t addr, uint8_t value) {
+    return pokeByte(&p->machine, addr, value);
+}
+
+void poppySetBreakpoint(struct poppy* p, uint16_t addr, bool on) {
+    setBreakpoint(&p->machine, addr, on);
+}
+void poppySetWatchpoint(struct poppy* p, uint16_t first, uint16_t last, bool read, bool write, bool on) {
+    setWatchpoint(&p->machine, first, last, read, write, on);
+}
+
+static bool runAdapter(struct machine* m, void* ctx) {
+    (void)m;
+    struct hookadapter* adapter = ctx;
+    return adapter->fn(adapter->p, adapter->ctx);
+}
+
+/* Runs fn in place of the routine at addr and charges cycles for it, including the RTS that is simulated after it.
+ * Hooks work with poppyPeek, poppyPoke and the registers. A NULL fn takes the hook off again */
+bool poppySetHook(struct poppy* p, uint16_t addr, poppyhook fn, void* ctx, unsigned cycles) {
+    struct hookadapter* slot = NULL;
+    for (unsigned i = 0; i < MAX_HOOKS; ++i) {
+        if (p->hooks[i].fn && p->hooks[i].addr == addr) slot = &p->hooks[i];
+        else if (!slot && !p->hooks[i].fn) slot = &p->hooks[i];
+    }
+    clearHook(&p->machine, addr);
+    if (slot && slot->fn && slot->addr == addr) slot->fn = NULL;
+    if (!fn) return true;
+    if (!slot) return false;
+    *slot = (struct hookadapter){.p = p, .addr = addr, .fn = fn, .ctx = ctx};
+    return setHook(&p->machine, addr, runAdapter, slot, cycles);
+}
+
+/* Puts a device on the whole pages from first to last, which have to be in the unused $9000-$BFFF region. NULL
+ * handlers take the device off again */
+bool poppySetDevice(struct poppy* p, uint16_t first, uint16_t last, poppyread read, poppywrite write, void* ctx) {
+    if (first < 0x9000 || last > 0xBFFF || first > last) return false;
+    for (unsigned page = first >> 8; page <= (unsigned)last >> 8; ++page) {
+        p->machine.devices[page] = (struct pagedevice){.read = read, .write = write, .ctx = ctx};
+    }
+    return true;
+}
+
+/* Makes every access to the whole pages from first to last take cycles more (slow ROM or I/O), 0 takes them off.
+ * Only these pages pay for it, the rest of memory runs as fast as without any */
+void poppySetWaitStates(struct poppy* p, uint16_t first, uint16_t last, uint8_t cycles) {
+    setWaitStates(&p->machine, first, last, cycles);
+    mapWatchpoints(&p->machine);
+}
+
+/* Level of the IRQ line from external devices, it is ORed with the VIA's */
+void poppySetIRQ(struct poppy* p, bool level) {
+    p->machine.extirq = level ? p->machine.extirq | 1 : p->machine.extirq & ~1U;
+    updateIRQ(&p->machine);
+}
+/* NMI is edge triggered, it is taken before the next instruction */
+void poppyNMI(struct poppy* p) {
+    raiseEvents(&p->machine, EVENT_NMI);
+}
+
+/* Levels driven onto the input pins of VIA port A (0) or B (1), the SD card drives PB7 while there is one */
+void poppySetPortInput(struct poppy* p, unsigned port, uint8_t value) {
+    if (port) {
+        p->machine.via.pinb = value;
+        updateSDCard(&p->machine);
+    } else {
+        p->machine.via.pina = value;
+    }
+}
+/* Levels the VIA drives on the output pins of port A (0) or B (1), input pins read as 1 */
+uint8_t poppyGetPortOutput(const struct poppy* p, unsigned port) {
+    const struct via* via = &p->machine.via;
+    if (port) return (via->orb & via->ddrb) | (uint8_t)~via->ddrb;
+    return (via->ora & via->ddra) | (uint8_t)~via->ddra;
+}
+
+/* Puts an SD card with the image in file on port B (PB0 SCK, PB1 MOSI, PB2 /CS, PB7 MISO), writes go to the file.
+ * NULL takes the card out again */
+bool poppyInsertSDCard(struct poppy* p, const char* file) {
+    if (!file) {
+        sdcardClose(&p->machine.sdcard);
+        return true;
+    }
+    if (!sdcardOpen(&p->machine.sdcard, file)) return false;
+    updateSDCard(&p->machine);
+    return true;
+}
+
+/* Puts the host file I/O device on $B000-$BFFF for files in dir, every command taking cycles. NULL takes it off */
+void poppySetHostDirectory(struct poppy* p, const char* dir, unsigned cycles) {
+    hostioInit(&p->machine.hostio, dir, cycles);
+}
+
+/* Loads a device plugin (poppydevice.h) into the machine, args is passed on to it */
+bool poppyLoadDevice(struct poppy* p, const char* file, const char* args) {
+    return loadPlugin(&p->machine, file, args);
+}
@@ -0,0 +1,385 @@
+#include "recompile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "via.h"
+#include "disasm.h"
+#include "symbols.h"
+
+/* Static recompiler */
+/* Writes the ROM code reachable from the vectors as C, one function per basic block, for a binary specialized for that
+ * ROM (make ROMC=rom.c). A block runs the interpreter's own instruction code with the opcode as a constant, so the
+ * compiler drops the dispatch and cpuStep runs a whole block at a time. A block charges its cycles when it is left and
+ * only catches the devices up around instructions that may access them (see romcode.h). After every instruction it
+ * checks that PC went where the decoder said, and where one can have raised an event or a device can be due that none
+ * is pending, so whatever it did not expect leaves it at an instruction boundary. Code only reached through an indirect
+ * jump with an unknown target has no block and runs on the interpreter, labels loaded with -y are taken as entry points
+ * as well to find more of it */
+
+#define ROM_BASE 0xC000
+#define MAX_BLOCK 64 /* instructions in a block, loops that long leave it anyway */
+
+static void* grow(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    return ptr;
+}
+
+/* FNV-1a of ROM1 and ROM0 */
+uint64_t romHash(const struct machine* m) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (unsigned i = 0; i < 8192; ++i) hash = (hash ^ m->rom1[i]) * 0x100000001B3;
+    for (unsigned i = 0; i < 8192; ++i) hash = (hash ^ m->rom0[i]) * 0x100000001B3;
+    return hash;
+}
+
+/* Control flow graph */
+/* Every address control can reach other than by falling through starts a block. The walk follows both edges of
+ * branches, JMP and JSR targets, the instruction after a JSR or BRK (where RTS and RTI come back to) and JMP ($xxxx)
+ * through a pointer in ROM. RTS, RTI, STP and jumps whose target is not known until they run end a path */
+
+struct cfg {
+    uint8_t leader[0x4000];
+    uint8_t visited[0x4000]; /* instructions decoded */
+    uint16_t* work;
+    unsigned workcount;
+    unsigned workcapacity;
+};
+
+static void addLeader(struct cfg* g, unsigned addr) {
+    if (addr < ROM_BASE || addr > 0xFFFF || g->leader[addr - ROM_BASE]) return;
+    g->leader[addr - ROM_BASE] = 1;
+    if (g->workcount == g->workcapacity) {
+        g->workcapacity = g->workcapacity ? g->workcapacity * 2 : 256;
+        g->work = grow(g->work, g->workcapacity * sizeof(*g->work));
+    }
+    g->work[g->workcount++] = addr;
+}
+
+/* Instructions that do not fall through to the next one, or only do when a condition says so */
+static bool endsBlock(uint8_t opcode) {
+    if ((opcode & 0x1F) == 0x10 || opcode == 0x80 || (opcode & 0x0F) == 0x0F) return true; /* branches */
+    switch (opcode) {
+        case 0x00: /* BRK */
+        case 0x20: /* JSR */
+        case 0x40: /* RTI */
+        case 0x4C: /* JMP $xxxx */
+        case 0x60: /* RTS */
+        case 0x6C: /* JMP ($xxxx) */
+        case 0x7C: /* JMP ($xxxx,X) */
+        case 0xDB: /* STP */
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Adds the places the instruction at addr can go to other than the next instruction */
+static void addTargets(struct cfg* g, const struct machine* m, uint16_t addr) {
+    uint8_t opcode = peekByte(m, addr);
+    uint16_t abs = peekByte(m, addr + 1) | peekByte(m, addr + 2) << 8;
+    if ((opcode & 0x1F) == 0x10 || opcode == 0x80) { /* Bxx, BRA */
+        addLeader(g, (uint16_t)(addr + 2 + (int8_t)peekByte(m, addr + 1)));
+        if (opcode != 0x80) addLeader(g, addr + 2);
+    } else if ((opcode & 0x0F) == 0x0F) { /* BBRn, BBSn */
+        addLeader(g, (uint16_t)(addr + 3 + (int8_t)peekByte(m, addr + 2)));
+        addLeader(g, addr + 3);
+    } else if (opcode == 0x4C) { /* JMP $xxxx */
+        addLeader(g, abs);
+    } else if (opcode == 0x20) { /* JSR */
+        addLeader(g, abs);
+        addLeader(g, addr + 3);
+    } else if (opcode == 0x00) { /* BRK, the IRQ vector is walked on its own */
+        addLeader(g, addr + 2);
+    } else if (opcode == 0x6C && abs >= ROM_BASE && abs < 0xFFFF) { /* JMP ($xxxx) through a pointer in ROM */
+        addLeader(g, peekByte(m, abs) | peekByte(m, abs + 1) << 8);
+    }
+}
+
+static void walk(struct cfg* g, const struct machine* m) {
+    while (g->workcount) {
+        unsigned addr = g->work[--g->workcount];
+        while (addr + instructionLength(peekByte(m, addr)) <= 0x10000 && !g->visited[addr - ROM_BASE]) {
+            g->visited[addr - ROM_BASE] = 1;
+            addTargets(g, m, addr);
+            if (endsBlock(peekByte(m, addr))) break;
+            addr += instructionLength(peekByte(m, addr));
+        }
+    }
+}
+
+/* Instruction timing */
+/* The cycles and accesses of every opcode are taken from the interpreter itself by running it once on a scratch
+ * machine, so they cannot drift apart from opcodes.h. The run is set up so no page is crossed and for the branches
+ * it is done once with the flags set and once with them clear, the cheaper one is the not taken branch. The operand
+ * is $1234 and all other memory holds $56, so the page of an access tells what it went through: the operand, zero
+ * page and the stack, the vectors, or a pointer or return address only known when it runs */
+
+#define SCRATCH_PC 0x0200
+#define SCRATCH_FILL 0x56
+
+enum access {
+    ACCESS_RAM = 1, /* zero page and the stack */
+    ACCESS_VECTOR = 2, /* $FFxx in ROM */
+    ACCESS_READ = 4, /* the operand's page */
+    ACCESS_WRITE = 8,
+    ACCESS_DYNAMIC = 16 /* anywhere */
+};
+
+struct timing {
+    uint8_t cycles; /* without page crossings and taken branches */
+    uint8_t access;
+};
+
+static void measureOpcodes(struct timing timings[256]) {
+    struct machine* m = calloc(1, sizeof(*m));
+    uint8_t* mem = malloc(65536);
+    if (!m || !mem) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    mapFlat(m, mem);
+    viaReset(&m->via);
+    m->fastmode = true;
+    m->tracebus = true;
+    for (unsigned opcode = 0; opcode < 256; ++opcode) {
+        timings[opcode] = (struct timing){.cycles = 0xFF};
+        for (unsigned flags = 0; flags < 2; ++flags) {
+            memset(mem, SCRATCH_FILL, 65536);
+            mem[SCRATCH_PC] = opcode;
+            mem[SCRATCH_PC + 1] = 0x34;
+            mem[SCRATCH_PC + 2] = 0x12;
+            m->registers = (struct registers){
+                .pc = SCRATCH_PC, .sp = 0xFF, .p = FLAG_ONE | (flags ? 0xC3 : 0) /* N, V, Z and C */
+            };
+            uint64_t start = m->cycles;
+            cpuStep(m);
+            if (m->cycles - start < timings[opcode].cycles) timings[opcode].cycles = m->cycles - start;
+            for (unsigned i = 0; i < m->buslogcount && i < BUSLOG_SIZE; ++i) {
+                const struct busaccess* bus = &m->buslog[i];
+                switch (bus->addr >> 8) {
+                    case 0x00: case 0x01:
+                        timings[opcode].access |= ACCESS_RAM;
+                        break;
+                    case SCRATCH_PC >> 8:
+                        break; /* the opcode and operand, and dummy reads of them */
+                    case 0x12:
+                        timings[opcode].access |= bus->write ? ACCESS_WRITE : ACCESS_READ;
+                        break;
+                    case 0xFF:
+                        timings[opcode].access |= bus->write ? ACCESS_DYNAMIC : ACCESS_VECTOR;
+                        break;
+                    default:
+                        timings[opcode].access |= ACCESS_DYNAMIC;
+                        break;
+                }
+            }
+        }
+    }
+    free(mem);
+    free(m);
+}
+
+/* Output */
+
+/* Whether an access to page can find plain memory in the Odin32K memory map, romMatches checks the map when the
+ * blocks run */
+static bool plainPage(unsigned page, bool store) {
+    return page < 0x80 || (!store && page >= 0xC0);
+}
+
+enum step {
+    STEP_INTERNAL, /* ROM_INTERNAL */
+    STEP_MEMORY, /* ROM_STEP */
+    STEP_IO /* ROM_IO */
+};
+
+/* What the instruction at addr has to do around it, from what it accesses */
+static enum step stepKind(const struct timing* timings, const struct machine* m, uint16_t addr) {
+    uint8_t opcode = peekByte(m, addr);
+    uint8_t access = timings[opcode].access;
+    unsigned page = peekByte(m, addr + 2);
+    if (access & ACCESS_DYNAMIC) return STEP_IO;
+    if ((access & ACCESS_READ) && !(plainPage(page, false) && plainPage((page + 1) & 0xFF, false))) return STEP_IO;
+    if ((access & ACCESS_WRITE) && !(plainPage(page, true) && plainPage((page + 1) & 0xFF, true))) return STEP_IO;
+    return access ? STEP_MEMORY : STEP_INTERNAL;
+}
+
+static void writeStep(FILE* fp, const struct machine* m, const char* step, uint16_t addr, unsigned count,
+    const char* cycles) {
+    char text[128];
+    uint8_t opcode = peekByte(m, addr);
+    disassemble(m, addr, text, sizeof(text));
+    fprintf(
+        fp, "    %s(0x%02X, 0x%04X, %u, %s); /* %s */\n", step, opcode,
+        (addr + instructionLength(opcode)) & 0xFFFF, count, cycles, text
+    );
+}
+
+/* Cycles not charged yet, the fetches are the opcode and operand bytes whose wait states come on top */
+struct pending {
+    unsigned cycles;
+    unsigned fetches;
+};
+
+/* The cycles as a C expression, waits is the wait states of the block's page (ROM_BEGIN) */
+static const char* formatCycles(char* text, size_t size, struct pending cycles) {
+    if (cycles.fetches) snprintf(text, size, "%u + %u * waits", cycles.cycles, cycles.fetches);
+    else snprintf(text, size, "%u", cycles.cycles);
+    return text;
+}
+
+/* Writes the instruction at addrs[i] as a step of its kind */
+static void writeInstruction(FILE* fp, const struct timing* timings, const struct machine* m, const uint16_t* addrs,
+    unsigned i, struct pending* pending) {
+    char cycles[80], before[32], own[32];
+    uint8_t opcode = peekByte(m, addrs[i]);
+    struct pending instruction = {.cycles = timings[opcode].cycles, .fetches = instructionLength(opcode)};
+    switch (stepKind(timings, m, addrs[i])) {
+        case STEP_INTERNAL:
+        case STEP_MEMORY:
+            pending->cycles += instruction.cycles;
+            pending->fetches += instruction.fetches;
+            formatCycles(cycles, sizeof(cycles), *pending);
+            writeStep(fp, m, stepKind(timings, m, addrs[i]) == STEP_MEMORY ? "ROM_STEP" : "ROM_INTERNAL", addrs[i],
+                i + 1, cycles);
+            break;
+        case STEP_IO:
+            snprintf(
+                cycles, sizeof(cycles), "%s, %s", formatCycles(before, sizeof(before), *pending),
+                formatCycles(own, sizeof(own), instruction)
+            );
+            writeStep(fp, m, "ROM_IO", addrs[i], i + 1, cycles);
+            *pending = (struct pending){0};
+            break;
+    }
+}
+
+/* Writes the block starting at addr, returns false if there is no instruction there to make one of */
+static bool writeBlock(FILE* fp, struct cfg* g, const struct timing* timings, const struct machine* m,
+    unsigned addr) {
+    uint16_t addrs[MAX_BLOCK];
+    unsigned count = 0;
+    unsigned first = addr;
+    while (count < MAX_BLOCK) {
+        uint8_t opcode = peekByte(m, addr);
+        unsigned next = addr + instructionLength(opcode);
+        if (next > 0x10000) break;
+        /* A block is in a single page, whose wait states it charges for its fetches (ROM_BEGIN). What follows in the
+         * next page is a block of its own, and an instruction across two pages is left to the interpreter */
+        if ((next - 1) >> 8 != first >> 8) {
+            if (count) g->leader[addr - ROM_BASE] = 1;
+            else if (next <= 0xFFFF) g->leader[next - ROM_BASE] = 1;
+            break;
+        }
+        addrs[count++] = addr;
+        if (endsBlock(opcode) || next > 0xFFFF || g->leader[next - ROM_BASE]) break;
+        if (count == MAX_BLOCK) g->leader[next - ROM_BASE] = 1; /* the rest is a block of its own */
+        addr = next;
+    }
+    if (!count) return false;
+
+    char text[128];
+    if (symbolFormat(m->symbols, addrs[0], text, sizeof(text))) fprintf(fp, "/* %s */\n", text);
+    fprintf(
+        fp, "static unsigned block%04X(struct machine* m, unsigned budget) {\n    ROM_BEGIN(0x%04X, 0x%04X);\n",
+        addrs[0], addrs[0], addrs[count - 1]
+    );
+    struct pending pending = {0};
+    for (unsigned i = 0; i < count; ++i) writeInstruction(fp, timings, m, addrs, i, &pending);
+    if (pending.fetches) fprintf(fp, "    ROM_CHARGE(%s);\n", formatCycles(text, sizeof(text), pending));
+    fprintf(fp, "    return %u;\n}\n\n", count);
+    return true;
+}
+
+/* Writes the C for the ROMs in m to file */
+bool recompileROM(const struct machine* m, const char* file) {
+    static struct cfg g;
+    memset(&g, 0, sizeof(g));
+    struct timing timings[256];
+    measureOpcodes(timings);
+    addLeader(&g, m->rom0[0x1FFA] | m->rom0[0x1FFB] << 8); /* NMI */
+    addLeader(&g, m->rom0[0x1FFC] | m->rom0[0x1FFD] << 8); /* RESET */
+    addLeader(&g, m->rom0[0x1FFE] | m->rom0[0x1FFF] << 8); /* IRQ/BRK */
+    if (m->symbols) {
+        for (unsigned i = 0; i < m->symbols->count; ++i) addLeader(&g, m->symbols->list[i].addr);
+    }
+    walk(&g, m);
+    free(g.work);
+
+    FILE* fp = fopen(file, "w");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return false;
+    }
+    uint64_t hash = romHash(m);
+    fprintf(fp, "/* ROM code recompiled by PoppyEMU -R, build it in with make ROMC=%s */\n\n", file);
+    fputs("#include \"romcode.h\"\n\n", fp);
+    static uint8_t written[0x4000];
+    unsigned blocks = 0;
+    for (unsigned addr = ROM_BASE; addr <= 0xFFFF; ++addr) {
+        written[addr - ROM_BASE] = g.leader[addr - ROM_BASE] && writeBlock(fp, &g, timings, m, addr);
+        blocks += written[addr - ROM_BASE];
+    }
+    fprintf(fp, "const struct romimage romImage = {\n    .hash = 0x%016llXULL,\n", (unsigned long long)hash);
+    fputs("    .build = POPPY_BUILD,\n    .machinesize = sizeof(struct machine),\n    .blocks = {\n", fp);
+    for (unsigned addr = ROM_BASE; addr <= 0xFFFF; ++addr) {
+        if (written[addr - ROM_BASE]) fprintf(fp, "        [0x%04X] = block%04X,\n", addr - ROM_BASE, addr);
+    }
+    fputs("    }\n};\n", fp);
+    bool ok = !ferror(fp);
+    if (fclose(fp) || !ok) {
+        fprintf(stderr, "Failed to write '%s'\n", file);
+        return false;
+    }
+    printf("Recompiled %u blocks to '%s'\n", blocks, file);
+    return true;
+}
+
+/* Running */
+
+/* The blocks are only good for the ROMs they were made from, mapped where they belong, and with the devices in
+ * $8000-$BFFF where the recompiler expects them (plainPage) */
+static bool romMatches(const struct machine* m) {
+    for (unsigned page = ROM_BASE >> 8; page < 0x100; ++page) {
+        const uint8_t* mem = page >= 0xE0 ? &m->rom0[(page << 8) & 0x1FFF] : &m->rom1[(page << 8) & 0x1FFF];
+        if (m->readpages[page] != mem) return false;
+    }
+    for (unsigned page = 0; page < 0x80; ++page) {
+        unsigned region = m->memmap[page].region;
+        if (region != REGION_NONE && region != REGION_RAM && region != REGION_ROM0 && region != REGION_ROM1) {
+            return false;
+        }
+    }
+    if (romHash(m) == m->romimage->hash) return true;
+    fputs("The recompiled ROM code is for other ROMs, running on the interpreter\n", stderr);
+    return false;
+}
+
+/* Runs the block at PC, which has to be in ROM, and returns how many instructions it ran. 0 if there is no block
+ * and the interpreter has to run the instruction, which it also does while events other than breakpoints and hooks
+ * are pending */
+unsigned romStep(struct machine* m) {
+    if (m->romcode != ROMCODE_MATCH) {
+        if (m->romcode == ROMCODE_MISMATCH) return 0;
+        m->romcode = romMatches(m) ? ROMCODE_MATCH : ROMCODE_MISMATCH;
+        if (m->romcode == ROMCODE_MISMATCH) return 0;
+    }
+    if (m->tracebus) return 0; /* bus logs and fingerprints are per instruction */
+    syncDevices(m);
+    unsigned events = atomic_load_explicit(&m->events, memory_order_relaxed);
+    if (events & (EVENT_TRACE | ~ROM_LEVEL_EVENTS)) return 0;
+    romblock block = m->romimage->blocks[m->registers.pc - ROM_BASE];
+    if (!block) return 0;
+    /* A block is never longer than MAX_BLOCK, so only a run about to end needs a smaller budget */
+    uint64_t left = m->runinstructions ? m->runinstructions - m->instructions : MAX_BLOCK;
+    return block(m, left < MAX_BLOCK ? left : MAX_BLOCK);
+}
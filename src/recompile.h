@@ -0,0 +1,37 @@
+#ifndef POPPY_RECOMPILE_H
+#define POPPY_RECOMPILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+/* Recompiled ROM code */
+/* A block runs the instructions from its address on and returns how many it ran, at least 1 and at most budget */
+typedef unsigned (*romblock)(struct machine* m, unsigned budget);
+struct romimage {
+    uint64_t hash; /* romHash of the ROMs the blocks were made from */
+    uint64_t build; /* buildHash of the emulator a translation cache entry was made for, 0 when built in */
+    size_t machinesize; /* sizeof(struct machine) the blocks were compiled with */
+    romblock blocks[0x4000]; /* by address - $C000, NULL where there is no block */
+};
+
+/* Events that stay set while a feature is on rather than asking for something to happen now, blocks run while they
+ * are. Breakpoints and hooks are looked up for the addresses of the block when it is entered (ROM_BEGIN), a taken
+ * branch leaves the block so cpuEvents looks at its target like at any other PC, and tracing keeps romStep on the
+ * interpreter as it prints every instruction */
+#define ROM_LEVEL_EVENTS (EVENT_HOOKS | EVENT_BREAKPOINTS | EVENT_TRACE)
+
+uint64_t romHash(const struct machine* m);
+bool recompileROM(const struct machine* m, const char* file);
+unsigned romStep(struct machine* m);
+
+#ifdef POPPY_ROMC
+extern const struct romimage romImage; /* in the C written by recompileROM */
+#endif
+
+/* romcache.c */
+bool romcacheLoad(struct machine* m, const char* dir);
+
+#endif
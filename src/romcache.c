@@ -0,0 +1,277 @@
+#define _GNU_SOURCE /* environ */
+#include "recompile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#ifdef __ELF__
+    #include <unistd.h>
+    #include <dlfcn.h>
+    #include <spawn.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+#endif
+
+/* Translation cache */
+/* Recompiled ROM code compiled into a shared object once per ROM and emulator build and kept in a directory, so
+ * later runs map it in with dlopen and start on native code right away instead of on the interpreter. The sources
+ * an entry is compiled from (its own copy of the bus slow path and the devices, and the headers) are embedded in the
+ * emulator when it is built, so an entry always matches the code that loads it whatever happened to the source tree
+ * since. Entries are named after the ROM hash and a hash of the embedded sources, the recompiler and the flags, and a
+ * loaded entry is checked against both and the machine layout before it is used. A missing entry is compiled with
+ * $CC (default cc, split on whitespace, run without a shell) in a private temporary directory and renamed into place,
+ * so parallel jobs can share a directory. Embedding the sources takes ELF assembler directives, on other hosts
+ * romcacheLoad only says it is not supported and the interpreter runs the ROM code */
+
+#ifdef __ELF__
+
+#ifndef POPPY_SRCDIR
+    #define POPPY_SRCDIR "src" /* set by the Makefile */
+#endif
+
+/* Embeds file from the source dir between symbol and symbol_end */
+#define EMBED(symbol, file) \
+    __asm__( \
+        ".pushsection .rodata\n" \
+        ".globl " #symbol "\n.hidden " #symbol "\n" #symbol ":\n" \
+        ".incbin \"" POPPY_SRCDIR "/" file "\"\n" \
+        ".globl " #symbol "_end\n.hidden " #symbol "_end\n" #symbol "_end:\n" \
+        ".popsection\n" \
+    ); \
+    extern const char symbol[], symbol##_end[]
+
+EMBED(embedded_romcode_h, "romcode.h");
+EMBED(embedded_opcodes_h, "opcodes.h");
+EMBED(embedded_ucode_h, "ucode.h");
+EMBED(embedded_recompile_h, "recompile.h");
+EMBED(embedded_bus_h, "bus.h");
+EMBED(embedded_machine_h, "machine.h");
+EMBED(embedded_options_h, "options.h");
+EMBED(embedded_time_h, "time.h");
+EMBED(embedded_via_h, "via.h");
+EMBED(embedded_sdcard_h, "sdcard.h");
+EMBED(embedded_hostio_h, "hostio.h");
+EMBED(embedded_symbols_h, "symbols.h");
+EMBED(embedded_bus_c, "bus.c");
+EMBED(embedded_via_c, "via.c");
+EMBED(embedded_sdcard_c, "sdcard.c");
+EMBED(embedded_hostio_c, "hostio.c");
+EMBED(embedded_recompile_c, "recompile.c");
+
+struct embedded {
+    const char* name; /* NULL for files that are only hashed */
+    const char* start;
+    const char* end;
+};
+static const struct embedded sources[] = {
+    {"romcode.h", embedded_romcode_h, embedded_romcode_h_end},
+    {"opcodes.h", embedded_opcodes_h, embedded_opcodes_h_end},
+    {"ucode.h", embedded_ucode_h, embedded_ucode_h_end},
+    {"recompile.h", embedded_recompile_h, embedded_recompile_h_end},
+    {"bus.h", embedded_bus_h, embedded_bus_h_end},
+    {"machine.h", embedded_machine_h, embedded_machine_h_end},
+    {"options.h", embedded_options_h, embedded_options_h_end},
+    {"time.h", embedded_time_h, embedded_time_h_end},
+    {"via.h", embedded_via_h, embedded_via_h_end},
+    {"sdcard.h", embedded_sdcard_h, embedded_sdcard_h_end},
+    {"hostio.h", embedded_hostio_h, embedded_hostio_h_end},
+    {"symbols.h", embedded_symbols_h, embedded_symbols_h_end},
+    {"bus.c", embedded_bus_c, embedded_bus_c_end},
+    {"via.c", embedded_via_c, embedded_via_c_end},
+    {"sdcard.c", embedded_sdcard_c, embedded_sdcard_c_end},
+    {"hostio.c", embedded_hostio_c, embedded_hostio_c_end},
+    {NULL, embedded_recompile_c, embedded_recompile_c_end} /* writes the C the entries are made of */
+};
+#define SOURCE_COUNT (sizeof(sources) / sizeof(sources[0]))
+
+/* What the entry is compiled with on top of -DPOPPY_BUILD, the options that change the code have to match */
+static const char* const entryflags[] = {
+    "-std=c11", "-O2", "-D_DEFAULT_SOURCE", "-shared", "-fPIC", "-Wl,-Bsymbolic",
+    #ifdef NDEBUG
+    "-DNDEBUG",
+    #endif
+    #ifdef POPPY_CODEPAGE
+    "-DPOPPY_CODEPAGE",
+    #endif
+};
+#define ENTRY_FLAG_COUNT (sizeof(entryflags) / sizeof(entryflags[0]))
+
+static inline uint64_t hashBytes(uint64_t hash, const void* data, size_t n) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < n; ++i) hash = (hash ^ bytes[i]) * 0x100000001B3;
+    return hash;
+}
+
+/* FNV-1a of the embedded sources and the flags */
+static uint64_t buildHash(void) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (unsigned i = 0; i < SOURCE_COUNT; ++i) {
+        if (sources[i].name) hash = hashBytes(hash, sources[i].name, strlen(sources[i].name) + 1);
+        hash = hashBytes(hash, sources[i].start, sources[i].end - sources[i].start);
+    }
+    for (unsigned i = 0; i < ENTRY_FLAG_COUNT; ++i) hash = hashBytes(hash, entryflags[i], strlen(entryflags[i]) + 1);
+    return hash;
+}
+
+/* dir/name into path, false if it does not fit */
+static bool joinPath(char* path, size_t size, const char* dir, const char* name) {
+    int n = snprintf(path, size, "%s/%s", dir, name);
+    if (n < 0 || (size_t)n >= size) {
+        fprintf(stderr, "Path too long in '%s'\n", dir);
+        return false;
+    }
+    return true;
+}
+
+static bool writeFile(const char* path, const char* data, size_t size) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, fp) == size;
+    if (fclose(fp) || !ok) {
+        fprintf(stderr, "Failed to write '%s'\n", path);
+        return false;
+    }
+    return true;
+}
+
+/* Runs argv[0] from PATH with argv and waits for it, returns true if it exited with 0. The compiler's own errors
+ * are on stderr already, this only adds how it ended */
+static bool runCompiler(char* const* argv) {
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err) {
+        fprintf(stderr, "Failed to run '%s' ($CC, a C compiler is needed on the host): %s\n", argv[0], strerror(err));
+        return false;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to wait for '%s': %s\n", argv[0], strerror(errno));
+            return false;
+        }
+    }
+    if (WIFEXITED(status) && !WEXITSTATUS(status)) return true;
+    if (WIFEXITED(status)) fprintf(stderr, "'%s' ($CC) exited with status %d\n", argv[0], WEXITSTATUS(status));
+    else fprintf(stderr, "'%s' ($CC) was killed by signal %d\n", argv[0], WTERMSIG(status));
+    return false;
+}
+
+#define MAX_CC_WORDS 32
+
+static bool compileIn(const struct machine* m, const char* tmp, const char* object, uint64_t build) {
+    char path[4096];
+    for (unsigned i = 0; i < SOURCE_COUNT; ++i) {
+        if (!sources[i].name) continue;
+        if (!joinPath(path, sizeof(path), tmp, sources[i].name)) return false;
+        if (!writeFile(path, sources[i].start, sources[i].end - sources[i].start)) return false;
+    }
+    if (!joinPath(path, sizeof(path), tmp, "poppy.c") || !recompileROM(m, path)) return false;
+
+    const char* env = getenv("CC");
+    char cc[1024];
+    snprintf(cc, sizeof(cc), "%s", env && *env ? env : "cc");
+    char define[64];
+    snprintf(define, sizeof(define), "-DPOPPY_BUILD=0x%016" PRIX64 "ULL", build);
+    static const char* const files[] = {"poppy.c", "bus.c", "via.c", "sdcard.c", "hostio.c"};
+    char filepaths[sizeof(files) / sizeof(files[0])][4096];
+    char* argv[MAX_CC_WORDS + ENTRY_FLAG_COUNT + sizeof(files) / sizeof(files[0]) + 8];
+    unsigned argc = 0;
+    for (char* word = strtok(cc, " \t"); word; word = strtok(NULL, " \t")) {
+        if (argc == MAX_CC_WORDS) {
+            fputs("Too many words in $CC\n", stderr);
+            return false;
+        }
+        argv[argc++] = word;
+    }
+    if (!argc) argv[argc++] = "cc";
+    for (unsigned i = 0; i < ENTRY_FLAG_COUNT; ++i) argv[argc++] = (char*)entryflags[i];
+    argv[argc++] = define;
+    argv[argc++] = "-iquote";
+    argv[argc++] = (char*)tmp;
+    for (unsigned i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        if (!joinPath(filepaths[i], sizeof(filepaths[i]), tmp, files[i])) return false;
+        argv[argc++] = filepaths[i];
+    }
+    argv[argc++] = "-o";
+    argv[argc++] = (char*)object;
+    argv[argc] = NULL;
+    return runCompiler(argv);
+}
+
+/* Removes the temporary directory and everything compileIn put in it */
+static void removeTemporary(const char* tmp, const char* object) {
+    char path[4096];
+    for (unsigned i = 0; i < SOURCE_COUNT; ++i) {
+        if (!sources[i].name) continue;
+        if (joinPath(path, sizeof(path), tmp, sources[i].name)) remove(path);
+    }
+    if (joinPath(path, sizeof(path), tmp, "poppy.c")) remove(path);
+    remove(object);
+    rmdir(tmp);
+}
+
+static bool compileEntry(const struct machine* m, const char* dir, const char* path, uint64_t build) {
+    char tmp[4096], object[4096];
+    if (!joinPath(tmp, sizeof(tmp), dir, "poppy-XXXXXX")) return false;
+    if (!mkdtemp(tmp)) {
+        fprintf(stderr, "Failed to create a directory in '%s': %s\n", dir, strerror(errno));
+        return false;
+    }
+    if (!joinPath(object, sizeof(object), tmp, "poppy.so")) {
+        rmdir(tmp);
+        return false;
+    }
+    bool ok = compileIn(m, tmp, object, build);
+    if (!ok) fprintf(stderr, "Failed to compile the translation cache entry '%s'\n", path);
+    else if (rename(object, path)) {
+        fprintf(stderr, "Failed to rename '%s' to '%s': %s\n", object, path, strerror(errno));
+        ok = false;
+    }
+    removeTemporary(tmp, object);
+    return ok;
+}
+
+/* Runs the ROM code of m from the entry for its ROMs in dir, compiling it first if there is none. Returns false
+ * and leaves the machine on the interpreter if that does not work out */
+bool romcacheLoad(struct machine* m, const char* dir) {
+    uint64_t build = buildHash();
+    uint64_t hash = romHash(m);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/poppy-%016" PRIX64 "-%016" PRIX64 ".so", dir, hash, build);
+    if (access(path, R_OK)) {
+        if (mkdir(dir, 0777) && errno != EEXIST) {
+            fprintf(stderr, "Failed to create '%s': %s\n", dir, strerror(errno));
+            return false;
+        }
+        if (!compileEntry(m, dir, path, build)) return false;
+    }
+    void* module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!module) {
+        fprintf(stderr, "Failed to load '%s': %s\n", path, dlerror());
+        return false;
+    }
+    const struct romimage* image = dlsym(module, "romImage");
+    if (!image || image->hash != hash || image->build != build || image->machinesize != sizeof(struct machine)) {
+        fprintf(stderr, "'%s' is not a translation cache entry for these ROMs and this build\n", path);
+        dlclose(module);
+        return false;
+    }
+    m->romimage = image; /* the entry stays mapped until the process exits */
+    m->romcode = ROMCODE_UNCHECKED;
+    return true;
+}
+
+#else
+
+bool romcacheLoad(struct machine* m, const char* dir) {
+    (void)m, (void)dir;
+    fputs("Translation caches are not supported on this platform, running on the interpreter\n", stderr);
+    return false;
+}
+
+#endif
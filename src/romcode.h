@@ -0,0 +1,96 @@
+#ifndef POPPY_ROMCODE_H
+#define POPPY_ROMCODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUS_BLOCK_CYCLES /* the blocks charge the cycles, see bus.h */
+#include "options.h"
+#include "bus.h"
+#include "ucode.h"
+#include "recompile.h"
+
+/* Recompiled ROM code */
+/* Included by the C that recompileROM writes. romInstruction is the fast core for a constant opcode, so every
+ * instruction of a block is the interpreter's own code for it without the dispatch */
+#ifndef POPPY_BUILD
+    #define POPPY_BUILD 0 /* built into the emulator instead of loaded from a translation cache */
+#endif
+
+#define CORE_ACCURATE false
+#define CORE_STEP romInstruction
+#define CORE_OPCODE
+#include "opcodes.h"
+#undef CORE_ACCURATE
+#undef CORE_STEP
+#undef CORE_OPCODE
+
+/* Block-level cycles */
+/* A block starts with the devices caught up, no events pending but ROM_LEVEL_EVENTS (romStep sees to that) and no
+ * breakpoint or hook on its instructions (ROM_BEGIN), and leaves the devices alone until it ends. The cycles its
+ * instructions always take are charged in one go when it is left, the recompiler passes the total since the last
+ * charge as total, while page crossings and taken branches count as they happen. The guard is limit, the cycle a
+ * device can raise an interrupt at the earliest: a block is split at the first instruction that ends at or past it,
+ * so the devices catch up and the interrupt is taken right where the interpreter would take it. The end of the run
+ * is a guard in the same way, for cycles in limit and for instructions as budget. Only instructions that access
+ * memory can raise events themselves (watchpoints, the IRQ line from a device) and only those look at the events
+ * after them, and an instruction that may access a device catches the devices up before it runs */
+
+/* The guard, which also stops at the end of a poppyRunCycles run */
+static inline uint64_t romLimit(const struct machine* m) {
+    uint64_t limit = m->devicecycles + quietCycles(m);
+    return m->runcycles && m->runcycles < limit ? m->runcycles : limit;
+}
+
+/* If a breakpoint or a hook is on an address from first to last, the block cannot run past it */
+static inline bool romMarked(const struct machine* m, unsigned events, uint16_t first, uint16_t last) {
+    for (unsigned addr = first; addr <= last; ++addr) {
+        if ((events & EVENT_BREAKPOINTS) && testAddress(m->breakpoints, addr)) return true;
+        if ((events & EVENT_HOOKS) && testAddress(m->hookmap, addr)) return true;
+    }
+    return false;
+}
+
+/* Starts the block whose instructions are from first to last, or leaves it to the interpreter with 0. A block is in
+ * a single page, whose wait states the totals charge for every opcode and operand byte as n * waits */
+#define ROM_BEGIN(first, last) \
+    unsigned marks = atomic_load_explicit(&m->events, memory_order_relaxed) & (EVENT_HOOKS | EVENT_BREAKPOINTS); \
+    if (marks && romMarked(m, marks, first, last)) return 0; \
+    const unsigned waits = m->waitstates[(first) >> 8]; \
+    uint64_t limit = romLimit(m)
+
+/* Leaves the block with the number of instructions run so far if PC did not end up at next (a taken branch, an
+ * opcode the decoder sees differently than the core), the devices have to catch up, the budget romStep passed in
+ * is used up or cond says so */
+#define ROM_CHECK(next, count, total, cond) do { \
+        if (m->registers.pc != (next) || m->cycles + (total) >= limit || (count) >= budget || (cond)) { \
+            m->cycles += (total); \
+            return count; \
+        } \
+    } while (0)
+#define ROM_EVENTS() (atomic_load_explicit(&m->events, memory_order_relaxed) & ~ROM_LEVEL_EVENTS)
+
+/* An instruction that only works on the registers */
+#define ROM_INTERNAL(opcode, next, count, total) do { \
+        romInstruction(m, opcode); \
+        ROM_CHECK(next, count, total, false); \
+    } while (0)
+/* An instruction that only accesses memory in the page table, or may find a watchpoint there */
+#define ROM_STEP(opcode, next, count, total) do { \
+        romInstruction(m, opcode); \
+        ROM_CHECK(next, count, total, ROM_EVENTS()); \
+    } while (0)
+/* An instruction that may access a device, which has to see the cycle the interpreter would be at. pending is
+ * charged before it and own after it, and the guard starts over from what the devices are up to */
+#define ROM_IO(opcode, next, count, pending, own) do { \
+        m->cycles += (pending); \
+        syncDevices(m); \
+        romInstruction(m, opcode); \
+        m->cycles += (own); \
+        limit = romLimit(m); \
+        ROM_CHECK(next, count, 0, ROM_EVENTS()); \
+    } while (0)
+#define ROM_CHARGE(total) (m->cycles += (total))
+
+#endif
@@ -0,0 +1,298 @@
+#include "sdcard.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* SD card */
+/* An SDHC card (block addressing) on an image file that is mapped into memory, so a block transfer is a copy
+ * between the mapping and the SPI bus. The card follows port B edge by edge, a byte is handled once its 8th bit is
+ * in and the answer goes out from the falling edge after it. Whole bytes and blocks can also be transferred at
+ * once when the bus is between bytes (sdcardAligned), which is what the HLE hooks do in place of the firmware's
+ * bit-banging loops, and that leaves the card exactly where bit-banging them would have. CRCs are neither checked
+ * nor sent, like in SPI mode by default */
+
+bool sdcardOpen(struct sdcard* sd, const char* file) {
+    bool readonly = false;
+    int fd = open(file, O_RDWR);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        fd = open(file, O_RDONLY);
+        readonly = true;
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size - st.st_size % SD_BLOCK;
+    if (!size) {
+        fprintf(stderr, "'%s' is too small for an SD card image\n", file);
+        close(fd);
+        return false;
+    }
+    void* image = mmap(NULL, size, readonly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Failed to map '%s': %s\n", file, strerror(errno));
+        close(fd);
+        return false;
+    }
+    sdcardClose(sd);
+    *sd = (struct sdcard){
+        .image = image, .size = size, .readonly = readonly, .fd = fd, .pins = 0xFF, .tx = 0xFF,
+        .state = SD_COMMAND, .idle = true
+    };
+    return true;
+}
+
+void sdcardClose(struct sdcard* sd) {
+    if (sd->image) {
+        munmap(sd->image, sd->size);
+        close(sd->fd);
+    }
+    memset(sd, 0, sizeof(*sd));
+}
+
+/* Makes dst a card in the same state as src whose writes stay in its own copy-on-write mapping of the image, for
+ * machines that run alongside the one that owns the card. dst is overwritten, not closed */
+bool sdcardCopy(struct sdcard* dst, const struct sdcard* src) {
+    *dst = *src;
+    if (!src->image) return true;
+    dst->image = NULL;
+    dst->fd = dup(src->fd);
+    if (dst->fd < 0) {
+        fprintf(stderr, "Failed to copy the SD card: %s\n", strerror(errno));
+        return false;
+    }
+    void* image = mmap(NULL, src->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, dst->fd, 0);
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the SD card copy: %s\n", strerror(errno));
+        close(dst->fd);
+        memset(dst, 0, sizeof(*dst));
+        return false;
+    }
+    dst->image = image;
+    return true;
+}
+
+/* Puts dst in the SPI and protocol state src is in, dst keeps its own image. Without one it stays out */
+void sdcardSetState(struct sdcard* dst, const struct sdcard* src) {
+    struct sdcard card = *dst;
+    if (!card.image) return;
+    *dst = *src;
+    dst->image = card.image;
+    dst->size = card.size;
+    dst->readonly = card.readonly;
+    dst->fd = card.fd;
+}
+
+/* Protocol */
+
+static void respond(struct sdcard* sd, const uint8_t* bytes, unsigned n) {
+    sd->out[0] = 0xFF; /* a byte of NCR before the response */
+    memcpy(&sd->out[1], bytes, n);
+    sd->outlen = n + 1;
+    sd->outpos = 0;
+}
+static void respondR1(struct sdcard* sd, uint8_t r1) {
+    respond(sd, &r1, 1);
+}
+
+static void command(struct sdcard* sd) {
+    unsigned index = sd->cmd[0] & 0x3F;
+    uint32_t arg = (uint32_t)sd->cmd[1] << 24 | sd->cmd[2] << 16 | sd->cmd[3] << 8 | sd->cmd[4];
+    bool app = sd->appcmd;
+    uint8_t r1 = sd->idle ? 0x01 : 0x00;
+    sd->appcmd = false;
+    if (sd->state == SD_READ) { /* only CMD12 is taken while blocks are being sent */
+        if (index != 12) return;
+        sd->state = SD_COMMAND;
+        respondR1(sd, r1);
+        return;
+    }
+    switch (index) {
+        default: /* illegal command */
+            respondR1(sd, r1 | 0x04);
+            break;
+        case 0: /* GO_IDLE_STATE */
+            sd->idle = true;
+            respondR1(sd, 0x01);
+            break;
+        case 8: /* SEND_IF_COND, R7 echoes the voltage and check pattern */
+            respond(sd, (const uint8_t[]){r1, 0x00, 0x00, sd->cmd[3] & 0x0F, sd->cmd[4]}, 5);
+            break;
+        case 12: /* STOP_TRANSMISSION with nothing to stop */
+        case 59: /* CRC_ON_OFF, CRCs are never checked */
+            respondR1(sd, r1);
+            break;
+        case 16: /* SET_BLOCKLEN, SDHC blocks are always 512 bytes */
+            respondR1(sd, arg == SD_BLOCK ? r1 : r1 | 0x40);
+            break;
+        case 41: /* ACMD41 SD_SEND_OP_COND, initialization is done right away */
+            if (!app) {
+                respondR1(sd, r1 | 0x04);
+                break;
+            }
+            sd->idle = false;
+            respondR1(sd, 0x00);
+            break;
+        case 55: /* APP_CMD */
+            sd->appcmd = true;
+            respondR1(sd, r1);
+            break;
+        case 58: /* READ_OCR, powered up with CCS set once initialized */
+            respond(sd, (const uint8_t[]){r1, sd->idle ? 0x00 : 0xC0, 0xFF, 0x80, 0x00}, 5);
+            break;
+        case 17: /* READ_SINGLE_BLOCK */
+        case 18: /* READ_MULTIPLE_BLOCK */
+        case 24: /* WRITE_BLOCK */
+            if (sd->idle) {
+                respondR1(sd, r1 | 0x04);
+                break;
+            }
+            if (arg >= sd->size / SD_BLOCK) {
+                respondR1(sd, 0x20); /* address error */
+                break;
+            }
+            sd->block = arg;
+            sd->pos = 0;
+            if (index == 24) {
+                sd->state = SD_WRITE;
+                respondR1(sd, 0x00);
+                break;
+            }
+            sd->state = SD_READ;
+            sd->multiple = index == 18;
+            respond(sd, (const uint8_t[]){0x00, 0xFF}, 2); /* a byte of NAC before the data token */
+            break;
+    }
+}
+
+/* Takes the byte the host sent */
+static void receive(struct sdcard* sd, uint8_t in) {
+    switch (sd->state) {
+        case SD_WRITE:
+            if (in == 0xFE) sd->state = SD_WRITEDATA;
+            return;
+        case SD_WRITEDATA:
+            if (sd->pos < SD_BLOCK && !sd->readonly) sd->image[(size_t)sd->block * SD_BLOCK + sd->pos] = in;
+            if (++sd->pos == SD_BLOCK + 2) {
+                sd->state = SD_COMMAND;
+                /* Data response (accepted or write error), then a byte of busy */
+                sd->out[0] = sd->readonly ? 0x0D : 0x05;
+                sd->out[1] = 0x00;
+                sd->outlen = 2;
+                sd->outpos = 0;
+            }
+            return;
+        default:
+            if (!sd->cmdlen && (in & 0xC0) != 0x40) return; /* not a command start bit */
+            sd->cmd[sd->cmdlen++] = in;
+            if (sd->cmdlen == sizeof(sd->cmd)) {
+                sd->cmdlen = 0;
+                command(sd);
+            }
+            return;
+    }
+}
+
+/* Returns the byte the card sends next, a read block is the data token, the data and 2 bytes of CRC */
+static uint8_t send(struct sdcard* sd) {
+    if (sd->outpos < sd->outlen) return sd->out[sd->outpos++];
+    if (sd->state != SD_READ) return 0xFF;
+    if (!sd->pos) {
+        sd->pos = 1;
+        return 0xFE;
+    }
+    if (sd->pos <= SD_BLOCK) return sd->image[(size_t)sd->block * SD_BLOCK + sd->pos++ - 1];
+    if (sd->pos <= SD_BLOCK + 2 && ++sd->pos == SD_BLOCK + 3) {
+        if (!sd->multiple) {
+            sd->state = SD_COMMAND;
+        } else if (sd->block + 1 < sd->size / SD_BLOCK) {
+            ++sd->block;
+            sd->pos = 0;
+        }
+    }
+    return 0xFF;
+}
+
+/* SPI */
+
+/* Follows port B, returns the level of MISO */
+bool sdcardPins(struct sdcard* sd, uint8_t levels) {
+    if (!sd->image) return true;
+    uint8_t changed = levels ^ sd->pins;
+    sd->pins = levels;
+    if (levels & SD_CS) {
+        sd->selected = false;
+        sd->bits = sd->shifts = 0;
+    } else if (!sd->selected) {
+        sd->selected = true;
+        sd->bits = sd->shifts = 0;
+    } else if ((changed & SD_SCK) && (levels & SD_SCK)) {
+        sd->rx = sd->rx << 1 | ((levels & SD_MOSI) != 0);
+        if (++sd->bits == 8) {
+            receive(sd, sd->rx);
+            sd->next = send(sd);
+        }
+    } else if ((changed & SD_SCK) && sd->shifts < sd->bits) {
+        if (sd->bits == 8) {
+            sd->tx = sd->next;
+            sd->bits = sd->shifts = 0;
+        } else {
+            ++sd->shifts;
+        }
+    }
+    return sdcardMISO(sd);
+}
+
+/* Transfers a whole byte, the bus has to be between bytes */
+uint8_t sdcardTransfer(struct sdcard* sd, uint8_t in) {
+    uint8_t ret = sd->tx;
+    receive(sd, in);
+    sd->tx = send(sd);
+    return ret;
+}
+
+/* Transfers n bytes sending $FF, the data of a read block is copied straight out of the image */
+void sdcardRead(struct sdcard* sd, uint8_t* dst, size_t n) {
+    for (size_t i = 0; i < n;) {
+        dst[i++] = sd->tx;
+        if (sd->state == SD_READ && sd->outpos == sd->outlen && !sd->cmdlen && sd->pos && sd->pos <= SD_BLOCK) {
+            /* The $FF sent for these bytes are not commands, so nothing but the position changes */
+            size_t run = SD_BLOCK + 1 - sd->pos;
+            if (run > n - i) run = n - i;
+            memcpy(&dst[i], &sd->image[(size_t)sd->block * SD_BLOCK + sd->pos - 1], run);
+            sd->pos += run;
+            i += run;
+        }
+        receive(sd, 0xFF);
+        sd->tx = send(sd);
+    }
+}
+
+/* Transfers n bytes ignoring what comes back, the data of a write block is copied straight into the image */
+void sdcardWrite(struct sdcard* sd, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n;) {
+        if (sd->state == SD_WRITEDATA && sd->outpos == sd->outlen && sd->pos < SD_BLOCK) {
+            /* The card sends $FF while it takes the data */
+            size_t run = SD_BLOCK - sd->pos;
+            if (run > n - i) run = n - i;
+            if (!sd->readonly) memcpy(&sd->image[(size_t)sd->block * SD_BLOCK + sd->pos], &src[i], run);
+            sd->pos += run;
+            i += run;
+            sd->tx = 0xFF;
+            continue;
+        }
+        receive(sd, src[i++]);
+        sd->tx = send(sd);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef POPPY_SDCARD_H
+#define POPPY_SDCARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* SD card in SPI mode */
+/* http://elm-chan.org/docs/mmc/mmc_e.html */
+/* Bit-banged by the firmware through VIA port B, SPI mode 0: the card samples MOSI on the rising edge of SCK and
+ * puts the next bit on MISO after the falling edge */
+#define SD_SCK  (1U << 0) /* PB0, output */
+#define SD_MOSI (1U << 1) /* PB1, output */
+#define SD_CS   (1U << 2) /* PB2, output, active low */
+#define SD_MISO (1U << 7) /* PB7, input, so BIT $8000 puts it in N */
+
+#define SD_BLOCK 512
+
+enum sdstate {
+    SD_COMMAND, /* Taking commands */
+    SD_READ, /* Sending data blocks, CMD17 or CMD18 (until CMD12) */
+    SD_WRITE, /* Waiting for the data token of a CMD24 block */
+    SD_WRITEDATA /* Taking a CMD24 block and its CRC */
+};
+
+struct sdcard {
+    /* Image, mapped shared so writes end up in the file, or privately in copies (sdcardCopy) */
+    uint8_t* image; /* NULL without a card */
+    size_t size; /* whole blocks */
+    bool readonly;
+    int fd; /* of the image file, kept open for mapping it again */
+
+    /* SPI */
+    uint8_t pins; /* Port B levels as last seen */
+    bool selected;
+    unsigned bits; /* Rising edges in the current byte */
+    unsigned shifts; /* Falling edges in the current byte */
+    uint8_t rx; /* Byte coming in on MOSI */
+    uint8_t tx; /* Byte going out on MISO */
+    uint8_t next; /* Byte to send after this one, known from the 8th rising edge on */
+
+    /* Protocol */
+    enum sdstate state;
+    bool idle; /* In the idle state, until ACMD41 */
+    bool appcmd; /* The last command was CMD55 */
+    bool multiple; /* CMD18, blocks keep coming until CMD12 */
+    uint8_t cmd[6];
+    unsigned cmdlen;
+    uint8_t out[8]; /* Response bytes queued ahead of any data */
+    unsigned outlen, outpos;
+    uint32_t block; /* Block being read or written */
+    unsigned pos; /* Bytes of the block transfer done, including the token */
+};
+
+bool sdcardOpen(struct sdcard* sd, const char* file);
+void sdcardClose(struct sdcard* sd);
+bool sdcardCopy(struct sdcard* dst, const struct sdcard* src);
+void sdcardSetState(struct sdcard* dst, const struct sdcard* src);
+bool sdcardPins(struct sdcard* sd, uint8_t levels);
+uint8_t sdcardTransfer(struct sdcard* sd, uint8_t in);
+void sdcardRead(struct sdcard* sd, uint8_t* dst, size_t n);
+void sdcardWrite(struct sdcard* sd, const uint8_t* src, size_t n);
+
+/* Level of MISO, pulled up while the card is not selected */
+static inline bool sdcardMISO(const struct sdcard* sd) {
+    return !sd->selected || (sd->tx << (sd->shifts & 7) & 0x80);
+}
+
+/* If the bus is between bytes, so a whole byte can be transferred at once */
+static inline bool sdcardAligned(const struct sdcard* sd) {
+    return sd->image && sd->selected && !sd->bits && !sd->shifts && !(sd->pins & SD_SCK);
+}
+
+#endif
@@ -0,0 +1,561 @@
+#include "sequencer.h"
+
+#include <stdint.h>
+
+#include "bus.h"
+#include "ucode.h"
+
+/* Sequencer */
+/* The accurate core: a state machine that runs one bus cycle of the current instruction per call, with its place in
+ * the instruction (struct sequencer) kept in the machine between calls. Every cycle steps the devices before its
+ * access, so they see each access on the exact cycle it happens and can be looked at between any two of them. The
+ * sequences are the same bus accesses in the same order as the fast core's (opcodes.h), lockstep (-l accurate) holds
+ * the two to that */
+
+/* Addressing modes and the other shapes an instruction's cycles can take */
+enum mode {
+    SEQ_ONE, /* the opcode fetch and nothing else, opcodes that are not implemented */
+    SEQ_IMPLIED,
+    SEQ_PUSH, /* PHA, PHP */
+    SEQ_PULL, /* PLA, PLP */
+    SEQ_IMM,
+    SEQ_ZP,
+    SEQ_ZPX,
+    SEQ_ZPY,
+    SEQ_ABS,
+    SEQ_ABX,
+    SEQ_ABY,
+    SEQ_INX, /* ($12,X) */
+    SEQ_INY, /* ($12),Y */
+    SEQ_ZPI, /* ($12) */
+    SEQ_BRANCH,
+    SEQ_JMP,
+    SEQ_JMPI, /* JMP ($1234) and JMP ($1234,X) */
+    SEQ_JSR,
+    SEQ_RTS,
+    SEQ_BRK,
+    SEQ_RTI,
+    SEQ_SKIP, /* 2 byte no-ops */
+    SEQ_SKIPZP,
+    SEQ_SKIPZPX,
+    SEQ_SKIPABX,
+    SEQ_SKIPLONG /* $5C, 3 bytes and 8 cycles */
+};
+
+/* What the instruction does with the memory its addressing mode ends at */
+enum op {
+    OP_NONE,
+    /* reads */
+    OP_LDA,
+    OP_LDX,
+    OP_LDY,
+    OP_ADC,
+    OP_SBC,
+    OP_CMP,
+    OP_CPX,
+    OP_CPY,
+    /* writes */
+    OP_STA,
+    OP_STX,
+    OP_STY,
+    /* read-modify-writes */
+    OP_INC,
+    OP_DEC
+};
+
+static const struct {
+    uint8_t mode; /* enum mode */
+    uint8_t op; /* enum op */
+} instructions[256] = {
+    [0xA9] = {SEQ_IMM, OP_LDA}, [0xA5] = {SEQ_ZP, OP_LDA}, [0xB5] = {SEQ_ZPX, OP_LDA}, [0xAD] = {SEQ_ABS, OP_LDA},
+    [0xBD] = {SEQ_ABX, OP_LDA}, [0xB9] = {SEQ_ABY, OP_LDA}, [0xA1] = {SEQ_INX, OP_LDA}, [0xB1] = {SEQ_INY, OP_LDA},
+    [0xA2] = {SEQ_IMM, OP_LDX}, [0xA6] = {SEQ_ZP, OP_LDX}, [0xB6] = {SEQ_ZPY, OP_LDX}, [0xAE] = {SEQ_ABS, OP_LDX},
+    [0xBE] = {SEQ_ABY, OP_LDX},
+    [0xA0] = {SEQ_IMM, OP_LDY}, [0xA4] = {SEQ_ZP, OP_LDY}, [0xB4] = {SEQ_ZPX, OP_LDY}, [0xAC] = {SEQ_ABS, OP_LDY},
+    [0xBC] = {SEQ_ABX, OP_LDY},
+    [0x85] = {SEQ_ZP, OP_STA}, [0x95] = {SEQ_ZPX, OP_STA}, [0x8D] = {SEQ_ABS, OP_STA}, [0x9D] = {SEQ_ABX, OP_STA},
+    [0x99] = {SEQ_ABY, OP_STA}, [0x81] = {SEQ_INX, OP_STA}, [0x91] = {SEQ_INY, OP_STA},
+    [0x86] = {SEQ_ZP, OP_STX}, [0x96] = {SEQ_ZPY, OP_STX}, [0x8E] = {SEQ_ABS, OP_STX},
+    [0x84] = {SEQ_ZP, OP_STY}, [0x94] = {SEQ_ZPX, OP_STY}, [0x8C] = {SEQ_ABS, OP_STY},
+    [0xAA] = {SEQ_IMPLIED}, [0xA8] = {SEQ_IMPLIED}, [0xBA] = {SEQ_IMPLIED}, [0x8A] = {SEQ_IMPLIED},
+    [0x9A] = {SEQ_IMPLIED}, [0x98] = {SEQ_IMPLIED},
+    [0x48] = {SEQ_PUSH}, [0x08] = {SEQ_PUSH}, [0x68] = {SEQ_PULL}, [0x28] = {SEQ_PULL},
+    [0xE6] = {SEQ_ZP, OP_INC}, [0xF6] = {SEQ_ZPX, OP_INC}, [0xEE] = {SEQ_ABS, OP_INC}, [0xFE] = {SEQ_ABX, OP_INC},
+    [0xC6] = {SEQ_ZP, OP_DEC}, [0xD6] = {SEQ_ZPX, OP_DEC}, [0xCE] = {SEQ_ABS, OP_DEC}, [0xDE] = {SEQ_ABX, OP_DEC},
+    [0xE8] = {SEQ_IMPLIED}, [0xC8] = {SEQ_IMPLIED}, [0xCA] = {SEQ_IMPLIED}, [0x88] = {SEQ_IMPLIED},
+    [0x69] = {SEQ_IMM, OP_ADC}, [0x65] = {SEQ_ZP, OP_ADC}, [0x75] = {SEQ_ZPX, OP_ADC}, [0x6D] = {SEQ_ABS, OP_ADC},
+    [0x7D] = {SEQ_ABX, OP_ADC}, [0x79] = {SEQ_ABY, OP_ADC}, [0x61] = {SEQ_INX, OP_ADC}, [0x71] = {SEQ_INY, OP_ADC},
+    [0x72] = {SEQ_ZPI, OP_ADC},
+    [0xE9] = {SEQ_IMM, OP_SBC}, [0xE5] = {SEQ_ZP, OP_SBC}, [0xF5] = {SEQ_ZPX, OP_SBC}, [0xED] = {SEQ_ABS, OP_SBC},
+    [0xFD] = {SEQ_ABX, OP_SBC}, [0xF9] = {SEQ_ABY, OP_SBC}, [0xE1] = {SEQ_INX, OP_SBC}, [0xF1] = {SEQ_INY, OP_SBC},
+    [0xF2] = {SEQ_ZPI, OP_SBC},
+    [0x18] = {SEQ_IMPLIED}, [0xD8] = {SEQ_IMPLIED}, [0x58] = {SEQ_IMPLIED}, [0xB8] = {SEQ_IMPLIED},
+    [0x38] = {SEQ_IMPLIED}, [0xF8] = {SEQ_IMPLIED}, [0x78] = {SEQ_IMPLIED},
+    [0xC9] = {SEQ_IMM, OP_CMP}, [0xC5] = {SEQ_ZP, OP_CMP}, [0xD5] = {SEQ_ZPX, OP_CMP}, [0xCD] = {SEQ_ABS, OP_CMP},
+    [0xDD] = {SEQ_ABX, OP_CMP}, [0xD9] = {SEQ_ABY, OP_CMP}, [0xC1] = {SEQ_INX, OP_CMP}, [0xD1] = {SEQ_INY, OP_CMP},
+    [0xD2] = {SEQ_ZPI, OP_CMP},
+    [0xE0] = {SEQ_IMM, OP_CPX}, [0xE4] = {SEQ_ZP, OP_CPX}, [0xEC] = {SEQ_ABS, OP_CPX},
+    [0xC0] = {SEQ_IMM, OP_CPY}, [0xC4] = {SEQ_ZP, OP_CPY}, [0xCC] = {SEQ_ABS, OP_CPY},
+    [0x10] = {SEQ_BRANCH}, [0x30] = {SEQ_BRANCH}, [0x50] = {SEQ_BRANCH}, [0x70] = {SEQ_BRANCH},
+    [0x90] = {SEQ_BRANCH}, [0xB0] = {SEQ_BRANCH}, [0xD0] = {SEQ_BRANCH}, [0xF0] = {SEQ_BRANCH},
+    [0x80] = {SEQ_BRANCH},
+    [0x4C] = {SEQ_JMP}, [0x6C] = {SEQ_JMPI}, [0x7C] = {SEQ_JMPI}, [0x20] = {SEQ_JSR}, [0x60] = {SEQ_RTS},
+    [0x00] = {SEQ_BRK}, [0x40] = {SEQ_RTI},
+    [0xEA] = {SEQ_IMPLIED},
+    [0x02] = {SEQ_SKIP}, [0x22] = {SEQ_SKIP}, [0x42] = {SEQ_SKIP}, [0x62] = {SEQ_SKIP}, [0x82] = {SEQ_SKIP},
+    [0xC2] = {SEQ_SKIP}, [0xE2] = {SEQ_SKIP},
+    [0x44] = {SEQ_SKIPZP}, [0x54] = {SEQ_SKIPZPX}, [0xD4] = {SEQ_SKIPZPX}, [0xF4] = {SEQ_SKIPZPX},
+    [0xDC] = {SEQ_SKIPABX}, [0xFC] = {SEQ_SKIPABX}, [0x5C] = {SEQ_SKIPLONG}
+};
+
+/* Step of a read-modify-write instruction that writes the result back, after its addressing mode's steps */
+#define STEP_WRITEBACK 0xFF
+
+static inline bool done(struct sequencer* s) {
+    s->step = 0;
+    return true;
+}
+
+static inline uint8_t fetch(struct machine* m) {
+    return busFetchByte(m, true);
+}
+/* The operand byte at PC without stepping past it, for the modes that only do that a cycle later */
+static inline uint8_t readOperand(struct machine* m) {
+    return busReadCode(m, m->registers.pc, true);
+}
+static inline void dummyRead(struct machine* m, uint16_t addr) {
+    busDummyRead(m, addr, true);
+}
+
+static void implied(struct registers* r, uint8_t opcode) {
+    switch (opcode) {
+        case 0xAA: r->x = r->a; ucodeSetZNFlags(r->x, &r->p); break; /* TAX */
+        case 0xA8: r->y = r->a; ucodeSetZNFlags(r->y, &r->p); break; /* TAY */
+        case 0xBA: r->x = r->sp; ucodeSetZNFlags(r->x, &r->p); break; /* TSX */
+        case 0x8A: r->a = r->x; ucodeSetZNFlags(r->a, &r->p); break; /* TXA */
+        case 0x9A: r->sp = r->x; break; /* TXS */
+        case 0x98: r->a = r->y; ucodeSetZNFlags(r->a, &r->p); break; /* TYA */
+        case 0xE8: ++r->x; ucodeSetZNFlags(r->x, &r->p); break; /* INX */
+        case 0xC8: ++r->y; ucodeSetZNFlags(r->y, &r->p); break; /* INY */
+        case 0xCA: --r->x; ucodeSetZNFlags(r->x, &r->p); break; /* DEX */
+        case 0x88: --r->y; ucodeSetZNFlags(r->y, &r->p); break; /* DEY */
+        case 0x18: r->p &= ~FLAG_CARRY; break; /* CLC */
+        case 0xD8: r->p &= ~FLAG_DECIMAL; break; /* CLD */
+        case 0x58: r->p &= ~FLAG_IRQDISABLE; break; /* CLI */
+        case 0xB8: r->p &= ~FLAG_OVERFLOW; break; /* CLV */
+        case 0x38: r->p |= FLAG_CARRY; break; /* SEC */
+        case 0xF8: r->p |= FLAG_DECIMAL; break; /* SED */
+        case 0x78: r->p |= FLAG_IRQDISABLE; break; /* SEI */
+        default: break; /* NOP */
+    }
+}
+
+static bool branchTaken(uint8_t p, uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: return !(p & FLAG_NEGATIVE); /* BPL */
+        case 0x30: return p & FLAG_NEGATIVE; /* BMI */
+        case 0x50: return !(p & FLAG_OVERFLOW); /* BVC */
+        case 0x70: return p & FLAG_OVERFLOW; /* BVS */
+        case 0x90: return !(p & FLAG_CARRY); /* BCC */
+        case 0xB0: return p & FLAG_CARRY; /* BCS */
+        case 0xD0: return !(p & FLAG_ZERO); /* BNE */
+        case 0xF0: return p & FLAG_ZERO; /* BEQ */
+        default: return true; /* BRA */
+    }
+}
+
+static void readOp(struct registers* r, enum op op, uint8_t value) {
+    switch (op) {
+        case OP_LDA: r->a = value; ucodeSetZNFlags(r->a, &r->p); break;
+        case OP_LDX: r->x = value; ucodeSetZNFlags(r->x, &r->p); break;
+        case OP_LDY: r->y = value; ucodeSetZNFlags(r->y, &r->p); break;
+        case OP_ADC: r->a = ucodeAddWithCarry(r->a, value, &r->p); break;
+        case OP_SBC: r->a = ucodeSubWithCarry(r->a, value, &r->p); break;
+        case OP_CMP: ucodeCompare(r->a, value, &r->p); break;
+        case OP_CPX: ucodeCompare(r->x, value, &r->p); break;
+        case OP_CPY: ucodeCompare(r->y, value, &r->p); break;
+        default: break;
+    }
+}
+
+/* The access at the effective address that ends an addressing mode. Reads and writes are done with it,
+ * read-modify-writes write the result back on the next cycle */
+static bool operate(struct machine* m, struct sequencer* s) {
+    struct registers* r = &m->registers;
+    enum op op = instructions[s->opcode].op;
+    switch (op) {
+        case OP_STA:
+        case OP_STX:
+        case OP_STY:
+            busWrite(m, s->addr, op == OP_STA ? r->a : op == OP_STX ? r->x : r->y, true);
+            return done(s);
+        case OP_INC:
+        case OP_DEC:
+            s->data = busRead(m, s->addr, true) + (op == OP_INC ? 1 : -1);
+            ucodeSetZNFlags(s->data, &r->p);
+            s->step = STEP_WRITEBACK;
+            return false;
+        default:
+            break;
+    }
+    readOp(r, op, busRead(m, s->addr, true));
+    return done(s);
+}
+
+/* Runs the next bus cycle of the current instruction, or fetches the opcode of the next one between instructions.
+ * Returns true when the instruction is done */
+bool sequencerCycle(struct machine* m) {
+    struct sequencer* s = &m->sequencer;
+    struct registers* r = &m->registers;
+    if (!s->step) {
+        s->opcode = fetch(m);
+        s->step = 1;
+        return instructions[s->opcode].mode == SEQ_ONE && done(s);
+    }
+    if (s->step == STEP_WRITEBACK) {
+        busWrite(m, s->addr, s->data, true);
+        return done(s);
+    }
+    enum op op = instructions[s->opcode].op;
+    bool modify = op == OP_INC || op == OP_DEC;
+    bool write = op == OP_STA || op == OP_STX || op == OP_STY;
+    unsigned step = s->step++;
+    switch (instructions[s->opcode].mode) {
+        case SEQ_ONE:
+            return done(s);
+        case SEQ_IMPLIED:
+            dummyRead(m, r->pc);
+            implied(r, s->opcode);
+            return done(s);
+        case SEQ_PUSH:
+            if (step == 1) {
+                dummyRead(m, r->pc);
+                return false;
+            }
+            busPush(m, s->opcode == 0x48 ? r->a : r->p | FLAG_BREAK | FLAG_ONE, true);
+            return done(s);
+        case SEQ_PULL:
+            if (step == 1) {
+                dummyRead(m, r->pc);
+                return false;
+            }
+            if (step == 2) {
+                dummyRead(m, 0x0100 | r->sp);
+                return false;
+            }
+            if (s->opcode == 0x68) {
+                r->a = busPop(m, true);
+                ucodeSetZNFlags(r->a, &r->p);
+            } else {
+                r->p = busPop(m, true);
+            }
+            return done(s);
+        case SEQ_IMM:
+            readOp(r, op, fetch(m));
+            return done(s);
+        case SEQ_ZP:
+            switch (step) {
+                case 1:
+                    s->addr = fetch(m);
+                    return false;
+                case 2:
+                    if (!modify) return operate(m, s);
+                    dummyRead(m, s->addr);
+                    return false;
+                default:
+                    return operate(m, s);
+            }
+        case SEQ_ZPX:
+        case SEQ_ZPY: {
+            uint8_t index = instructions[s->opcode].mode == SEQ_ZPX ? r->x : r->y;
+            switch (step) {
+                case 1:
+                    s->addr = fetch(m);
+                    return false;
+                case 2:
+                    dummyRead(m, s->addr);
+                    if (!modify) s->addr = (uint8_t)(s->addr + index);
+                    return false;
+                case 3:
+                    if (!modify) return operate(m, s);
+                    dummyRead(m, s->addr);
+                    s->addr = (uint8_t)(s->addr + index);
+                    return false;
+                default:
+                    return operate(m, s);
+            }
+        }
+        case SEQ_ABS:
+            switch (step) {
+                case 1:
+                    s->addr = fetch(m);
+                    return false;
+                case 2:
+                    s->addr |= (uint16_t)fetch(m) << 8;
+                    return false;
+                case 3:
+                    if (!modify) return operate(m, s);
+                    dummyRead(m, s->addr);
+                    return false;
+                default:
+                    return operate(m, s);
+            }
+        case SEQ_ABX:
+        case SEQ_ABY: {
+            /* The high byte is read a cycle before PC steps past it, with another read of it in between when
+             * indexing crosses a page */
+            uint8_t index = instructions[s->opcode].mode == SEQ_ABX ? r->x : r->y;
+            switch (step) {
+                case 1:
+                    s->base = fetch(m);
+                    return false;
+                case 2:
+                    s->base |= (uint16_t)readOperand(m) << 8;
+                    s->addr = s->base + index;
+                    if (!modify) s->step = 4;
+                    return false;
+                case 3:
+                    dummyRead(m, s->base);
+                    return false;
+                case 4:
+                    if (write) {
+                        dummyRead(m, r->pc++);
+                        return false;
+                    }
+                    if ((s->addr & 0xFF00) != (s->base & 0xFF00)) {
+                        busPenaltyRead(m, r->pc++, true);
+                        return false;
+                    }
+                    ++r->pc;
+                    return operate(m, s);
+                default:
+                    return operate(m, s);
+            }
+        }
+        case SEQ_INX:
+            switch (step) {
+                case 1:
+                    s->data = fetch(m);
+                    return false;
+                case 2:
+                    dummyRead(m, s->data);
+                    s->data += r->x;
+                    return false;
+                case 3:
+                    s->addr = busRead(m, s->data, true);
+                    return false;
+                case 4:
+                    s->addr |= (uint16_t)busRead(m, (uint8_t)(s->data + 1), true) << 8;
+                    return false;
+                default:
+                    return operate(m, s);
+            }
+        case SEQ_INY:
+            /* PC steps past the operand after the pointer has been read, with another read of the operand in
+             * between when indexing crosses a page */
+            switch (step) {
+                case 1:
+                    s->data = readOperand(m);
+                    return false;
+                case 2:
+                    s->base = busRead(m, s->data, true);
+                    return false;
+                case 3:
+                    s->base |= (uint16_t)busRead(m, (uint8_t)(s->data + 1), true) << 8;
+                    s->addr = s->base + r->y;
+                    return false;
+                case 4:
+                    if (write) {
+                        dummyRead(m, r->pc++);
+                        return false;
+                    }
+                    if ((s->addr & 0xFF00) != (s->base & 0xFF00)) {
+                        busPenaltyRead(m, r->pc++, true);
+                        return false;
+                    }
+                    ++r->pc;
+                    return operate(m, s);
+                default:
+                    return operate(m, s);
+            }
+        case SEQ_ZPI:
+            switch (step) {
+                case 1:
+                    s->data = fetch(m);
+                    return false;
+                case 2:
+                    s->addr = busRead(m, s->data, true);
+                    return false;
+                case 3:
+                    s->addr |= (uint16_t)busRead(m, (uint8_t)(s->data + 1), true) << 8;
+                    return false;
+                default:
+                    return operate(m, s);
+            }
+        case SEQ_BRANCH:
+            /* Taken branches read the next opcode again while they add the offset, and once more if the target
+             * is in another page */
+            if (step == 1) {
+                int8_t offset = fetch(m);
+                s->addr = r->pc + offset;
+                return !branchTaken(r->p, s->opcode) && done(s);
+            }
+            busPenaltyRead(m, r->pc, true);
+            if (step == 2 && (s->addr & 0xFF00) != (r->pc & 0xFF00)) return false;
+            if (s->addr == (uint16_t)(r->pc - 2)) m->selfloop = true; /* branch to itself */
+            r->pc = s->addr;
+            return done(s);
+        case SEQ_JMP:
+            if (step == 1) {
+                s->addr = fetch(m);
+                return false;
+            }
+            s->addr |= (uint16_t)fetch(m) << 8;
+            if (s->addr == (uint16_t)(r->pc - 3)) m->selfloop = true; /* JMP * */
+            r->pc = s->addr;
+            return done(s);
+        case SEQ_JMPI:
+            switch (step) {
+                case 1:
+                    s->base = fetch(m);
+                    return false;
+                case 2:
+                    s->base |= (uint16_t)readOperand(m) << 8;
+                    return false;
+                case 3:
+                    dummyRead(m, s->base);
+                    if (s->opcode == 0x7C) s->base += r->x;
+                    return false;
+                case 4:
+                    s->addr = busRead(m, s->base, true);
+                    return false;
+                default:
+                    s->addr |= (uint16_t)busRead(m, s->base + 1, true) << 8;
+                    r->pc = s->addr;
+                    return done(s);
+            }
+        case SEQ_JSR:
+            switch (step) {
+                case 1:
+                    s->addr = fetch(m);
+                    return false;
+                case 2:
+                    dummyRead(m, 0x0100 | r->sp);
+                    return false;
+                case 3:
+                    busPush(m, r->pc >> 8, true);
+                    return false;
+                case 4:
+                    busPush(m, r->pc, true);
+                    return false;
+                default:
+                    s->addr |= (uint16_t)readOperand(m) << 8;
+                    r->pc = s->addr;
+                    return done(s);
+            }
+        case SEQ_RTS:
+            switch (step) {
+                case 1:
+                    dummyRead(m, r->pc);
+                    return false;
+                case 2:
+                    dummyRead(m, 0x0100 | r->sp);
+                    return false;
+                case 3:
+                    s->addr = busPop(m, true);
+                    return false;
+                case 4:
+                    s->addr |= (uint16_t)busPop(m, true) << 8;
+                    r->pc = s->addr;
+                    return false;
+                default:
+                    dummyRead(m, r->pc++);
+                    return done(s);
+            }
+        case SEQ_BRK:
+            switch (step) {
+                case 1:
+                    dummyRead(m, r->pc++);
+                    return false;
+                case 2:
+                    busPush(m, r->pc >> 8, true);
+                    return false;
+                case 3:
+                    busPush(m, r->pc, true);
+                    return false;
+                case 4:
+                    busPush(m, r->p | FLAG_BREAK | FLAG_ONE, true);
+                    return false;
+                case 5:
+                    s->addr = busRead(m, 0xFFFE, true);
+                    return false;
+                default:
+                    s->addr |= (uint16_t)busRead(m, 0xFFFF, true) << 8;
+                    r->pc = s->addr;
+                    return done(s);
+            }
+        case SEQ_RTI:
+            switch (step) {
+                case 1:
+                    dummyRead(m, r->pc);
+                    return false;
+                case 2:
+                    dummyRead(m, 0x0100 | r->sp);
+                    return false;
+                case 3:
+                    r->p = busPop(m, true);
+                    return false;
+                case 4:
+                    s->addr = busPop(m, true);
+                    return false;
+                default:
+                    s->addr |= (uint16_t)busPop(m, true) << 8;
+                    r->pc = s->addr;
+                    return done(s);
+            }
+        case SEQ_SKIP:
+            dummyRead(m, r->pc++);
+            return done(s);
+        case SEQ_SKIPZP:
+            if (step == 1) {
+                s->data = fetch(m);
+                return false;
+            }
+            dummyRead(m, s->data);
+            return done(s);
+        case SEQ_SKIPZPX:
+            switch (step) {
+                case 1:
+                    s->data = fetch(m);
+                    return false;
+                case 2:
+                    dummyRead(m, s->data);
+                    s->data += r->x;
+                    return false;
+                default:
+                    dummyRead(m, s->data);
+                    return done(s);
+            }
+        case SEQ_SKIPABX:
+            switch (step) {
+                case 1:
+                    s->base = fetch(m);
+                    return false;
+                case 2:
+                    s->base |= (uint16_t)readOperand(m) << 8;
+                    ++r->pc;
+                    return false;
+                default:
+                    dummyRead(m, s->base + r->x);
+                    return done(s);
+            }
+        case SEQ_SKIPLONG:
+            if (step <= 2) {
+                dummyRead(m, r->pc++);
+                return false;
+            }
+            busCycles(m, 1, true);
+            return step == 7 && done(s);
+    }
+    return done(s);
+}
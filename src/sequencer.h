@@ -0,0 +1,10 @@
+#ifndef POPPY_SEQUENCER_H
+#define POPPY_SEQUENCER_H
+
+#include <stdbool.h>
+
+#include "machine.h"
+
+bool sequencerCycle(struct machine* m);
+
+#endif
@@ -0,0 +1,335 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cpu.h"
+#include "bus.h"
+#include "fingerprint.h"
+#include "breakpoints.h"
+#include "time.h"
+
+/* Page store */
+/* Snapshots taken close together share almost all of their pages and the ROMs never change, so pages are
+ * deduplicated by their contents. Pages are found with an open addressing hash table keyed by hashPage and
+ * compared in full, so colliding hashes never merge different pages */
+
+#define PAGE_NONE UINT32_MAX
+
+static void* grow(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    return ptr;
+}
+
+void pagestoreInit(struct pagestore* store) {
+    memset(store, 0, sizeof(*store));
+    store->freelist = PAGE_NONE;
+    store->tablemask = 1023;
+    store->table = grow(NULL, (store->tablemask + 1) * sizeof(*store->table));
+    memset(store->table, 0xFF, (store->tablemask + 1) * sizeof(*store->table));
+}
+void pagestoreFree(struct pagestore* store) {
+    free(store->data);
+    free(store->hashes);
+    free(store->refs);
+    free(store->table);
+    memset(store, 0, sizeof(*store));
+}
+
+static void tableInsert(struct pagestore* store, uint32_t id) {
+    uint32_t slot = store->hashes[id] & store->tablemask;
+    while (store->table[slot] != PAGE_NONE) slot = (slot + 1) & store->tablemask;
+    store->table[slot] = id;
+}
+
+/* Backward shift deletion, moves later entries of the probe sequence into the hole so lookups can stop at the
+ * first empty slot */
+static void tableRemove(struct pagestore* store, uint32_t id) {
+    uint32_t slot = store->hashes[id] & store->tablemask;
+    while (store->table[slot] != id) slot = (slot + 1) & store->tablemask;
+    uint32_t hole = slot;
+    for (;;) {
+        slot = (slot + 1) & store->tablemask;
+        uint32_t other = store->table[slot];
+        if (other == PAGE_NONE) break;
+        uint32_t home = store->hashes[other] & store->tablemask;
+        /* Only move entries whose home slot is not between the hole and where they are now */
+        if (((slot - home) & store->tablemask) >= ((slot - hole) & store->tablemask)) {
+            store->table[hole] = other;
+            hole = slot;
+        }
+    }
+    store->table[hole] = PAGE_NONE;
+}
+
+/* Returns the ID of a page with these contents and takes a reference to it, adding it if it is new */
+static uint32_t pageIntern(struct pagestore* store, const uint8_t* page) {
+    uint64_t hash = hashPage(page);
+    for (uint32_t slot = hash & store->tablemask; store->table[slot] != PAGE_NONE;
+         slot = (slot + 1) & store->tablemask) {
+        uint32_t id = store->table[slot];
+        if (store->hashes[id] == hash && !memcmp(store->data[id], page, 256)) {
+            ++store->refs[id];
+            return id;
+        }
+    }
+
+    uint32_t id;
+    if (store->freelist != PAGE_NONE) {
+        id = store->freelist;
+        store->freelist = store->hashes[id];
+    } else {
+        if (store->count == store->capacity) {
+            store->capacity = store->capacity ? store->capacity * 2 : 256;
+            store->data = grow(store->data, store->capacity * sizeof(*store->data));
+            store->hashes = grow(store->hashes, store->capacity * sizeof(*store->hashes));
+            store->refs = grow(store->refs, store->capacity * sizeof(*store->refs));
+        }
+        id = store->count++;
+    }
+    memcpy(store->data[id], page, 256);
+    store->hashes[id] = hash;
+    store->refs[id] = 1;
+    ++store->live;
+
+    /* Keep the table at most half full */
+    if (store->live * 2 > store->tablemask + 1) {
+        free(store->table);
+        store->tablemask = store->tablemask * 2 + 1;
+        store->table = grow(NULL, (store->tablemask + 1) * sizeof(*store->table));
+        memset(store->table, 0xFF, (store->tablemask + 1) * sizeof(*store->table));
+        for (uint32_t other = 0; other < store->count; ++other) {
+            if (store->refs[other] && other != id) tableInsert(store, other);
+        }
+    }
+    tableInsert(store, id);
+    return id;
+}
+
+static void pageRelease(struct pagestore* store, uint32_t id) {
+    if (--store->refs[id]) return;
+    tableRemove(store, id);
+    store->hashes[id] = store->freelist;
+    store->freelist = id;
+    --store->live;
+}
+
+/* Snapshots */
+
+static inline uint8_t* snapshotPage(struct machine* m, unsigned i) {
+    if (i < 128) return &m->sysram[i << 8];
+    if (i < 160) return &m->rom1[(i - 128) << 8];
+    return &m->rom0[(i - 160) << 8];
+}
+
+/* The state of plugin i as a page, zeroes if there is no such plugin or it keeps none */
+static const uint8_t* pluginState(struct machine* m, unsigned i, uint8_t* page) {
+    memset(page, 0, 256);
+    if (i < m->plugincount && m->plugins[i].save) m->plugins[i].save(m->plugins[i].ctx, page);
+    return page;
+}
+
+/* Takes a snapshot of the machine. Given the previous snapshot of the same machine and with bus tracing on, only
+ * the system memory pages written since then are looked up again */
+void snapshotTake(struct pagestore* store, struct machine* m, struct snapshot* s, const struct snapshot* prev) {
+    s->registers = m->registers;
+    s->via = m->via;
+    s->sdcard = m->sdcard;
+    hostioSave(&m->hostio, &s->hostio);
+    s->extirq = m->extirq;
+    for (unsigned i = 0; i < MAX_BANKS; ++i) s->banks[i] = i < m->bankcount ? m->banks[i].selected : 0;
+    s->devicecycles = m->devicecycles;
+    s->floating = m->floating;
+    s->cycles = m->cycles;
+    s->instructions = m->instructions;
+    s->accuratehold = m->accuratehold;
+    s->sequencer = m->sequencer;
+    s->selfloop = m->selfloop;
+    for (unsigned i = 0; i < SNAPSHOT_PAGES; ++i) {
+        bool dirty = i >= 128 || (m->dirtypages[i >> 6] >> (i & 63) & 1);
+        if (i >= SNAPSHOT_HOSTIO) {
+            s->pages[i] = pageIntern(store, (const uint8_t*)m->hostio.names[i - SNAPSHOT_HOSTIO]);
+        } else if (i >= SNAPSHOT_MEMORY) {
+            uint8_t page[256];
+            s->pages[i] = pageIntern(store, pluginState(m, i - SNAPSHOT_MEMORY, page));
+        } else if (prev && m->tracebus && !dirty) {
+            s->pages[i] = prev->pages[i];
+            ++store->refs[s->pages[i]];
+        } else {
+            s->pages[i] = pageIntern(store, snapshotPage(m, i));
+        }
+    }
+    m->dirtypages[0] = m->dirtypages[1] = 0;
+}
+
+/* Puts the machine back into the state of the snapshot, the page table is left as it is but for bank windows */
+void snapshotRestore(const struct pagestore* store, struct machine* m, const struct snapshot* s) {
+    m->registers = s->registers;
+    m->via = s->via;
+    sdcardSetState(&m->sdcard, &s->sdcard); /* the card stays in, in the state it was in then */
+    const char* names[HOSTIO_FILES];
+    for (unsigned i = 0; i < HOSTIO_FILES; ++i) names[i] = (const char*)store->data[s->pages[SNAPSHOT_HOSTIO + i]];
+    hostioRestore(&m->hostio, &s->hostio, names);
+    m->devicecycles = s->devicecycles;
+    m->floating = s->floating;
+    m->cycles = s->cycles;
+    m->instructions = s->instructions;
+    m->accuratehold = s->accuratehold;
+    m->sequencer = s->sequencer;
+    m->accuratehit = false;
+    m->selfloop = s->selfloop;
+    for (unsigned i = 0; i < SNAPSHOT_MEMORY; ++i) {
+        memcpy(snapshotPage(m, i), store->data[s->pages[i]], 256);
+    }
+    m->extirq = s->extirq;
+    if (m->bankcount) {
+        for (unsigned i = 0; i < m->bankcount; ++i) selectBank(m, i, s->banks[i]);
+        mapWatchpoints(m); /* right away instead of before the next instruction, for looking at memory */
+    }
+    clearTimers(m); /* the plugins schedule theirs again */
+    for (unsigned i = 0; i < m->plugincount; ++i) {
+        if (m->plugins[i].load) m->plugins[i].load(m->plugins[i].ctx, store->data[s->pages[SNAPSHOT_MEMORY + i]]);
+    }
+    m->irqline = !(viaIRQ(&m->via) || m->extirq); /* so updateIRQ sets EVENT_IRQ either way */
+    updateIRQ(m);
+    m->dirtypages[0] = m->dirtypages[1] = ~0ULL;
+    if (m->tracebus) m->ramhash = ramHash(m);
+    m->codepagenum = 0x100;
+    m->romcode = ROMCODE_UNCHECKED;
+    /* Pace from now on instead of trying to catch up */
+    m->pacedcycles = m->cycles;
+    getTime(&m->targettime);
+}
+
+void snapshotRelease(struct pagestore* store, struct snapshot* s) {
+    for (unsigned i = 0; i < SNAPSHOT_PAGES; ++i) pageRelease(store, s->pages[i]);
+}
+
+/* Files */
+/* Only the pages the snapshots use are written, with their IDs renumbered from 0 */
+
+static const char snapshotmagic[8] = "POPPYSS7";
+
+bool snapshotSave(const char* file, const struct pagestore* store, const struct snapshot* snapshots, unsigned count) {
+    FILE* fp = fopen(file, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return false;
+    }
+    uint32_t* remap = grow(NULL, (store->count ? store->count : 1) * sizeof(*remap));
+    memset(remap, 0xFF, store->count * sizeof(*remap));
+    uint32_t pages = 0;
+    fwrite(snapshotmagic, 1, sizeof(snapshotmagic), fp);
+    for (unsigned i = 0; i < count; ++i) {
+        for (unsigned j = 0; j < SNAPSHOT_PAGES; ++j) {
+            uint32_t id = snapshots[i].pages[j];
+            if (remap[id] == PAGE_NONE) remap[id] = pages++;
+        }
+    }
+    fwrite(&pages, sizeof(pages), 1, fp);
+    for (uint32_t id = 0; id < store->count; ++id) {
+        if (remap[id] != PAGE_NONE) fwrite(store->data[id], 256, 1, fp);
+    }
+    /* The pages were written in ID order, number them the same way */
+    pages = 0;
+    for (uint32_t id = 0; id < store->count; ++id) {
+        if (remap[id] != PAGE_NONE) remap[id] = pages++;
+    }
+    fwrite(&count, sizeof(count), 1, fp);
+    for (unsigned i = 0; i < count; ++i) {
+        struct snapshot s = snapshots[i];
+        for (unsigned j = 0; j < SNAPSHOT_PAGES; ++j) s.pages[j] = remap[s.pages[j]];
+        fwrite(&s, sizeof(s), 1, fp);
+    }
+    free(remap);
+    bool ok = !ferror(fp);
+    if (fclose(fp) || !ok) {
+        fprintf(stderr, "Failed to write '%s'\n", file);
+        return false;
+    }
+    return true;
+}
+
+/* Returns the snapshots in the file with their pages added to store, NULL on failure */
+struct snapshot* snapshotLoad(const char* file, struct pagestore* store, unsigned* count) {
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", file, strerror(errno));
+        return NULL;
+    }
+    char magic[sizeof(snapshotmagic)];
+    uint32_t pages;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, snapshotmagic, sizeof(magic)) ||
+        fread(&pages, sizeof(pages), 1, fp) != 1) {
+        fprintf(stderr, "'%s' is not a snapshot file\n", file);
+        fclose(fp);
+        return NULL;
+    }
+    uint32_t* ids = grow(NULL, (pages ? pages : 1) * sizeof(*ids));
+    uint8_t page[256];
+    struct snapshot* snapshots = NULL;
+    uint32_t loaded = 0;
+    for (; loaded < pages && fread(page, 256, 1, fp) == 1; ++loaded) ids[loaded] = pageIntern(store, page);
+    if (loaded == pages && fread(count, sizeof(*count), 1, fp) == 1) {
+        snapshots = grow(NULL, (*count ? *count : 1) * sizeof(*snapshots));
+        bool valid = fread(snapshots, sizeof(*snapshots), *count, fp) == *count;
+        for (unsigned i = 0; valid && i < *count; ++i) {
+            for (unsigned j = 0; j < SNAPSHOT_PAGES; ++j) valid = valid && snapshots[i].pages[j] < pages;
+        }
+        if (valid) {
+            for (unsigned i = 0; i < *count; ++i) {
+                for (unsigned j = 0; j < SNAPSHOT_PAGES; ++j) {
+                    snapshots[i].pages[j] = ids[snapshots[i].pages[j]];
+                    ++store->refs[snapshots[i].pages[j]];
+                }
+            }
+        } else {
+            free(snapshots);
+            snapshots = NULL;
+        }
+    }
+    /* The references held while loading */
+    for (uint32_t j = 0; j < loaded; ++j) pageRelease(store, ids[j]);
+    free(ids);
+    fclose(fp);
+    if (!snapshots) fprintf(stderr, "'%s' is truncated or corrupt\n", file);
+    return snapshots;
+}
+
+/* Runs until limit instructions have been executed (0 for no limit), taking a snapshot every interval cycles and
+ * once more at the end, and saves them all to file */
+bool snapshotRun(struct machine* m, const char* file, uint64_t interval, uint64_t limit) {
+    static struct pagestore store;
+    pagestoreInit(&store);
+    unsigned count = 0, capacity = 64;
+    struct snapshot* snapshots = grow(NULL, capacity * sizeof(*snapshots));
+    m->tracebus = true;
+    snapshotTake(&store, m, &snapshots[count++], NULL);
+    uint64_t next = m->cycles + interval;
+    for (;;) {
+        bool done = limit && m->instructions >= limit;
+        if (!done) cpuStep(m);
+        if (done || m->cycles >= next) {
+            if (count == capacity) snapshots = grow(snapshots, (capacity *= 2) * sizeof(*snapshots));
+            snapshotTake(&store, m, &snapshots[count], &snapshots[count - 1]);
+            ++count;
+            next += interval;
+        }
+        if (done) break;
+    }
+    printf(
+        "%u snapshots, %u unique pages (%.1f KiB instead of %.1f KiB)\n",
+        count, store.live, store.live / 4.0, count * (SNAPSHOT_PAGES / 4.0)
+    );
+    bool ok = snapshotSave(file, &store, snapshots, count);
+    for (unsigned i = 0; i < count; ++i) snapshotRelease(&store, &snapshots[i]);
+    free(snapshots);
+    pagestoreFree(&store);
+    return ok;
+}
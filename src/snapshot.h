@@ -0,0 +1,56 @@
+#ifndef POPPY_SNAPSHOT_H
+#define POPPY_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+#include "via.h"
+
+/* Page store */
+/* Every unique 256 byte page is stored once and found again by its contents, snapshots only hold page IDs */
+struct pagestore {
+    uint8_t (*data)[256];
+    uint64_t* hashes; /* content hash of every page, next free ID for freed pages */
+    uint32_t* refs; /* snapshots using every page, 0 for freed pages */
+    uint32_t count; /* IDs handed out so far, including freed ones */
+    uint32_t capacity;
+    uint32_t live; /* pages with references */
+    uint32_t freelist; /* first freed ID, UINT32_MAX if none */
+    uint32_t* table; /* open addressing hash table of page IDs, UINT32_MAX for empty slots */
+    uint32_t tablemask;
+};
+
+/* Snapshots */
+#define SNAPSHOT_MEMORY 192 /* system memory ($00-$7F), then ROM1 and ROM0 ($C0-$FF) */
+#define SNAPSHOT_HOSTIO (SNAPSHOT_MEMORY + MAX_PLUGINS) /* then the state of every plugin */
+#define SNAPSHOT_PAGES (SNAPSHOT_HOSTIO + HOSTIO_FILES) /* then the names of the host files */
+struct snapshot {
+    struct registers registers;
+    struct via via;
+    struct sdcard sdcard; /* the image itself is not part of a snapshot */
+    struct hostiostate hostio; /* neither are the host files, only where they were */
+    uint32_t extirq;
+    uint8_t banks[MAX_BANKS]; /* selected in every bank window */
+    uint64_t devicecycles;
+    uint64_t floating;
+    uint64_t cycles;
+    uint64_t instructions;
+    unsigned accuratehold;
+    struct sequencer sequencer; /* the accurate core can be stopped between the cycles of an instruction */
+    bool selfloop;
+    uint32_t pages[SNAPSHOT_PAGES];
+};
+
+void pagestoreInit(struct pagestore* store);
+void pagestoreFree(struct pagestore* store);
+
+void snapshotTake(struct pagestore* store, struct machine* m, struct snapshot* s, const struct snapshot* prev);
+void snapshotRestore(const struct pagestore* store, struct machine* m, const struct snapshot* s);
+void snapshotRelease(struct pagestore* store, struct snapshot* s);
+
+bool snapshotSave(const char* file, const struct pagestore* store, const struct snapshot* snapshots, unsigned count);
+struct snapshot* snapshotLoad(const char* file, struct pagestore* store, unsigned* count);
+bool snapshotRun(struct machine* m, const char* file, uint64_t interval, uint64_t limit);
+
+#endif
@@ -0,0 +1,440 @@
+#include "sst.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "machine.h"
+#include "cpu.h"
+#include "time.h"
+#include "via.h"
+
+/* SingleStepTests runner */
+/* https://github.com/SingleStepTests/65x02, every file is a JSON array of vectors for one opcode:
+ * {"name": "...", "initial": {"pc": .., "s": .., "a": .., "x": .., "y": .., "p": .., "ram": [[addr, value], ..]},
+ *  "final": {...}, "cycles": [[addr, value, "read" or "write"], ..]} */
+
+#define SST_MAXRAM 64
+#define SST_MAXCYCLES BUSLOG_SIZE
+
+struct sststate {
+    struct registers registers;
+    unsigned ramcount;
+    uint16_t ramaddr[SST_MAXRAM];
+    uint8_t ramvalue[SST_MAXRAM];
+};
+struct sstvector {
+    char name[64];
+    struct sststate initial;
+    struct sststate final;
+    unsigned cyclecount;
+    struct busaccess cycles[SST_MAXCYCLES];
+};
+
+/* Cores every vector is run on */
+static const struct {
+    const char* name;
+    enum core core;
+} sstcores[] = {
+    {"fast", CORE_FAST},
+    {"accurate", CORE_ACCURATE},
+};
+#define SST_CORES (sizeof(sstcores) / sizeof(*sstcores))
+
+/* Streaming JSON reader */
+/* Only what the test files need, the vectors are parsed straight out of the read buffer without building a tree */
+struct reader {
+    FILE* fp;
+    size_t pos, len;
+    bool error;
+    char buf[65536];
+};
+
+static inline int peekChar(struct reader* r) {
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, sizeof(r->buf), r->fp);
+        r->pos = 0;
+        if (!r->len) return EOF;
+    }
+    return (unsigned char)r->buf[r->pos];
+}
+static inline int nextChar(struct reader* r) {
+    int c = peekChar(r);
+    if (c != EOF) ++r->pos;
+    return c;
+}
+static inline int skipSpace(struct reader* r) {
+    int c;
+    while ((c = peekChar(r)) == ' ' || c == '\n' || c == '\r' || c == '\t') ++r->pos;
+    return c;
+}
+static inline bool expectChar(struct reader* r, char expected) {
+    if (skipSpace(r) == expected) {
+        ++r->pos;
+        return true;
+    }
+    r->error = true;
+    return false;
+}
+/* Consumes a ',' and returns true, or returns false at the closing bracket */
+static bool nextElement(struct reader* r, char close) {
+    int c = skipSpace(r);
+    if (c == ',') {
+        ++r->pos;
+        return true;
+    }
+    if (c != close) r->error = true;
+    return false;
+}
+static bool parseNumber(struct reader* r, long* out) {
+    bool negative = false;
+    if (skipSpace(r) == '-') {
+        negative = true;
+        ++r->pos;
+    }
+    int c = peekChar(r);
+    if (c < '0' || c > '9') {
+        r->error = true;
+        return false;
+    }
+    long value = 0;
+    while ((c = peekChar(r)) >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        ++r->pos;
+    }
+    *out = negative ? -value : value;
+    return true;
+}
+static bool parseString(struct reader* r, char* out, size_t size) {
+    if (!expectChar(r, '"')) return false;
+    size_t len = 0;
+    int c;
+    while ((c = nextChar(r)) != '"') {
+        if (c == EOF) {
+            r->error = true;
+            return false;
+        }
+        if (c == '\\') c = nextChar(r); /* the test files don't use any escapes that aren't the character itself */
+        if (len + 1 < size) out[len++] = c;
+    }
+    out[len] = 0;
+    return true;
+}
+static bool skipValue(struct reader* r) {
+    int c = skipSpace(r);
+    if (c == '"') {
+        char dummy[1];
+        return parseString(r, dummy, sizeof(dummy));
+    }
+    if (c == '[' || c == '{') {
+        char close = c == '[' ? ']' : '}';
+        ++r->pos;
+        if (skipSpace(r) == close) {
+            ++r->pos;
+            return true;
+        }
+        do {
+            if (close == '}') {
+                char key[1];
+                if (!parseString(r, key, sizeof(key)) || !expectChar(r, ':')) return false;
+            }
+            if (!skipValue(r)) return false;
+        } while (nextElement(r, close));
+        return expectChar(r, close);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        long dummy;
+        return parseNumber(r, &dummy);
+    }
+    /* true, false, null */
+    while ((c = peekChar(r)) >= 'a' && c <= 'z') ++r->pos;
+    return true;
+}
+
+static bool parseState(struct reader* r, struct sststate* state) {
+    state->ramcount = 0;
+    if (!expectChar(r, '{')) return false;
+    do {
+        char key[8];
+        long value;
+        if (!parseString(r, key, sizeof(key)) || !expectChar(r, ':')) return false;
+        if (!strcmp(key, "ram")) {
+            if (!expectChar(r, '[')) return false;
+            if (skipSpace(r) == ']') {
+                ++r->pos;
+                continue;
+            }
+            do {
+                long addr;
+                if (!expectChar(r, '[') || !parseNumber(r, &addr) || !expectChar(r, ',') ||
+                    !parseNumber(r, &value) || !expectChar(r, ']')) return false;
+                if (state->ramcount == SST_MAXRAM) {
+                    r->error = true;
+                    return false;
+                }
+                state->ramaddr[state->ramcount] = addr;
+                state->ramvalue[state->ramcount] = value;
+                ++state->ramcount;
+            } while (nextElement(r, ']'));
+            if (!expectChar(r, ']')) return false;
+        } else if (!strcmp(key, "pc")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.pc = value;
+        } else if (!strcmp(key, "s")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.sp = value;
+        } else if (!strcmp(key, "a")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.a = value;
+        } else if (!strcmp(key, "x")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.x = value;
+        } else if (!strcmp(key, "y")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.y = value;
+        } else if (!strcmp(key, "p")) {
+            if (!parseNumber(r, &value)) return false;
+            state->registers.p = value;
+        } else if (!skipValue(r)) {
+            return false;
+        }
+    } while (nextElement(r, '}'));
+    return expectChar(r, '}');
+}
+static bool parseCycles(struct reader* r, struct sstvector* vector) {
+    vector->cyclecount = 0;
+    if (!expectChar(r, '[')) return false;
+    if (skipSpace(r) == ']') {
+        ++r->pos;
+        return true;
+    }
+    do {
+        long addr, value;
+        char type[8];
+        if (!expectChar(r, '[') || !parseNumber(r, &addr) || !expectChar(r, ',') || !parseNumber(r, &value) ||
+            !expectChar(r, ',') || !parseString(r, type, sizeof(type)) || !expectChar(r, ']')) return false;
+        if (vector->cyclecount < SST_MAXCYCLES) {
+            vector->cycles[vector->cyclecount] = (struct busaccess){
+                .addr = addr, .value = value, .write = !strcmp(type, "write")
+            };
+        }
+        ++vector->cyclecount;
+    } while (nextElement(r, ']'));
+    return expectChar(r, ']');
+}
+/* Parses the next vector in the array, returns false at the end of the array or on an error */
+static bool parseVector(struct reader* r, struct sstvector* vector, bool first) {
+    if (first) {
+        if (!expectChar(r, '[')) return false;
+        if (skipSpace(r) == ']') return false;
+    } else if (!nextElement(r, ']')) {
+        return false;
+    }
+    vector->name[0] = 0;
+    if (!expectChar(r, '{')) return false;
+    do {
+        char key[16];
+        if (!parseString(r, key, sizeof(key)) || !expectChar(r, ':')) return false;
+        bool ok;
+        if (!strcmp(key, "name")) ok = parseString(r, vector->name, sizeof(vector->name));
+        else if (!strcmp(key, "initial")) ok = parseState(r, &vector->initial);
+        else if (!strcmp(key, "final")) ok = parseState(r, &vector->final);
+        else if (!strcmp(key, "cycles")) ok = parseCycles(r, vector);
+        else ok = skipValue(r);
+        if (!ok) return false;
+    } while (nextElement(r, '}'));
+    return expectChar(r, '}');
+}
+
+/* Running */
+
+struct sstresult {
+    const char* file;
+    bool error; /* the file could not be read or parsed */
+    uint64_t vectors;
+    uint64_t passed[SST_CORES];
+    char failure[SST_CORES][200]; /* why the first failing vector failed */
+};
+
+/* Returns NULL if the machine matches the vector, otherwise a description of the first difference */
+static const char* checkVector(struct machine* m, const uint8_t* mem, const struct sstvector* vector, char* buf,
+    size_t size) {
+    const struct registers* want = &vector->final.registers;
+    const struct registers* got = &m->registers;
+    #define CHECK_REGISTER(reg, fmt) \
+        if (got->reg != want->reg) { \
+            snprintf(buf, size, #reg ": expected " fmt ", got " fmt, want->reg, got->reg); \
+            return buf; \
+        }
+    CHECK_REGISTER(pc, "$%04X");
+    CHECK_REGISTER(sp, "$%02X");
+    CHECK_REGISTER(a, "$%02X");
+    CHECK_REGISTER(x, "$%02X");
+    CHECK_REGISTER(y, "$%02X");
+    CHECK_REGISTER(p, "$%02X");
+    #undef CHECK_REGISTER
+    for (unsigned i = 0; i < vector->final.ramcount; ++i) {
+        uint16_t addr = vector->final.ramaddr[i];
+        if (mem[addr] != vector->final.ramvalue[i]) {
+            snprintf(buf, size, "$%04X: expected $%02X, got $%02X", addr, vector->final.ramvalue[i], mem[addr]);
+            return buf;
+        }
+    }
+    unsigned count = vector->cyclecount < SST_MAXCYCLES ? vector->cyclecount : SST_MAXCYCLES;
+    for (unsigned i = 0; i < count && i < m->buslogcount; ++i) {
+        const struct busaccess* x = &vector->cycles[i];
+        const struct busaccess* y = &m->buslog[i];
+        if (x->addr != y->addr || x->value != y->value || x->write != y->write) {
+            snprintf(
+                buf, size, "cycle %u: expected %c $%04X: $%02X, got %c $%04X: $%02X", i + 1,
+                x->write ? 'W' : 'R', x->addr, x->value, y->write ? 'W' : 'R', y->addr, y->value
+            );
+            return buf;
+        }
+    }
+    if (m->buslogcount != vector->cyclecount) {
+        snprintf(buf, size, "expected %u cycles, got %u", vector->cyclecount, m->buslogcount);
+        return buf;
+    }
+    return NULL;
+}
+
+static void runFile(struct sstresult* result, struct machine* m, uint8_t* mem, struct sstvector* vector,
+    struct reader* r) {
+    r->fp = fopen(result->file, "rb");
+    if (!r->fp) {
+        snprintf(result->failure[0], sizeof(result->failure[0]), "%s", strerror(errno));
+        result->error = true;
+        return;
+    }
+    r->pos = r->len = 0;
+    r->error = false;
+    for (bool first = true; parseVector(r, vector, first); first = false) {
+        ++result->vectors;
+        for (unsigned core = 0; core < SST_CORES; ++core) {
+            for (unsigned i = 0; i < vector->initial.ramcount; ++i) {
+                mem[vector->initial.ramaddr[i]] = vector->initial.ramvalue[i];
+            }
+            m->registers = vector->initial.registers;
+            m->core = sstcores[core].core;
+            cpuStep(m);
+            char buf[128];
+            const char* failure = checkVector(m, mem, vector, buf, sizeof(buf));
+            if (!failure) {
+                ++result->passed[core];
+            } else if (!result->failure[core][0]) {
+                snprintf(result->failure[core], sizeof(result->failure[core]), "%s: %s", vector->name, failure);
+            }
+            /* Put back every byte the vector touched to zero for the next one */
+            for (unsigned i = 0; i < vector->initial.ramcount; ++i) mem[vector->initial.ramaddr[i]] = 0;
+            for (unsigned i = 0; i < vector->final.ramcount; ++i) mem[vector->final.ramaddr[i]] = 0;
+            unsigned count = m->buslogcount < BUSLOG_SIZE ? m->buslogcount : BUSLOG_SIZE;
+            for (unsigned i = 0; i < count; ++i) {
+                if (m->buslog[i].write) mem[m->buslog[i].addr] = 0;
+            }
+        }
+    }
+    if (r->error) {
+        snprintf(result->failure[0], sizeof(result->failure[0]), "parse error after %" PRIu64 " vectors",
+            result->vectors);
+        result->error = true;
+    }
+    fclose(r->fp);
+}
+
+struct sstworker {
+    struct sstresult* results;
+    int count;
+    atomic_int* next;
+};
+
+static void* sstThread(void* arg) {
+    struct sstworker* worker = arg;
+    /* Every thread gets its own machine with a flat 64K of RAM and no devices in the way */
+    struct machine* m = calloc(1, sizeof(*m));
+    uint8_t* mem = calloc(1, 65536);
+    struct sstvector* vector = malloc(sizeof(*vector));
+    struct reader* r = malloc(sizeof(*r));
+    if (!m || !mem || !vector || !r) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    mapFlat(m, mem);
+    viaReset(&m->via);
+    m->fastmode = true;
+    m->tracebus = true;
+    int i;
+    while ((i = atomic_fetch_add(worker->next, 1)) < worker->count) {
+        runFile(&worker->results[i], m, mem, vector, r);
+    }
+    free(r);
+    free(vector);
+    free(mem);
+    free(m);
+    return NULL;
+}
+
+/* Runs every file on all cores with the given number of threads and prints the results for every opcode, returns
+ * the exit status */
+int runSingleStepTests(char** files, int count, int threads) {
+    struct sstresult* results = calloc(count, sizeof(*results));
+    pthread_t* tids = calloc(threads, sizeof(*tids));
+    if (!results || !tids) {
+        fputs("Out of memory\n", stderr);
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) results[i].file = files[i];
+
+    struct timespec start, end;
+    getTime(&start);
+    atomic_int next = 0;
+    struct sstworker worker = {.results = results, .count = count, .next = &next};
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&tids[i], NULL, sstThread, &worker)) {
+            fprintf(stderr, "Failed to start thread: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    for (int i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+    getTime(&end);
+    subTime(&end, &start);
+
+    uint64_t vectors = 0;
+    int status = 0;
+    for (int i = 0; i < count; ++i) {
+        const struct sstresult* result = &results[i];
+        const char* name = strrchr(result->file, '/');
+        name = name ? name + 1 : result->file;
+        if (result->error) {
+            printf("%-12s ERROR %s\n", name, result->failure[0]);
+            status = 1;
+            continue;
+        }
+        vectors += result->vectors;
+        printf("%-12s", name);
+        for (unsigned core = 0; core < SST_CORES; ++core) {
+            bool pass = result->passed[core] == result->vectors;
+            if (!pass) status = 1;
+            printf("  %s %s %" PRIu64 "/%" PRIu64, sstcores[core].name, pass ? "PASS" : "FAIL",
+                result->passed[core], result->vectors);
+        }
+        putchar('\n');
+        for (unsigned core = 0; core < SST_CORES; ++core) {
+            if (result->failure[core][0]) printf("    %s: %s\n", sstcores[core].name, result->failure[core]);
+        }
+    }
+    double seconds = end.tv_sec + end.tv_nsec / 1e9;
+    printf(
+        "%" PRIu64 " vectors on %u cores in %.3f s with %d threads (%.0f vectors/s)\n",
+        vectors, (unsigned)SST_CORES, seconds, threads, seconds > 0 ? vectors * SST_CORES / seconds : 0
+    );
+    free(tids);
+    free(results);
+    return status;
+}
@@ -0,0 +1,6 @@
+#ifndef POPPY_SST_H
+#define POPPY_SST_H
+
+int runSingleStepTests(char** files, int count, int threads);
+
+#endif
@@ -0,0 +1,229 @@
+#include "symbols.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+/* Symbols */
+/* Labels from ca65/ld65 debug files (ld65 --dbgfile), VICE label files (ca65 -Ln, "al C:E000 .reset") and plain
+ * "label = $E000" maps. The whole file is read at once and parsed in place, names go into one growing buffer and
+ * the list is sorted once per file in linear time, so lookups are a binary search for the last label at or below an
+ * address */
+
+static void* grow(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    return ptr;
+}
+
+void symbolsInit(struct symbols* s) {
+    memset(s, 0, sizeof(*s));
+}
+void symbolsFree(struct symbols* s) {
+    free(s->list);
+    free(s->names);
+    memset(s, 0, sizeof(*s));
+}
+
+static void addSymbol(struct symbols* s, const char* name, size_t len, unsigned long addr, unsigned long size) {
+    if (!len || addr > 0xFFFF) return;
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 1024;
+        s->list = grow(s->list, s->capacity * sizeof(*s->list));
+    }
+    if (s->namesize + len + 1 > s->namecapacity) {
+        while (s->namesize + len + 1 > s->namecapacity) s->namecapacity = s->namecapacity ? s->namecapacity * 2 : 16384;
+        s->names = grow(s->names, s->namecapacity);
+    }
+    memcpy(s->names + s->namesize, name, len);
+    s->names[s->namesize + len] = 0;
+    s->list[s->count++] = (struct symbol){.addr = addr, .size = size, .name = s->namesize};
+    s->namesize += len + 1;
+}
+
+/* $E000, 0xE000 or plain decimal */
+static bool parseValue(const char* str, const char* end, unsigned long* out) {
+    int base = 10;
+    if (str < end && *str == '$') {
+        ++str;
+        base = 16;
+    } else if (end - str > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+        base = 16;
+    }
+    char* stop;
+    *out = strtoul(str, &stop, base);
+    return stop != str && stop <= end;
+}
+
+/* sym id=3,name="reset",addrsize=absolute,size=3,scope=0,def=12,ref=40,val=0xE000,seg=1,type=lab */
+static void parseDebugSymbol(struct symbols* s, const char* line, const char* end) {
+    const char* name = NULL;
+    size_t namelen = 0;
+    unsigned long addr = 0, size = 0;
+    bool hasaddr = false, label = false;
+    const char* p = line;
+    while (p < end) {
+        const char* eq = memchr(p, '=', end - p);
+        if (!eq) break;
+        const char* value = eq + 1;
+        const char* next;
+        if (*value == '"') {
+            const char* close = memchr(value + 1, '"', end - value - 1);
+            if (!close) break;
+            next = close + 1;
+        } else {
+            next = memchr(value, ',', end - value);
+            if (!next) next = end;
+        }
+        size_t keylen = eq - p;
+        if (keylen == 4 && !memcmp(p, "name", 4) && *value == '"') {
+            name = value + 1;
+            namelen = next - value - 2;
+        } else if (keylen == 3 && !memcmp(p, "val", 3)) {
+            hasaddr = parseValue(value, next, &addr);
+        } else if (keylen == 4 && !memcmp(p, "size", 4)) {
+            parseValue(value, next, &size);
+        } else if (keylen == 4 && !memcmp(p, "type", 4)) {
+            label = next - value == 3 && !memcmp(value, "lab", 3); /* equates are numbers, imports repeat exports */
+        }
+        p = next < end ? next + 1 : end;
+    }
+    if (name && hasaddr && label) addSymbol(s, name, namelen, addr, size);
+}
+
+/* al C:E000 .reset */
+static void parseViceLabel(struct symbols* s, const char* line, const char* end) {
+    const char* p = line + 3;
+    while (p < end && *p == ' ') ++p;
+    if (end - p > 2 && p[1] == ':') p += 2;
+    char* stop;
+    unsigned long addr = strtoul(p, &stop, 16);
+    if (stop == p || stop >= end) return;
+    p = stop;
+    while (p < end && (*p == ' ' || *p == '.')) ++p;
+    const char* name = p;
+    while (p < end && !isspace((unsigned char)*p)) ++p;
+    addSymbol(s, name, p - name, addr, 0);
+}
+
+/* label = $E000, label := $E000 */
+static void parseAssignment(struct symbols* s, const char* line, const char* end) {
+    const char* p = line;
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_' || *p == '.' || *p == '@')) ++p;
+    const char* nameend = p;
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    if (p < end && *p == ':') ++p;
+    if (p >= end || *p != '=') return;
+    ++p;
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    unsigned long addr;
+    if (parseValue(p, end, &addr)) addSymbol(s, line, nameend - line, addr, 0);
+}
+
+/* Counting sort on the address, which is stable so labels at the same address stay in the order they were loaded.
+ * The first label at every address is the one shown for it and gets the size of any other */
+static void sortSymbols(struct symbols* s) {
+    uint32_t* starts = grow(NULL, 65537 * sizeof(*starts));
+    memset(starts, 0, 65537 * sizeof(*starts));
+    for (unsigned i = 0; i < s->count; ++i) ++starts[s->list[i].addr + 1];
+    for (unsigned addr = 0; addr < 65536; ++addr) starts[addr + 1] += starts[addr];
+    struct symbol* sorted = grow(NULL, (s->count ? s->count : 1) * sizeof(*sorted));
+    for (unsigned i = 0; i < s->count; ++i) sorted[starts[s->list[i].addr]++] = s->list[i];
+    free(starts);
+    free(s->list);
+    s->list = sorted;
+    s->capacity = s->count ? s->count : 1;
+
+    unsigned first = 0;
+    for (unsigned i = 0; i < s->count; ++i) {
+        s->list[i].alias = i && s->list[i - 1].addr == s->list[i].addr;
+        if (!s->list[i].alias) first = i;
+        else if (!s->list[first].size) s->list[first].size = s->list[i].size;
+    }
+}
+
+/* Adds the labels in a file, the format is worked out line by line */
+bool symbolsLoad(struct symbols* s, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* text = grow(NULL, length > 0 ? length + 1 : 1);
+    if (length < 0 || fread(text, 1, length, fp) != (size_t)length) {
+        fprintf(stderr, "Failed to read '%s'\n", path);
+        free(text);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    text[length] = 0; /* strtoul in the parsers can read past the last line */
+
+    const char* end = text + length;
+    for (const char* line = text; line < end;) {
+        const char* eol = memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        const char* last = eol;
+        while (last > line && isspace((unsigned char)last[-1])) --last;
+        while (line < last && isspace((unsigned char)*line)) ++line;
+        if (last - line > 4 && !memcmp(line, "sym", 3) && isspace((unsigned char)line[3])) {
+            parseDebugSymbol(s, line + 4, last);
+        } else if (last - line > 3 && !memcmp(line, "al ", 3)) {
+            parseViceLabel(s, line, last);
+        } else if (line < last && *line != ';' && *line != '#') {
+            parseAssignment(s, line, last);
+        }
+        line = eol + 1;
+    }
+    free(text);
+    sortSymbols(s);
+    return true;
+}
+
+/* The label covering addr and how far into it addr is, NULL if there is none */
+const char* symbolLookup(const struct symbols* s, uint16_t addr, uint16_t* offset) {
+    if (!s) return NULL;
+    unsigned lo = 0, hi = s->count; /* first label above addr */
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (s->list[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo && s->list[lo - 1].alias) --lo;
+    if (!lo) return NULL;
+    const struct symbol* sym = &s->list[lo - 1];
+    if (sym->size && (uint32_t)(addr - sym->addr) >= sym->size) return NULL;
+    *offset = addr - sym->addr;
+    return s->names + sym->name;
+}
+
+/* Address of a label by name */
+bool symbolFind(const struct symbols* s, const char* name, uint16_t* addr) {
+    if (!s) return false;
+    for (unsigned i = 0; i < s->count; ++i) {
+        if (!strcmp(s->names + s->list[i].name, name)) {
+            *addr = s->list[i].addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Writes "routine" or "routine+$12", returns false and writes nothing if no label covers addr */
+bool symbolFormat(const struct symbols* s, uint16_t addr, char* out, size_t size) {
+    uint16_t offset;
+    const char* name = symbolLookup(s, addr, &offset);
+    if (!name) return false;
+    if (offset) snprintf(out, size, "%s+$%X", name, offset);
+    else snprintf(out, size, "%s", name);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef POPPY_SYMBOLS_H
+#define POPPY_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Symbols */
+/* Labels sorted by address, every label covers the addresses up to the next one or its size if the file gave one.
+ * Where several are at one address the first one loaded names it, the others are aliases only found by name */
+struct symbol {
+    uint16_t addr;
+    bool alias; /* another label at the same address comes first */
+    uint32_t size; /* 0 if unknown */
+    uint32_t name; /* offset into the name buffer */
+};
+struct symbols {
+    struct symbol* list;
+    unsigned count;
+    unsigned capacity;
+    char* names; /* all names, NUL terminated */
+    size_t namesize;
+    size_t namecapacity;
+};
+
+void symbolsInit(struct symbols* s);
+void symbolsFree(struct symbols* s);
+bool symbolsLoad(struct symbols* s, const char* path);
+const char* symbolLookup(const struct symbols* s, uint16_t addr, uint16_t* offset);
+bool symbolFind(const struct symbols* s, const char* name, uint16_t* addr);
+bool symbolFormat(const struct symbols* s, uint16_t addr, char* out, size_t size);
+
+#endif
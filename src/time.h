@@ -28,7 +28,7 @@ static inline void getTime(struct timespec* out) {
 static inline void waitFor(struct timespec* amount) {
     nanosleep(amount, NULL);
 }
-static void waitUntil(struct timespec* target) {
+static inline void waitUntil(struct timespec* target) {
     struct timespec curtime;
     getTime(&curtime);
     struct timespec amount = *target;
@@ -0,0 +1,52 @@
+#ifndef POPPY_UCODE_H
+#define POPPY_UCODE_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+/* Microcode */
+static inline void ucodeSetZNFlags(uint8_t value, uint8_t* flags) {
+    if (value) {
+        /* The value is non-zero so mask out the zero flag and do a negative check */
+        *flags &= ~FLAG_ZERO;
+        if (value & 0x80) { /* Check if bit 7 is 1 */
+            *flags |= FLAG_NEGATIVE;
+        } else {
+            *flags &= ~FLAG_NEGATIVE;
+        }
+    } else {
+        /* The value is zero and cannot be negative so mask out the negative flag */
+        *flags |= FLAG_ZERO;
+        *flags &= ~FLAG_NEGATIVE;
+    }
+}
+/* https://www.masswerk.at/6502/6502_instruction_set.html#arithmetic */
+/* https://www.righto.com/2012/12/the-6502-overflow-flag-explained.html */
+static inline uint8_t ucodeAddWithCarry(uint8_t a, uint8_t b, uint8_t* flags) {
+    uint16_t result = a + b + ((*flags & FLAG_CARRY) != 0);
+    ucodeSetZNFlags(result, flags);
+    if (result & 0x100) *flags |= FLAG_CARRY;
+    else *flags &= ~FLAG_CARRY;
+    if ((a ^ result) & (b ^ result) & 0x80) *flags |= FLAG_OVERFLOW;
+    else *flags &= ~FLAG_OVERFLOW;
+    return result;
+}
+static inline uint8_t ucodeSubWithCarry(uint8_t a, uint8_t b, uint8_t* flags) {
+    b = 255 - b;
+    uint16_t result = a + b + ((*flags & FLAG_CARRY) != 0);
+    ucodeSetZNFlags(result, flags);
+    if (result & 0x100) *flags |= FLAG_CARRY;
+    else *flags &= ~FLAG_CARRY;
+    if ((a ^ result) & (b ^ result) & 0x80) *flags |= FLAG_OVERFLOW;
+    else *flags &= ~FLAG_OVERFLOW;
+    return result;
+}
+/* CMP, CPX and CPY set the flags like a subtraction without the borrow in, and discard the result */
+static inline void ucodeCompare(uint8_t reg, uint8_t value, uint8_t* flags) {
+    ucodeSetZNFlags(reg - value, flags);
+    if (reg >= value) *flags |= FLAG_CARRY;
+    else *flags &= ~FLAG_CARRY;
+}
+
+#endif
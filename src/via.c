@@ -0,0 +1,174 @@
+#include "via.h"
+
+#include <string.h>
+
+void viaReset(struct via* via) {
+    memset(via, 0, sizeof(*via));
+    /* Nothing is attached to the ports yet, so the inputs float high */
+    via->pina = 0xFF;
+    via->pinb = 0xFF;
+}
+
+static void tickTimer1(struct via* via, uint64_t n) {
+    if (via->t1reload && n) {
+        /* The cycle after a free-run time-out loads the latch, so the counter shows $FFFF for one cycle */
+        via->t1reload = false;
+        if (via->acr & 0x40) via->t1 = via->t1latch;
+        else via->t1 = 0xFFFE;
+        --n;
+    }
+    if (n <= via->t1) {
+        via->t1 -= n;
+        return;
+    }
+    /* The counter times out when it goes from $0000 to $FFFF */
+    n -= (uint64_t)via->t1 + 1;
+    if (via->t1armed) {
+        via->ifr |= VIA_INT_T1;
+        if (!(via->acr & 0x40)) via->t1armed = false; /* One-shot mode only interrupts once */
+    }
+    if (!(via->acr & 0x40)) {
+        /* One-shot mode keeps counting down */
+        via->t1 = 0xFFFF - n;
+        return;
+    }
+    /* Free-run mode reloads the latch on the cycle after the time-out, so a period is latch + 2 cycles */
+    uint64_t into = n % ((uint64_t)via->t1latch + 2);
+    via->t1reload = into == 0;
+    via->t1 = into ? via->t1latch - (into - 1) : 0xFFFF;
+}
+
+static void tickTimer2(struct via* via, uint64_t n) {
+    if (via->acr & 0x20) return; /* Pulse counting mode, PB6 is not emulated */
+    if (n > via->t2 && via->t2armed) {
+        via->ifr |= VIA_INT_T2;
+        via->t2armed = false; /* Timer 2 is always one-shot */
+    }
+    via->t2 -= n;
+}
+
+/* Advance the VIA by n clock cycles */
+void viaTick(struct via* via, uint64_t n) {
+    tickTimer1(via, n);
+    tickTimer2(via, n);
+}
+
+uint8_t viaRead(struct via* via, uint16_t addr) {
+    uint8_t ret;
+    switch (addr & 0xF) { /* the VIA is mirrored across its whole region */
+        default: /* VIA_ORB */
+            via->ifr &= ~(VIA_INT_CB1 | VIA_INT_CB2);
+            ret = (via->orb & via->ddrb) | (via->pinb & ~via->ddrb);
+            break;
+        case VIA_ORA:
+            via->ifr &= ~(VIA_INT_CA1 | VIA_INT_CA2);
+            /* fallthrough */
+        case VIA_ORAN:
+            ret = (via->ora & via->ddra) | (via->pina & ~via->ddra);
+            break;
+        case VIA_DDRB:
+            ret = via->ddrb;
+            break;
+        case VIA_DDRA:
+            ret = via->ddra;
+            break;
+        case VIA_T1CL: /* Reading the low counter acknowledges the interrupt */
+            via->ifr &= ~VIA_INT_T1;
+            ret = via->t1;
+            break;
+        case VIA_T1CH:
+            ret = via->t1 >> 8;
+            break;
+        case VIA_T1LL:
+            ret = via->t1latch;
+            break;
+        case VIA_T1LH:
+            ret = via->t1latch >> 8;
+            break;
+        case VIA_T2CL:
+            via->ifr &= ~VIA_INT_T2;
+            ret = via->t2;
+            break;
+        case VIA_T2CH:
+            ret = via->t2 >> 8;
+            break;
+        case VIA_SR: /* Shifting is not emulated, the register just holds its value */
+            via->ifr &= ~VIA_INT_SR;
+            ret = via->sr;
+            break;
+        case VIA_ACR:
+            ret = via->acr;
+            break;
+        case VIA_PCR:
+            ret = via->pcr;
+            break;
+        case VIA_IFR:
+            ret = via->ifr | (viaIRQ(via) ? VIA_INT_ANY : 0);
+            break;
+        case VIA_IER:
+            ret = via->ier | 0x80;
+            break;
+    }
+    return ret;
+}
+
+void viaWrite(struct via* via, uint16_t addr, uint8_t value) {
+    switch (addr & 0xF) {
+        default: /* VIA_ORB */
+            via->ifr &= ~(VIA_INT_CB1 | VIA_INT_CB2);
+            via->orb = value;
+            break;
+        case VIA_ORA:
+            via->ifr &= ~(VIA_INT_CA1 | VIA_INT_CA2);
+            /* fallthrough */
+        case VIA_ORAN:
+            via->ora = value;
+            break;
+        case VIA_DDRB:
+            via->ddrb = value;
+            break;
+        case VIA_DDRA:
+            via->ddra = value;
+            break;
+        case VIA_T1CL:
+        case VIA_T1LL:
+            via->t1latch = (via->t1latch & 0xFF00) | value;
+            break;
+        case VIA_T1CH: /* Writing the high counter loads the counter from the latch and starts the timer */
+            via->t1latch = (via->t1latch & 0x00FF) | (uint16_t)value << 8;
+            via->t1 = via->t1latch;
+            via->t1reload = false;
+            via->ifr &= ~VIA_INT_T1;
+            via->t1armed = true;
+            break;
+        case VIA_T1LH:
+            via->t1latch = (via->t1latch & 0x00FF) | (uint16_t)value << 8;
+            via->ifr &= ~VIA_INT_T1;
+            break;
+        case VIA_T2CL:
+            via->t2latch = value;
+            break;
+        case VIA_T2CH:
+            via->t2 = via->t2latch | (uint16_t)value << 8;
+            via->ifr &= ~VIA_INT_T2;
+            via->t2armed = true;
+            break;
+        case VIA_SR:
+            via->ifr &= ~VIA_INT_SR;
+            via->sr = value;
+            break;
+        case VIA_ACR:
+            via->acr = value;
+            break;
+        case VIA_PCR:
+            via->pcr = value;
+            break;
+        case VIA_IFR: /* Writing a 1 clears the flag */
+            via->ifr &= ~value & 0x7F;
+            break;
+        case VIA_IER: /* Bit 7 selects between setting and clearing the written bits */
+            if (value & 0x80) via->ier |= value & 0x7F;
+            else via->ier &= ~value;
+            break;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef POPPY_VIA_H
+#define POPPY_VIA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 65C22 Versatile Interface Adapter */
+/* http://archive.6502.org/datasheets/wdc_w65c22_sep_2010.pdf */
+
+/* Registers (the bottom 4 bits of the address) */
+#define VIA_ORB  0x0 /* Output/input register B */
+#define VIA_ORA  0x1 /* Output/input register A */
+#define VIA_DDRB 0x2 /* Data direction register B */
+#define VIA_DDRA 0x3 /* Data direction register A */
+#define VIA_T1CL 0x4 /* Timer 1 counter low */
+#define VIA_T1CH 0x5 /* Timer 1 counter high */
+#define VIA_T1LL 0x6 /* Timer 1 latch low */
+#define VIA_T1LH 0x7 /* Timer 1 latch high */
+#define VIA_T2CL 0x8 /* Timer 2 counter low */
+#define VIA_T2CH 0x9 /* Timer 2 counter high */
+#define VIA_SR   0xA /* Shift register */
+#define VIA_ACR  0xB /* Auxiliary control register */
+#define VIA_PCR  0xC /* Peripheral control register */
+#define VIA_IFR  0xD /* Interrupt flag register */
+#define VIA_IER  0xE /* Interrupt enable register */
+#define VIA_ORAN 0xF /* Output/input register A without handshake */
+
+/* Interrupt flags */
+#define VIA_INT_CA2 (1U << 0)
+#define VIA_INT_CA1 (1U << 1)
+#define VIA_INT_SR  (1U << 2)
+#define VIA_INT_CB2 (1U << 3)
+#define VIA_INT_CB1 (1U << 4)
+#define VIA_INT_T2  (1U << 5)
+#define VIA_INT_T1  (1U << 6)
+#define VIA_INT_ANY (1U << 7)
+
+struct via {
+    uint8_t orb, ora; /* Output registers */
+    uint8_t ddrb, ddra; /* Data direction registers (1 for output) */
+    uint8_t pinb, pina; /* Levels driven onto the input pins from outside */
+    uint16_t t1, t1latch; /* Timer 1 counter and latch */
+    uint16_t t2; /* Timer 2 counter */
+    uint8_t t2latch; /* Timer 2 low latch */
+    bool t1armed, t2armed; /* If the timer will raise its interrupt flag on the next time-out */
+    bool t1reload; /* Free-running timer 1 timed out and loads the latch on the next cycle */
+    uint8_t sr, acr, pcr;
+    uint8_t ifr, ier;
+};
+
+void viaReset(struct via* via);
+void viaTick(struct via* via, uint64_t n);
+uint8_t viaRead(struct via* via, uint16_t addr);
+void viaWrite(struct via* via, uint16_t addr, uint8_t value);
+
+/* Cycles the VIA can be left alone for before a timer can time out and set an interrupt flag */
+static inline uint32_t viaQuietCycles(const struct via* via) {
+    uint32_t quiet = UINT32_MAX;
+    if (via->t1armed) quiet = via->t1reload ? 1 + (uint32_t)via->t1latch : via->t1;
+    if (via->t2armed && !(via->acr & 0x20) && via->t2 < quiet) quiet = via->t2;
+    return quiet;
+}
+
+/* If the IRQ output is asserted */
+static inline bool viaIRQ(const struct via* via) {
+    return via->ifr & via->ier & 0x7F;
+}
+
+#endif